@@ -0,0 +1,405 @@
+/*
+ * File: filesystem-client.c
+ *
+ * This file contains the source code of the client library for
+ * filesystem-server, as declared in filesystem-client.h.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#define _POSIX_C_SOURCE 200809L
+
+#include "filesystem-client.h"
+#include "filesystem-protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* -------------------- Function Prototypes -------------------- */
+static int wait_for_input(Fs_client *const client);
+static int read_input(Fs_client *const client, size_t size);
+static int reserve(char **buffer, size_t *capacity, size_t size);
+static void put_number(char bytes[], unsigned long number, int size);
+static unsigned long get_number(const char bytes[], int size);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Connects client to the server listening on the Unix domain socket at
+ * path. The connection does not use any file system until fs_client_open()
+ * is called. The socket is non-blocking, and the functions below wait for
+ * it with poll() instead.
+ * - If the connection could not be made, then it will return 0.
+ */
+int fs_client_connect(Fs_client *const client, const char path[])
+{
+    struct sockaddr_un address;
+    int result = 0;
+
+    client->next_id = 1;
+    client->out = NULL;
+    client->out_size = 0;
+    client->out_capacity = 0;
+    client->in = NULL;
+    client->in_start = 0;
+    client->in_used = 0;
+    client->in_size = 0;
+    client->in_capacity = 0;
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd >= 0 && strlen(path) < sizeof(address.sun_path))
+    {
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+
+        if (connect(client->fd, (struct sockaddr *)&address,
+                    sizeof(address)) == 0
+            && fcntl(client->fd, F_SETFL, O_NONBLOCK) == 0)
+        {
+            result = 1;
+        }
+    }
+
+    if (!result && client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+
+    return result;
+}
+
+/*
+ * Closes the connection of client, and frees its buffers. Requests that
+ * have been queued but not flushed are dropped.
+ */
+void fs_client_close(Fs_client *const client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+
+    free(client->out);
+    free(client->in);
+    client->out = NULL;
+    client->in = NULL;
+}
+
+/*
+ * Queues a request for the operation op (one of the FS_OP_ constants) with
+ * the arguments arg and arg2 of the specified lengths. arg2 is only used by
+ * FS_OP_LN and FS_OP_LN_S, and may be NULL otherwise.
+ * The request is only sent by the next fs_client_flush() or
+ * fs_client_receive().
+ * - Returns the id of the request, or 0 if an argument is longer than
+ *   65535 bytes or memory could not be allocated.
+ */
+unsigned long fs_client_send(Fs_client *const client, int op,
+                             const char arg[], size_t arg_length,
+                             const char arg2[], size_t arg2_length)
+{
+    char *frame;
+    size_t size;
+    unsigned long id = 0;
+
+    if (arg2 == NULL)
+    {
+        arg2_length = 0;
+    }
+
+    size = FS_REQUEST_HEADER_SIZE + arg_length + arg2_length;
+
+    if (arg_length <= 65535 && arg2_length <= 65535
+        && reserve(&client->out, &client->out_capacity,
+                   client->out_size + size))
+    {
+        id = client->next_id;
+
+        /* Ids wrap around after 4 bytes, but are never 0 */
+        client->next_id = (client->next_id + 1) & 0xFFFFFFFFUL;
+        if (client->next_id == 0)
+        {
+            client->next_id = 1;
+        }
+
+        frame = client->out + client->out_size;
+        put_number(frame, size - 4, 4);
+        put_number(frame + 4, id, 4);
+        put_number(frame + 8, (unsigned long)op, 1);
+        put_number(frame + 9, arg_length, 2);
+        put_number(frame + 11, arg2_length, 2);
+        if (arg_length != 0)
+        {
+            memcpy(frame + FS_REQUEST_HEADER_SIZE, arg, arg_length);
+        }
+        if (arg2_length != 0)
+        {
+            memcpy(frame + FS_REQUEST_HEADER_SIZE + arg_length, arg2,
+                   arg2_length);
+        }
+
+        client->out_size += size;
+    }
+
+    return id;
+}
+
+/*
+ * Sends every queued request to the server at once. Replies arriving in
+ * the meantime are read, to be returned later by fs_client_receive(), so
+ * that the server never stops reading requests while waiting for its
+ * replies to be read.
+ * - If the connection has failed, then it will return 0.
+ */
+int fs_client_flush(Fs_client *const client)
+{
+    struct pollfd descriptor;
+    size_t sent = 0;
+    ssize_t written;
+    int result = 1;
+
+    while (result && sent < client->out_size)
+    {
+        descriptor.fd = client->fd;
+        descriptor.events = POLLIN | POLLOUT;
+        if (poll(&descriptor, 1, -1) < 0)
+        {
+            result = errno == EINTR;
+        }
+        else if (descriptor.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            result = read_input(client, 65536);
+        }
+        else if (descriptor.revents & POLLOUT)
+        {
+            written = write(client->fd, client->out + sent,
+                            client->out_size - sent);
+            if (written > 0)
+            {
+                sent += (size_t)written;
+            }
+            else if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+                     && errno != EINTR)
+            {
+                result = 0;
+            }
+        }
+    }
+
+    client->out_size = 0;
+
+    return result;
+}
+
+/*
+ * Waits for the reply to the oldest request that has not been answered yet,
+ * and stores it in reply. Queued requests are flushed first.
+ * - If the connection has failed or the server sent something invalid, then
+ *   it will return 0.
+ */
+int fs_client_receive(Fs_client *const client, Fs_reply *reply)
+{
+    size_t length = 0;
+    int complete = 0, result = 1;
+
+    if (client->out_size != 0)
+    {
+        result = fs_client_flush(client);
+    }
+
+    /* Drops the reply returned last */
+    client->in_start += client->in_used;
+    client->in_used = 0;
+
+    while (result && !complete)
+    {
+        /* Checks whether the whole of the next reply has arrived */
+        if (client->in_size - client->in_start >= 4)
+        {
+            length = get_number(client->in + client->in_start, 4) + 4;
+            if (length < FS_REPLY_HEADER_SIZE)
+            {
+                result = 0;
+            }
+            complete = client->in_size - client->in_start >= length;
+        }
+
+        if (result && !complete)
+        {
+            /* Moves the partial reply to the front to make room */
+            if (client->in_start != 0)
+            {
+                memmove(client->in, client->in + client->in_start,
+                        client->in_size - client->in_start);
+                client->in_size -= client->in_start;
+                client->in_start = 0;
+            }
+
+            result = wait_for_input(client)
+                     && read_input(client, length > 4096 ? length : 4096);
+        }
+    }
+
+    if (result)
+    {
+        reply->id = get_number(client->in + client->in_start + 4, 4);
+        reply->result = get_number(client->in + client->in_start + 8, 4);
+        reply->output = client->in + client->in_start + FS_REPLY_HEADER_SIZE;
+        reply->output_size = length - FS_REPLY_HEADER_SIZE;
+        client->in_used = length;
+    }
+
+    return result;
+}
+
+/*
+ * Sends a single request with the null-terminated arguments arg and arg2
+ * (which may be NULL), and waits for its reply. Any requests queued before
+ * must have had their replies received already.
+ * - If the request could not be sent or answered, then it will return 0.
+ */
+int fs_client_call(Fs_client *const client, int op, const char arg[],
+                   const char arg2[], Fs_reply *reply)
+{
+    return fs_client_send(client, op, arg, arg != NULL ? strlen(arg) : 0,
+                          arg2, arg2 != NULL ? strlen(arg2) : 0) != 0
+           && fs_client_receive(client, reply);
+}
+
+/*
+ * Starts using the file system of the specified tenant, which the server
+ * creates if it does not exist yet. The connection starts from its root.
+ * - If the server refused the request, then it will return 0.
+ */
+int fs_client_open(Fs_client *const client, unsigned long tenant)
+{
+    Fs_reply reply;
+    char id[4];
+
+    put_number(id, tenant, 4);
+
+    return fs_client_send(client, FS_OP_OPEN, id, 4, NULL, 0) != 0
+           && fs_client_receive(client, &reply) && reply.result == 1;
+}
+
+/*
+ * A helper function to wait until the server has sent something, or has
+ * closed the connection.
+ * - If the connection has failed, then it will return 0.
+ */
+static int wait_for_input(Fs_client *const client)
+{
+    struct pollfd descriptor;
+
+    descriptor.fd = client->fd;
+    descriptor.events = POLLIN;
+
+    return poll(&descriptor, 1, -1) >= 0 || errno == EINTR;
+}
+
+/*
+ * A helper function to append whatever the server has sent so far to the
+ * client's input, after making room for at least size more bytes. Finding
+ * nothing to read is not a failure.
+ * - If the connection has been closed or has failed, or if memory could
+ *   not be allocated, then it will return 0.
+ */
+static int read_input(Fs_client *const client, size_t size)
+{
+    ssize_t received;
+    int result;
+
+    result = reserve(&client->in, &client->in_capacity,
+                     client->in_size + size);
+    if (result)
+    {
+        received = read(client->fd, client->in + client->in_size,
+                        client->in_capacity - client->in_size);
+        if (received > 0)
+        {
+            client->in_size += (size_t)received;
+        }
+        else if (received == 0
+                 || (errno != EAGAIN && errno != EWOULDBLOCK
+                     && errno != EINTR))
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to make sure that buffer has room for size bytes,
+ * doubling its capacity as needed.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int reserve(char **buffer, size_t *capacity, size_t size)
+{
+    char *new_buffer;
+    size_t new_capacity;
+    int result = 1;
+
+    if (size > *capacity)
+    {
+        new_capacity = *capacity == 0 ? 4096 : *capacity * 2;
+        while (new_capacity < size)
+        {
+            new_capacity *= 2;
+        }
+
+        new_buffer = realloc(*buffer, new_capacity);
+        if (new_buffer != NULL)
+        {
+            *buffer = new_buffer;
+            *capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to store the lowest size bytes of number in bytes,
+ * most significant first.
+ */
+static void put_number(char bytes[], unsigned long number, int size)
+{
+    int i;
+
+    for (i = size - 1; i >= 0; i--)
+    {
+        bytes[i] = (char)(number & 0xFF);
+        number >>= 8;
+    }
+}
+
+/*
+ * A helper function to read a number of size bytes stored by put_number().
+ */
+static unsigned long get_number(const char bytes[], int size)
+{
+    unsigned long number = 0;
+    int i;
+
+    for (i = 0; i < size; i++)
+    {
+        number = (number << 8) | (unsigned char)bytes[i];
+    }
+
+    return number;
+}
@@ -0,0 +1,88 @@
+/*
+ * File: filesystem-client.h
+ *
+ * This file contains the structure declarations and function prototypes of
+ * the client library for filesystem-server.
+ *
+ * Requests are queued with fs_client_send() and sent together by
+ * fs_client_flush(), so that many of them travel in a single write. Their
+ * replies are then read one by one, in order, with fs_client_receive().
+ * Replies that arrive while a flush is still sending are read along the
+ * way, since the server stops reading requests while too many of its
+ * replies are waiting.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_CLIENT_H
+#define FILESYSTEM_CLIENT_H
+
+#include <stddef.h>
+
+/*
+ * These structures are used to create connections to a server
+ */
+typedef struct fs_client
+{
+
+    /* The socket connected to the server */
+    int fd;
+
+    /* The id given to the next request */
+    unsigned long next_id;
+
+    /* Requests queued by fs_client_send() that have not been sent yet */
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+
+    /* Bytes received from the server. Replies start at in_start, and the
+    first in_used bytes there belong to the reply returned last. */
+    char *in;
+    size_t in_start;
+    size_t in_used;
+    size_t in_size;
+    size_t in_capacity;
+
+} Fs_client;
+
+/*
+ * These structures hold the replies read by fs_client_receive()
+ */
+typedef struct fs_reply
+{
+
+    /* The id of the request this reply is for */
+    unsigned long id;
+
+    /* What the operation returned, or FS_RESULT_ERROR */
+    unsigned long result;
+
+    /* The text printed by the operation, which is not null-terminated and
+    only stays valid until the next call to fs_client_receive() or
+    fs_client_flush() */
+    const char *output;
+    size_t output_size;
+
+} Fs_reply;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int fs_client_connect(Fs_client *const client, const char path[]);
+void fs_client_close(Fs_client *const client);
+unsigned long fs_client_send(Fs_client *const client, int op,
+                             const char arg[], size_t arg_length,
+                             const char arg2[], size_t arg2_length);
+int fs_client_flush(Fs_client *const client);
+int fs_client_receive(Fs_client *const client, Fs_reply *reply);
+int fs_client_call(Fs_client *const client, int op, const char arg[],
+                   const char arg2[], Fs_reply *reply);
+int fs_client_open(Fs_client *const client, unsigned long tenant);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
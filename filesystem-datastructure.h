@@ -11,6 +11,81 @@
  * Author: Samuel Kosasih
  */
 
+#ifndef FILESYSTEM_DATASTRUCTURE_H
+#define FILESYSTEM_DATASTRUCTURE_H
+
+#include <limits.h>
+#include <stddef.h>
+
+/*
+ * The type of the links between directories and files, which hold the
+ * number of a node within a node table of its file system (see Node_table)
+ * instead of its address. Number 0 is never given to a node, so that it
+ * can stand for no node. It is 32 bits wide wherever unsigned int is.
+ */
+#if UINT_MAX >= 0xFFFFFFFFUL
+typedef unsigned int Node_index;
+#else
+typedef unsigned long Node_index;
+#endif
+
+/*
+ * These structures hold the contents of a file. Hard links to the same file
+ * are separate File_nodes sharing a single File_data, which is only freed
+ * once the last link to it has been removed.
+ */
+typedef struct file_data
+{
+
+    /* The timestamp of the file */
+    int timestamp;
+
+    /* The number of File_nodes linked to this data */
+    int link_count;
+
+    /* The list of those File_nodes, chained by their next_link members */
+    Node_index links;
+
+} File_data;
+
+/*
+ * These structures record a directory that a name was looked up in while
+ * resolving the target of a symbolic link, along with the generation the
+ * directory had then.
+ */
+typedef struct link_step
+{
+
+    /* The number of the directory, and its generation */
+    Node_index dir;
+    unsigned long gen;
+
+} Link_step;
+
+/*
+ * These structures hold what only symbolic links need, so that regular
+ * files do not carry it.
+ */
+typedef struct symlink_data
+{
+
+    /* The path the symbolic link points to */
+    char *target;
+
+    /* The last resolution of the target, or NULL for both if there is
+    none, along with every directory looked up to reach it in the order
+    they were walked. It stays valid until one of them changes. */
+    struct dir_node *cached_dir;
+    struct file_node *cached_file;
+    Link_step *cached_steps;
+    size_t cached_step_count;
+
+    /* The number of symbolic links that resolution followed, this one
+    included */
+    int cached_links;
+
+} Symlink_data;
+
 /*
  * These nodes are used to create a Linked List of Files
  */
@@ -20,11 +95,29 @@ typedef struct file_node
     /* The file's name */
     char *name;
 
-    /* The timestamp of the file */
-    int timestamp;
+    /* The contents of the file, or NULL if this is a symbolic link */
+    File_data *data;
+
+    /* What a symbolic link points to, or NULL for a regular file */
+    Symlink_data *symlink;
 
-    /* A pointer to the next file in the list */
-    struct file_node *next_file;
+    /* The next file in the list, or 0 if this is the last one */
+    Node_index next_file;
+
+    /* The next hard link sharing the same data, or 0 */
+    Node_index next_link;
+
+    /* The directory containing the file */
+    Node_index par_dir;
+
+    /* The number of the file itself within the file table */
+    Node_index self;
+
+    /* The file's inode number, or 0 if it has not been looked up yet */
+    Node_index ino;
+
+    /* The file's number in the name index, or 0 if it is not indexed */
+    Node_index name_id;
 
 } File_node;
 
@@ -40,34 +133,309 @@ typedef struct dir_node
     /* String of the directory path */
     char *path;
 
-    /* Head node of the file list */
-    File_node *file_list;
+    /* Head node of the file list, or 0 if there are no files */
+    Node_index file_list;
+
+    /* Head node of the subdirectory list, or 0 if there are none */
+    Node_index subdir_list;
+
+    /* The next directory in the list, or 0 if this is the last one */
+    Node_index next_dir;
+
+    /* The parent directory, or 0 for the root */
+    Node_index par_dir;
 
-    /* Head node of the subdirectory list */
-    struct dir_node *subdir_list;
+    /* The number of the directory itself within the directory table */
+    Node_index self;
 
-    /* A pointer to the next directory in the list */
-    struct dir_node *next_dir;
+    /* The directory's inode number, or 0 if it has not been looked up yet */
+    Node_index ino;
 
-    /* A pointer to the parent directory */
-    struct dir_node *par_dir;
+    /* The directory's number in the name index, or 0 if it is not indexed */
+    Node_index name_id;
+
+    /* A 64 bit hash of everything within the directory, as two 32 bit
+    lanes, which is only valid while hash_valid is 1. Changes to a
+    directory clear hash_valid on it and on every directory above it, so it
+    is only recomputed where needed. */
+    unsigned long hash[2];
+    int hash_valid;
+
+    /* The file system's generation when an entry was last created in or
+    removed from the directory, or when it was made */
+    unsigned long generation;
 
 } Dir_node;
 
+/*
+ * These structures make up the inode table of a file system, which maps
+ * inode numbers to the directory or file they were assigned to. Inodes are
+ * only assigned when a node is looked up with fs_lookup().
+ */
+typedef struct inode_entry
+{
+
+    /* The node using this inode, with the other one set to NULL.
+    Both are NULL while the inode is free. */
+    Dir_node *dir;
+    File_node *file;
+
+    /* Incremented every time the inode is freed, so that handles to a
+    removed node no longer match once the inode is reused */
+    unsigned long gen;
+
+    /* The next free inode in the table, or 0 if this is the last one */
+    unsigned long next_free;
+
+} Inode_entry;
+
+/*
+ * These structures are stable handles to a directory or file, returned by
+ * fs_lookup(). They stay valid until the node is removed.
+ */
+typedef struct fs_handle
+{
+
+    /* The inode number of the node */
+    unsigned long ino;
+
+    /* The generation of the inode when the handle was created */
+    unsigned long gen;
+
+} Fs_handle;
+
+/*
+ * These structures let a file system take its memory from somewhere other
+ * than malloc(), such as a pool shared between many file systems.
+ */
+typedef struct fs_allocator
+{
+
+    /* Returns size bytes of memory, or NULL if there are none left */
+    void *(*alloc)(void *context, size_t size);
+
+    /* Gives back memory returned by alloc, along with its size */
+    void (*release)(void *context, void *ptr, size_t size);
+
+    /* Passed to both functions, e.g. the pool to allocate from */
+    void *context;
+
+} Fs_allocator;
+
+/*
+ * These structures hold every directory or every file of a file system, in
+ * chunks of NODE_CHUNK_SIZE nodes (see filesystem-internal.h) that are
+ * never moved, so nodes keep their addresses for as long as they exist.
+ * Nodes are found by their number with DIR_AT() and FILE_AT().
+ */
+typedef struct node_table
+{
+
+    /* The chunks, and the number of them the array has room for */
+    void **chunks;
+    size_t chunk_capacity;
+
+    /* The number of nodes handed out so far, counting the unused node 0 */
+    Node_index used;
+
+    /* The last node freed, with each freed node holding the number of the
+    one freed before it in its first bytes, or 0 if there are none */
+    Node_index free_node;
+
+} Node_table;
+
 /*
  * These structures are used to create instances of a file system
  */
 typedef struct FileSystem
 {
 
+    /* The directories and files of the file system, which the links
+    between them refer to by number */
+    Node_table dirs;
+    Node_table files;
+
     /* A pointer to keep a reference to the root of the filesystem */
     Dir_node *root;
 
     /* A pointer to keep a reference to the current directory */
     Dir_node *cur_dir;
 
+    /* Incremented whenever an entry is created or removed, and given to the
+    directory it is in, so that cached symbolic link resolutions only
+    have to check the directories they looked names up in */
+    unsigned long generation;
+
+    /* The inode table, indexed by inode number. Inode 0 is never used. */
+    Inode_entry *inodes;
+
+    /* The number of inodes in use or freed, and the allocated size */
+    unsigned long inode_count;
+    unsigned long inode_capacity;
+
+    /* The head of the list of freed inodes, or 0 if there are none */
+    unsigned long free_inode;
+
+    /* The generation given to new inodes. Raised when a file system is
+    restored from an image so that handles from before are stale. */
+    unsigned long inode_epoch;
+
+    /* Where directories, files and names are allocated, or NULL for malloc */
+    const Fs_allocator *allocator;
+
+    /* The number of bytes currently allocated for this file system,
+    including its inode table, name index and watches, which are always
+    allocated with malloc() */
+    size_t bytes_used;
+
+    /* Receives the text printed by ls() and pwd(), or NULL for stdout */
+    void (*print)(void *context, const char text[]);
+    void *print_context;
+
+    /* The index of entry names built by fs_enable_index(), or NULL */
+    struct fs_name_index *name_index;
+
+    /* The image file of a file system made with mkfs_disk(), or NULL */
+    struct fs_disk *disk;
+
+    /* The block of memory fs_compact() moved the names and file records
+    into, or NULL, along with its size and the number of its bytes that
+    are still used */
+    char *packed;
+    size_t packed_size;
+    size_t packed_live;
+
+    /* The watches made with fs_watch(), or NULL if there are none */
+    struct fs_watch *watches;
+
 } FileSystem;
 
+/*
+ * These structures hold the state of resolving a path, which is shared by
+ * every symbolic link followed along the way.
+ */
+typedef struct link_walk
+{
+
+    /* The number of symbolic links followed so far */
+    int links;
+
+    /* The directories names were looked up in so far, in order, along with
+    their generations. Allocated with malloc(). */
+    Link_step *steps;
+    size_t step_count;
+    size_t step_capacity;
+
+    /* Set to 0 once memory for the steps could not be allocated, after
+    which no resolution is cached */
+    int ok;
+
+} Link_walk;
+
+/*
+ * These structures hold a directory changed by a transaction (see
+ * fs_txn_begin()), which either existed before it or was made by it.
+ */
+typedef struct txn_dir
+{
+
+    /* The directory. Directories made by the transaction are only linked
+    into the tree once it is committed. */
+    Dir_node *node;
+
+    /* The directory containing it within the transaction, or NULL if it
+    existed before and has not been needed yet */
+    struct txn_dir *parent;
+
+    /* A number telling the directories of a transaction apart */
+    unsigned long id;
+
+    /* The number of directories above node, so that the deepest existing
+    directories are committed first */
+    unsigned long depth;
+
+    /* Whether node was made by the transaction, and whether it was then
+    removed again before being committed */
+    int made;
+    int removed;
+
+    /* Whether the entries of node are in the table of the transaction */
+    int loaded;
+
+    /* The entries of the table that changed within this directory, sorted
+    by name when the transaction is committed */
+    struct txn_entry **changes;
+    size_t change_count;
+
+    /* The next directory of the transaction */
+    struct txn_dir *next;
+
+} Txn_dir;
+
+/*
+ * These structures make up the table of a transaction, with one entry for
+ * every name used within each of its directories, holding what the name
+ * referred to before the transaction and what it refers to now.
+ */
+typedef struct txn_entry
+{
+
+    /* The directory and the name, with dir set to NULL for free slots */
+    Txn_dir *dir;
+    const char *name;
+    size_t length;
+
+    /* The file or subdirectory with the name before the transaction, and
+    whether the transaction has removed it */
+    File_node *old_file;
+    Dir_node *old_dir;
+    int removed;
+
+    /* The number of times the transaction touched old_file */
+    unsigned long touches;
+
+    /* The file or subdirectory made with the name by the transaction */
+    File_node *new_file;
+    Txn_dir *new_dir;
+
+    /* The directory of the transaction for old_dir, once it is known */
+    Txn_dir *sub;
+
+} Txn_entry;
+
+/*
+ * These structures hold the changes of a transaction until it is committed
+ * or aborted.
+ */
+typedef struct fs_txn
+{
+
+    /* The file system being changed */
+    FileSystem *filesystem;
+
+    /* The current directory of the transaction, which starts out as the
+    current directory of the file system */
+    Txn_dir *cur_dir;
+
+    /* The directories that existed before the transaction, and the ones
+    made by it */
+    Txn_dir *old_dirs;
+    Txn_dir *new_dirs;
+    unsigned long dir_count;
+
+    /* The table of names, using linear probing. It is at most half full. */
+    Txn_entry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+
+    /* The blocks holding copies of the names that did not exist before,
+    each starting with a pointer to the previous one */
+    char *names;
+    size_t names_used;
+    size_t names_size;
+
+} Fs_txn;
+
 /*
  * These structures are used to create linked lists of names.
  * Used for the purpose of sorting the names of files and subdirectories
@@ -81,4 +449,6 @@ typedef struct name_node
     /* The next node in the list */
     struct name_node *next_name;
 
-} Name_node;
\ No newline at end of file
+} Name_node;
+
+#endif
@@ -0,0 +1,1399 @@
+/*
+ * File: filesystem-disk.c
+ *
+ * This file contains the source code of file systems kept in image files,
+ * as declared in filesystem-disk.h.
+ *
+ * The image file is made of PAGE_SIZE byte pages. Page 0 holds the header
+ * of the image, and every directory is a B+ tree of pages whose root never
+ * moves, starting with the root directory at page ROOT_PAGE. Each page
+ * starts with PAGE_HEADER_SIZE bytes:
+ * - type (1): PAGE_LEAF, PAGE_INTERNAL or PAGE_FREE.
+ * - count (2): the number of records in the page.
+ * - used (2): the number of bytes used, including the header.
+ * - link (4): the next leaf (leaves), the child holding the names before
+ *   the first record (internal pages), or the next free page (free pages).
+ * It is followed by records sorted by name, each made of:
+ * - length (1): the length of the name.
+ * - kind (1): ENTRY_FILE or ENTRY_DIR in leaves, and 0 in internal pages.
+ * - value (4): the timestamp of a file, the root page of a subdirectory, or
+ *   the child holding the names from this one onwards (internal pages).
+ * - name (length), without a terminating null character.
+ * Numbers are stored most significant byte first. Records are never moved
+ * out of pages that become empty, and the pages of removed directories are
+ * kept in a list of free pages for later use.
+ *
+ * Pages are read through a buffer cache of a fixed number of frames. When
+ * a page is needed and all frames are taken, the CLOCK algorithm picks a
+ * frame that has not been used recently, writing it back first if it has
+ * been modified. Modified pages are otherwise only written by fs_sync() and
+ * rmfs(), in the order they appear in the file.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include "filesystem-disk.h"
+#include "filesystem-internal.h"
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The size of every page of an image file */
+#define PAGE_SIZE 4096
+
+/* The size of the header of every page, before its records */
+#define PAGE_HEADER_SIZE 9
+
+/* The types of pages */
+#define PAGE_LEAF 1
+#define PAGE_INTERNAL 2
+#define PAGE_FREE 3
+
+/* The page holding the root of the root directory */
+#define ROOT_PAGE 1
+
+/* The kinds of records in leaves */
+#define ENTRY_FILE 'F'
+#define ENTRY_DIR 'D'
+
+/* The size of a record, apart from its name */
+#define RECORD_HEADER_SIZE 6
+
+/* Names are stored with a 1 byte length */
+#define MAX_NAME_LENGTH 255
+
+/* The smallest buffer cache, which must hold every page pinned at once */
+#define MIN_CACHE_PAGES 16
+
+/* The header of an image file, in page 0 */
+#define IMAGE_MAGIC "FSD1"
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures hold the frames of the buffer cache, each of which
+ * holds one page of the image file.
+ */
+typedef struct disk_frame
+{
+
+    /* The page held by the frame, or 0 if the frame is empty */
+    unsigned long page;
+
+    /* The contents of the page */
+    unsigned char *data;
+
+    /* The next frame in the same bucket of the cache's hash table, plus
+    1, or 0 if this is the last one */
+    size_t next;
+
+    /* Set when the page is used, and cleared as the clock hand passes */
+    int referenced;
+
+    /* Set when the page has been modified since it was last written */
+    int dirty;
+
+    /* The number of users of the page, which cannot be evicted while
+    this is not 0 */
+    int pins;
+
+} Disk_frame;
+
+/*
+ * These structures hold a file system kept in an image file
+ */
+struct fs_disk
+{
+
+    /* The image file */
+    FILE *file;
+
+    /* The number of pages in the image, and the head of the list of free
+    pages (or 0 if there are none) */
+    unsigned long page_count;
+    unsigned long free_page;
+
+    /* The frames of the buffer cache, and the position of the clock hand */
+    Disk_frame *frames;
+    size_t frame_count;
+    size_t hand;
+
+    /* The hash table finding the frame of a page, indexed by page number
+    modulo frame_count. Each bucket holds a frame index plus 1, or 0. */
+    size_t *buckets;
+
+    /* The root pages of the directories from the root down to the current
+    directory, and the number of them */
+    unsigned long *dirs;
+    size_t depth;
+    size_t dir_capacity;
+
+    /* The path of the current directory, and the length of the path of
+    each directory in dirs */
+    char *path;
+    size_t *path_lengths;
+    size_t path_capacity;
+
+    /* Set to 0 once reading or writing the image has failed */
+    int ok;
+
+};
+
+/*
+ * These structures describe the split of a page of a B+ tree, which adds
+ * a record to its parent.
+ */
+typedef struct page_split
+{
+
+    /* 1 if the page was split */
+    int happened;
+
+    /* The first name of the new page */
+    unsigned char name[MAX_NAME_LENGTH];
+    size_t length;
+
+    /* The new page, holding the records from name onwards */
+    unsigned long page;
+
+} Page_split;
+
+/* -------------------- Function Prototypes -------------------- */
+static int open_image(struct fs_disk *const disk, const char path[]);
+static int sync_disk(struct fs_disk *const disk);
+static void free_disk(struct fs_disk *const disk);
+static int classify(const char name[], size_t length);
+static int find_entry(struct fs_disk *const disk, unsigned long dir,
+                      const char name[], size_t length, int *kind,
+                      unsigned long *value, unsigned long *leaf,
+                      size_t *offset);
+static int insert_entry(struct fs_disk *const disk, unsigned long page,
+                        const unsigned char record[], int is_root,
+                        Page_split *split);
+static int add_record(struct fs_disk *const disk, Disk_frame *const frame,
+                      size_t offset, const unsigned char record[],
+                      int is_root, Page_split *split);
+static void write_records(unsigned char page[], int type, unsigned long link,
+                          const unsigned char records[], size_t size,
+                          size_t count);
+static int free_tree(struct fs_disk *const disk, unsigned long page);
+static void print_dir(FileSystem *const filesystem, unsigned long dir);
+static int push_dir(struct fs_disk *const disk, unsigned long dir,
+                    const char name[], size_t length);
+static Disk_frame *get_page(struct fs_disk *const disk, unsigned long page,
+                            int fresh);
+static void put_page(Disk_frame *const frame, int dirty);
+static Disk_frame *alloc_page(struct fs_disk *const disk);
+static void free_page(struct fs_disk *const disk, unsigned long page);
+static void write_frame(struct fs_disk *const disk, Disk_frame *const frame);
+static int compare_frames(const void *a, const void *b);
+static int compare_record(const unsigned char record[], const char name[],
+                          size_t length);
+static size_t record_size(const unsigned char record[]);
+static void put_number(unsigned char bytes[], unsigned long number,
+                       int size);
+static unsigned long get_number(const unsigned char bytes[], int size);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Initializes the FileSystem parameter filesystem like mkfs(), but keeps
+ * its contents in the image file at path, which is created if it does not
+ * exist yet. At most cache_pages pages of the image are kept in memory at
+ * once (with a minimum of 16), each of them taking 4 KiB.
+ * - Changes reach the file when fs_sync() or rmfs() is called, or earlier
+ *   for pages that make room for others in the cache.
+ * - If the image could not be opened or created, or is not a valid image,
+ *   then it will return 0. The file system is then kept in memory instead,
+ *   and must still be freed with rmfs().
+ */
+int mkfs_disk(FileSystem *const filesystem, const char path[],
+              size_t cache_pages)
+{
+    struct fs_disk *disk;
+    int result = 0;
+
+    if (filesystem != NULL)
+    {
+        mkfs(filesystem);
+
+        if (cache_pages < MIN_CACHE_PAGES)
+        {
+            cache_pages = MIN_CACHE_PAGES;
+        }
+
+        disk = calloc(1, sizeof(*disk));
+        if (disk != NULL && path != NULL)
+        {
+            disk->frame_count = cache_pages;
+            disk->frames = calloc(cache_pages, sizeof(Disk_frame));
+            disk->buckets = calloc(cache_pages, sizeof(size_t));
+            disk->ok = 1;
+
+            if (disk->frames != NULL && disk->buckets != NULL
+                && push_dir(disk, ROOT_PAGE, "", 0)
+                && open_image(disk, path))
+            {
+                filesystem->disk = disk;
+                result = 1;
+            }
+        }
+
+        if (!result && disk != NULL)
+        {
+            free_disk(disk);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Writes every page of the file system's image that has been modified since
+ * it was last written, along with the header of the image.
+ * - If the file system is not kept in an image, then nothing happens.
+ * - If reading or writing the image has failed since it was opened, then
+ *   it will return 0.
+ */
+int fs_sync(FileSystem *const filesystem)
+{
+    int result = 1;
+
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        result = sync_disk(filesystem->disk);
+    }
+
+    return result;
+}
+
+/*
+ * Works like touch() on a file system kept in an image.
+ */
+int disk_touch(FileSystem *const filesystem, const char name[],
+               size_t length)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    unsigned char record[RECORD_HEADER_SIZE + MAX_NAME_LENGTH];
+    unsigned long value, leaf;
+    Disk_frame *frame;
+    Page_split split;
+    size_t offset;
+    int kind, result = 0;
+
+    kind = classify(name, length);
+    if (kind == NAME_DOT || kind == NAME_DOTDOT)
+    {
+        result = 1;
+    }
+    else if (kind == NAME_REGULAR)
+    {
+        /* Increments the timestamp of an existing file, and leaves
+        subdirectories of the same name unmodified */
+        if (find_entry(disk, disk->dirs[disk->depth - 1], name, length,
+                       &kind, &value, &leaf, &offset))
+        {
+            if (kind == ENTRY_FILE)
+            {
+                frame = get_page(disk, leaf, 0);
+                if (frame != NULL)
+                {
+                    put_number(frame->data + offset + 2, value + 1, 4);
+                    put_page(frame, 1);
+                    result = 1;
+                }
+            }
+            else
+            {
+                result = 1;
+            }
+        }
+        /* Inserts a new file */
+        else
+        {
+            record[0] = (unsigned char)length;
+            record[1] = ENTRY_FILE;
+            put_number(record + 2, 1, 4);
+            memcpy(record + RECORD_HEADER_SIZE, name, length);
+
+            result = insert_entry(disk, disk->dirs[disk->depth - 1], record,
+                                  1, &split);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Works like mkdir() on a file system kept in an image.
+ */
+int disk_mkdir(FileSystem *const filesystem, const char name[],
+               size_t length)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    unsigned char record[RECORD_HEADER_SIZE + MAX_NAME_LENGTH];
+    unsigned long value, leaf, page;
+    Disk_frame *frame;
+    Page_split split;
+    size_t offset;
+    int kind, result = 0;
+
+    if (classify(name, length) == NAME_REGULAR
+        && !find_entry(disk, disk->dirs[disk->depth - 1], name, length,
+                       &kind, &value, &leaf, &offset))
+    {
+        /* The subdirectory starts as a single empty leaf */
+        frame = alloc_page(disk);
+        if (frame != NULL)
+        {
+            page = frame->page;
+            write_records(frame->data, PAGE_LEAF, 0, NULL, 0, 0);
+            put_page(frame, 1);
+
+            record[0] = (unsigned char)length;
+            record[1] = ENTRY_DIR;
+            put_number(record + 2, page, 4);
+            memcpy(record + RECORD_HEADER_SIZE, name, length);
+
+            result = insert_entry(disk, disk->dirs[disk->depth - 1], record,
+                                  1, &split);
+            if (!result)
+            {
+                free_page(disk, page);
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Works like cd() on a file system kept in an image.
+ */
+int disk_cd(FileSystem *const filesystem, const char name[], size_t length)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    unsigned long value, leaf;
+    size_t offset;
+    int kind, result = 0;
+
+    kind = classify(name, length);
+    if (kind == NAME_DOT)
+    {
+        result = 1;
+    }
+    /* Moves to the parent directory, unless this is the root */
+    else if (kind == NAME_DOTDOT)
+    {
+        if (disk->depth > 1)
+        {
+            disk->depth -= 1;
+            disk->path[disk->path_lengths[disk->depth - 1]] = '\0';
+        }
+        result = 1;
+    }
+    else if (kind == NAME_ROOT)
+    {
+        disk->depth = 1;
+        disk->path[0] = '\0';
+        result = 1;
+    }
+    else if (kind == NAME_REGULAR
+             && find_entry(disk, disk->dirs[disk->depth - 1], name, length,
+                           &kind, &value, &leaf, &offset)
+             && kind == ENTRY_DIR)
+    {
+        result = push_dir(disk, value, name, length);
+    }
+
+    return result;
+}
+
+/*
+ * Works like ls() on a file system kept in an image.
+ */
+int disk_ls(FileSystem *const filesystem, const char name[], size_t length)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    unsigned long value, leaf;
+    char text[MAX_NAME_LENGTH + 32];
+    size_t offset;
+    int kind, result = 0;
+
+    kind = classify(name, length);
+    if (kind == NAME_DOT || kind == NAME_EMPTY)
+    {
+        print_dir(filesystem, disk->dirs[disk->depth - 1]);
+        result = 1;
+    }
+    /* The root has no parent, so nothing is printed for it */
+    else if (kind == NAME_DOTDOT)
+    {
+        if (disk->depth > 1)
+        {
+            print_dir(filesystem, disk->dirs[disk->depth - 2]);
+        }
+        result = 1;
+    }
+    else if (kind == NAME_ROOT)
+    {
+        print_dir(filesystem, ROOT_PAGE);
+        result = 1;
+    }
+    else if (kind == NAME_REGULAR
+             && find_entry(disk, disk->dirs[disk->depth - 1], name, length,
+                           &kind, &value, &leaf, &offset))
+    {
+        if (kind == ENTRY_DIR)
+        {
+            print_dir(filesystem, value);
+        }
+        /* Prints the file's name followed by its timestamp */
+        else
+        {
+            memcpy(text, name, length);
+            sprintf(text + length, " %lu\n", value);
+            print_text(filesystem, text);
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+/*
+ * Works like pwd() on a file system kept in an image.
+ */
+void disk_pwd(FileSystem *const filesystem)
+{
+    struct fs_disk *const disk = filesystem->disk;
+
+    if (disk->depth == 1)
+    {
+        print_text(filesystem, "/\n");
+    }
+    else
+    {
+        print_text(filesystem, disk->path);
+        print_text(filesystem, "\n");
+    }
+}
+
+/*
+ * Works like rm() on a file system kept in an image. The pages of removed
+ * directories are added to the list of free pages.
+ */
+int disk_rm(FileSystem *const filesystem, const char name[], size_t length)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    unsigned long value, leaf, used;
+    Disk_frame *frame;
+    size_t offset, size;
+    int kind, result = 0;
+
+    if (classify(name, length) == NAME_REGULAR
+        && find_entry(disk, disk->dirs[disk->depth - 1], name, length, &kind,
+                      &value, &leaf, &offset))
+    {
+        frame = get_page(disk, leaf, 0);
+        if (frame != NULL)
+        {
+            /* Closes the gap left by the record */
+            size = record_size(frame->data + offset);
+            used = get_number(frame->data + 3, 2);
+            memmove(frame->data + offset, frame->data + offset + size,
+                    used - offset - size);
+            put_number(frame->data + 1, get_number(frame->data + 1, 2) - 1,
+                       2);
+            put_number(frame->data + 3, used - size, 2);
+            put_page(frame, 1);
+
+            result = kind == ENTRY_DIR ? free_tree(disk, value) : 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Writes back everything that has been modified, closes the image file,
+ * and frees the buffer cache. The file system is kept in memory afterwards.
+ * Called by rmfs().
+ */
+void disk_close(FileSystem *const filesystem)
+{
+    sync_disk(filesystem->disk);
+    free_disk(filesystem->disk);
+    filesystem->disk = NULL;
+}
+
+/*
+ * A helper function to open the image file at path, or to create it with
+ * an empty root directory if it does not exist.
+ * - If it could not be opened or created, then it will return 0.
+ */
+static int open_image(struct fs_disk *const disk, const char path[])
+{
+    unsigned char header[12];
+    Disk_frame *frame;
+    int result = 0;
+
+    disk->file = fopen(path, "r+b");
+    if (disk->file != NULL)
+    {
+        if (fread(header, 1, sizeof(header), disk->file) == sizeof(header)
+            && memcmp(header, IMAGE_MAGIC, 4) == 0)
+        {
+            disk->page_count = get_number(header + 4, 4);
+            disk->free_page = get_number(header + 8, 4);
+            result = disk->page_count > ROOT_PAGE;
+        }
+    }
+    else
+    {
+        disk->file = fopen(path, "w+b");
+        if (disk->file != NULL)
+        {
+            /* Page 0 holds the header, which fs_sync() writes */
+            disk->page_count = ROOT_PAGE;
+            disk->free_page = 0;
+
+            frame = alloc_page(disk);
+            if (frame != NULL)
+            {
+                write_records(frame->data, PAGE_LEAF, 0, NULL, 0, 0);
+                put_page(frame, 1);
+                result = sync_disk(disk);
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function for fs_sync(), writing every modified page in the
+ * order of the file, and then the header.
+ * Returns 0 if reading or writing the image has ever failed.
+ */
+static int sync_disk(struct fs_disk *const disk)
+{
+    Disk_frame **dirty;
+    unsigned char header[12];
+    size_t count = 0, i;
+
+    dirty = malloc(sizeof(*dirty) * disk->frame_count);
+    if (dirty != NULL)
+    {
+        for (i = 0; i < disk->frame_count; i++)
+        {
+            if (disk->frames[i].page != 0 && disk->frames[i].dirty)
+            {
+                dirty[count++] = &disk->frames[i];
+            }
+        }
+
+        qsort(dirty, count, sizeof(*dirty), compare_frames);
+        for (i = 0; i < count; i++)
+        {
+            write_frame(disk, dirty[i]);
+        }
+
+        free(dirty);
+    }
+    /* Without memory to sort them, pages are written in any order */
+    else
+    {
+        for (i = 0; i < disk->frame_count; i++)
+        {
+            if (disk->frames[i].page != 0 && disk->frames[i].dirty)
+            {
+                write_frame(disk, &disk->frames[i]);
+            }
+        }
+    }
+
+    memcpy(header, IMAGE_MAGIC, 4);
+    put_number(header + 4, disk->page_count, 4);
+    put_number(header + 8, disk->free_page, 4);
+    if (fseeko(disk->file, (off_t)0, SEEK_SET) != 0
+        || fwrite(header, 1, sizeof(header), disk->file) != sizeof(header)
+        || fflush(disk->file) != 0)
+    {
+        disk->ok = 0;
+    }
+
+    return disk->ok;
+}
+
+/*
+ * A helper function to close the image file of disk, if it was opened, and
+ * to free the memory it uses, without writing anything back.
+ */
+static void free_disk(struct fs_disk *const disk)
+{
+    size_t i;
+
+    if (disk->file != NULL)
+    {
+        fclose(disk->file);
+    }
+
+    if (disk->frames != NULL)
+    {
+        for (i = 0; i < disk->frame_count; i++)
+        {
+            free(disk->frames[i].data);
+        }
+    }
+
+    free(disk->frames);
+    free(disk->buckets);
+    free(disk->dirs);
+    free(disk->path);
+    free(disk->path_lengths);
+    free(disk);
+}
+
+/*
+ * A helper function to tell which kind of name the first length characters
+ * of name are, like classify_name(). Names that are too long to be stored
+ * in a record are invalid.
+ */
+static int classify(const char name[], size_t length)
+{
+    int result = classify_name(name, length);
+
+    if (result == NAME_REGULAR && length > MAX_NAME_LENGTH)
+    {
+        result = NAME_INVALID;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to search the directory whose B+ tree starts at page
+ * dir for the record with the specified name. If it is found, its kind and
+ * value are stored in kind and value, and its position in leaf and offset.
+ * - If it is not found, or the image could not be read, then it will
+ *   return 0.
+ */
+static int find_entry(struct fs_disk *const disk, unsigned long dir,
+                      const char name[], size_t length, int *kind,
+                      unsigned long *value, unsigned long *leaf,
+                      size_t *offset)
+{
+    Disk_frame *frame;
+    unsigned char *data;
+    unsigned long page = dir, child;
+    size_t count, position, i;
+    int order, result = 0;
+
+    while (page != 0)
+    {
+        frame = get_page(disk, page, 0);
+        if (frame == NULL)
+        {
+            return result;
+        }
+
+        data = frame->data;
+        count = get_number(data + 1, 2);
+        position = PAGE_HEADER_SIZE;
+
+        /* Goes down to the child holding the name */
+        if (data[0] == PAGE_INTERNAL)
+        {
+            child = get_number(data + 5, 4);
+            for (i = 0; i < count
+                        && compare_record(data + position, name, length) <= 0;
+                 i++)
+            {
+                child = get_number(data + position + 2, 4);
+                position += record_size(data + position);
+            }
+            put_page(frame, 0);
+            page = child;
+        }
+        /* Looks for the name within the leaf */
+        else
+        {
+            for (i = 0; i < count; i++)
+            {
+                order = compare_record(data + position, name, length);
+                if (order == 0)
+                {
+                    *kind = data[position + 1];
+                    *value = get_number(data + position + 2, 4);
+                    *leaf = page;
+                    *offset = position;
+                    result = 1;
+                }
+                if (order >= 0)
+                {
+                    break;
+                }
+                position += record_size(data + position);
+            }
+            put_page(frame, 0);
+            page = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A recursive helper function to insert a record into the B+ tree starting
+ * at page, whose name must not be in the tree already. If the page has to
+ * be split, the new page is described in split, and must be added to the
+ * parent page. Roots are split without moving them instead.
+ * - If the image could not be read or written, then it will return 0.
+ */
+static int insert_entry(struct fs_disk *const disk, unsigned long page,
+                        const unsigned char record[], int is_root,
+                        Page_split *split)
+{
+    unsigned char parent_record[RECORD_HEADER_SIZE + MAX_NAME_LENGTH];
+    Disk_frame *frame;
+    Page_split child_split;
+    unsigned long child;
+    size_t count, position, i;
+    int order, result = 0;
+
+    split->happened = 0;
+
+    frame = get_page(disk, page, 0);
+    if (frame != NULL)
+    {
+        /* Finds the position of the record, and the child containing
+        it for internal pages. Like find_entry(), names equal to a
+        separator go to its right, since rm() leaves separators behind. */
+        count = get_number(frame->data + 1, 2);
+        position = PAGE_HEADER_SIZE;
+        child = get_number(frame->data + 5, 4);
+        for (i = 0; i < count; i++)
+        {
+            order = compare_record(frame->data + position,
+                                   (const char *)record + RECORD_HEADER_SIZE,
+                                   record[0]);
+            if (order > 0 || (order == 0 && frame->data[0] == PAGE_LEAF))
+            {
+                break;
+            }
+
+            child = get_number(frame->data + position + 2, 4);
+            position += record_size(frame->data + position);
+        }
+
+        if (frame->data[0] == PAGE_LEAF)
+        {
+            result = add_record(disk, frame, position, record, is_root,
+                                split);
+        }
+        else
+        {
+            result = insert_entry(disk, child, record, 0,
+                                  &child_split); /* Recursive call */
+
+            /* Points the parent to the new page of the child */
+            if (result && child_split.happened)
+            {
+                parent_record[0] = (unsigned char)child_split.length;
+                parent_record[1] = 0;
+                put_number(parent_record + 2, child_split.page, 4);
+                memcpy(parent_record + RECORD_HEADER_SIZE, child_split.name,
+                       child_split.length);
+
+                result = add_record(disk, frame, position, parent_record,
+                                    is_root, split);
+            }
+        }
+
+        put_page(frame, 0);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to add a record at the specified offset of the page
+ * held by frame. If it does not fit, the records are split between the page
+ * and a new one, which is described in split. Roots are split into two new
+ * pages instead, and become an internal page pointing to both of them.
+ * - If no page could be allocated, then nothing is modified and it will
+ *   return 0.
+ */
+static int add_record(struct fs_disk *const disk, Disk_frame *const frame,
+                      size_t offset, const unsigned char record[],
+                      int is_root, Page_split *split)
+{
+    unsigned char records[2 * PAGE_SIZE];
+    unsigned char root_record[RECORD_HEADER_SIZE + MAX_NAME_LENGTH];
+    unsigned char *const data = frame->data;
+    Disk_frame *left = frame, *right;
+    unsigned long link, right_link;
+    size_t size = record_size(record), used, total, count;
+    size_t left_size = 0, left_count = 0, right_start;
+    int type, result = 1;
+
+    used = get_number(data + 3, 2);
+    count = get_number(data + 1, 2);
+
+    /* Case: The record fits within the page */
+    if (used + size <= PAGE_SIZE)
+    {
+        memmove(data + offset + size, data + offset, used - offset);
+        memcpy(data + offset, record, size);
+        put_number(data + 1, count + 1, 2);
+        put_number(data + 3, used + size, 2);
+        frame->dirty = 1;
+
+        return result;
+    }
+
+    /* Case: The page is split. Every record, including the new one, is
+    gathered in order before being shared out. */
+    type = data[0];
+    link = get_number(data + 5, 4);
+    total = used - PAGE_HEADER_SIZE + size;
+    memcpy(records, data + PAGE_HEADER_SIZE, offset - PAGE_HEADER_SIZE);
+    memcpy(records + offset - PAGE_HEADER_SIZE, record, size);
+    memcpy(records + offset - PAGE_HEADER_SIZE + size, data + offset,
+           used - offset);
+    count += 1;
+
+    /* The left page takes about half of the bytes, and at least one
+    record is left for the right page */
+    while (left_count < count - 1 && left_size < total / 2)
+    {
+        left_size += record_size(records + left_size);
+        left_count++;
+    }
+
+    /* The name of the first record of the right page goes up to the
+    parent. Internal pages move that record up entirely, and its child
+    holds the names before the next record. */
+    split->length = records[left_size];
+    memcpy(split->name, records + left_size + RECORD_HEADER_SIZE,
+           split->length);
+    right_start = left_size;
+    right_link = link;
+    if (type == PAGE_INTERNAL)
+    {
+        right_link = get_number(records + left_size + 2, 4);
+        right_start += record_size(records + left_size);
+    }
+
+    right = alloc_page(disk);
+    if (right != NULL && is_root)
+    {
+        left = alloc_page(disk);
+        if (left == NULL)
+        {
+            free_page(disk, right->page);
+            put_page(right, 1);
+            right = NULL;
+        }
+    }
+
+    if (right != NULL)
+    {
+        write_records(left->data, type,
+                      type == PAGE_LEAF ? right->page : link, records,
+                      left_size, left_count);
+        write_records(right->data, type, right_link, records + right_start,
+                      total - right_start,
+                      count - left_count - (type == PAGE_INTERNAL));
+        split->page = right->page;
+        split->happened = 1;
+
+        /* The root now points to both halves */
+        if (is_root)
+        {
+            root_record[0] = (unsigned char)split->length;
+            root_record[1] = 0;
+            put_number(root_record + 2, right->page, 4);
+            memcpy(root_record + RECORD_HEADER_SIZE, split->name,
+                   split->length);
+            write_records(data, PAGE_INTERNAL, left->page, root_record,
+                          record_size(root_record), 1);
+            split->happened = 0;
+            put_page(left, 1);
+        }
+
+        frame->dirty = 1;
+        put_page(right, 1);
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to fill a page with the specified header and records.
+ */
+static void write_records(unsigned char page[], int type, unsigned long link,
+                          const unsigned char records[], size_t size,
+                          size_t count)
+{
+    page[0] = (unsigned char)type;
+    put_number(page + 1, count, 2);
+    put_number(page + 3, PAGE_HEADER_SIZE + size, 2);
+    put_number(page + 5, link, 4);
+
+    if (size != 0)
+    {
+        memcpy(page + PAGE_HEADER_SIZE, records, size);
+    }
+}
+
+/*
+ * A recursive helper function to add every page of the B+ tree starting at
+ * page to the list of free pages, along with the trees of the directories
+ * it contains.
+ * - If the image could not be read, then it will return 0, and the pages
+ *   that could not be read stay allocated.
+ */
+static int free_tree(struct fs_disk *const disk, unsigned long page)
+{
+    Disk_frame *frame;
+    unsigned long *pages;
+    size_t count, position, i, page_count = 0;
+    int result = 0;
+
+    frame = get_page(disk, page, 0);
+    if (frame != NULL)
+    {
+        /* The pages below are noted first, so that none of the pages of
+        the cache stay pinned while they are freed */
+        count = get_number(frame->data + 1, 2);
+        pages = malloc(sizeof(*pages) * (count + 1));
+        if (pages != NULL)
+        {
+            result = 1;
+
+            if (frame->data[0] == PAGE_INTERNAL)
+            {
+                pages[page_count++] = get_number(frame->data + 5, 4);
+            }
+
+            position = PAGE_HEADER_SIZE;
+            for (i = 0; i < count; i++)
+            {
+                if (frame->data[0] == PAGE_INTERNAL
+                    || frame->data[position + 1] == ENTRY_DIR)
+                {
+                    pages[page_count++] =
+                        get_number(frame->data + position + 2, 4);
+                }
+                position += record_size(frame->data + position);
+            }
+        }
+        put_page(frame, 0);
+
+        if (pages != NULL)
+        {
+            free_page(disk, page);
+
+            for (i = 0; i < page_count; i++)
+            {
+                result = free_tree(disk, pages[i]) && result;
+            }
+            free(pages);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print the names in the directory whose B+ tree
+ * starts at page dir, in order, by going through its leaves from left to
+ * right. Subdirectories are printed with a trailing forward-slash.
+ */
+static void print_dir(FileSystem *const filesystem, unsigned long dir)
+{
+    struct fs_disk *const disk = filesystem->disk;
+    Disk_frame *frame;
+    char text[MAX_NAME_LENGTH + 3];
+    unsigned long page = dir;
+    size_t count, position, length, i;
+
+    while (page != 0)
+    {
+        frame = get_page(disk, page, 0);
+        if (frame == NULL)
+        {
+            return;
+        }
+
+        /* Goes down to the leftmost leaf */
+        if (frame->data[0] == PAGE_INTERNAL)
+        {
+            page = get_number(frame->data + 5, 4);
+        }
+        /* Prints the leaf, and moves to the next one */
+        else
+        {
+            count = get_number(frame->data + 1, 2);
+            position = PAGE_HEADER_SIZE;
+            for (i = 0; i < count; i++)
+            {
+                length = frame->data[position];
+                memcpy(text, frame->data + position + RECORD_HEADER_SIZE,
+                       length);
+                if (frame->data[position + 1] == ENTRY_DIR)
+                {
+                    text[length++] = '/';
+                }
+                text[length++] = '\n';
+                text[length] = '\0';
+                print_text(filesystem, text);
+
+                position += record_size(frame->data + position);
+            }
+            page = get_number(frame->data + 5, 4);
+        }
+
+        put_page(frame, 0);
+    }
+}
+
+/*
+ * A helper function to move the current directory into the subdirectory
+ * with the specified name, whose B+ tree starts at page dir. The root is
+ * pushed first, with an empty name.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int push_dir(struct fs_disk *const disk, unsigned long dir,
+                    const char name[], size_t length)
+{
+    unsigned long *new_dirs;
+    size_t *new_lengths, new_capacity, path_length = 0;
+    char *new_path;
+    int result = 1;
+
+    if (disk->depth == disk->dir_capacity)
+    {
+        new_capacity = disk->dir_capacity == 0 ? 16 : disk->dir_capacity * 2;
+        new_dirs = realloc(disk->dirs, sizeof(*new_dirs) * new_capacity);
+        if (new_dirs != NULL)
+        {
+            disk->dirs = new_dirs;
+        }
+        new_lengths = realloc(disk->path_lengths,
+                              sizeof(*new_lengths) * new_capacity);
+        if (new_lengths != NULL)
+        {
+            disk->path_lengths = new_lengths;
+        }
+
+        if (new_dirs != NULL && new_lengths != NULL)
+        {
+            disk->dir_capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    /* The path of a subdirectory is its parent's, a forward-slash, and
+    its name, while the path of the root is empty */
+    if (disk->depth != 0)
+    {
+        path_length = disk->path_lengths[disk->depth - 1] + 1 + length;
+    }
+
+    if (result && path_length + 1 > disk->path_capacity)
+    {
+        new_capacity = disk->path_capacity == 0 ? 256 : disk->path_capacity;
+        while (new_capacity < path_length + 1)
+        {
+            new_capacity *= 2;
+        }
+
+        new_path = realloc(disk->path, new_capacity);
+        if (new_path != NULL)
+        {
+            disk->path = new_path;
+            disk->path_capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (result)
+    {
+        if (disk->depth != 0)
+        {
+            disk->path[path_length - length - 1] = '/';
+            memcpy(disk->path + path_length - length, name, length);
+        }
+        disk->path[path_length] = '\0';
+
+        disk->dirs[disk->depth] = dir;
+        disk->path_lengths[disk->depth] = path_length;
+        disk->depth += 1;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to return the frame of the buffer cache holding page,
+ * pinned so that it stays there until put_page() is called. Pages that are
+ * not in the cache are read into the frame picked by the clock hand, which
+ * skips pinned frames and gives recently used ones a second chance.
+ * - If fresh is 1, the page is not read, and starts filled with zeroes.
+ * - If every frame is pinned, or memory could not be allocated, then it
+ *   will return NULL.
+ */
+static Disk_frame *get_page(struct fs_disk *const disk, unsigned long page,
+                            int fresh)
+{
+    Disk_frame *frame = NULL, *cur;
+    size_t bucket = page % disk->frame_count, i, *link;
+
+    /* Case: The page is already in the cache */
+    for (i = disk->buckets[bucket]; i != 0; i = disk->frames[i - 1].next)
+    {
+        if (disk->frames[i - 1].page == page)
+        {
+            frame = &disk->frames[i - 1];
+            frame->referenced = 1;
+            frame->pins += 1;
+            return frame;
+        }
+    }
+
+    /* Case: A frame has to be found for the page. Every frame is looked
+    at at most twice, since the first pass clears the referenced flags. */
+    for (i = 0; frame == NULL && i < 2 * disk->frame_count; i++)
+    {
+        cur = &disk->frames[disk->hand];
+        disk->hand = (disk->hand + 1) % disk->frame_count;
+
+        if (cur->pins == 0)
+        {
+            if (cur->referenced)
+            {
+                cur->referenced = 0;
+            }
+            else
+            {
+                frame = cur;
+            }
+        }
+    }
+
+    if (frame != NULL && frame->data == NULL)
+    {
+        frame->data = malloc(PAGE_SIZE);
+    }
+    if (frame == NULL || frame->data == NULL)
+    {
+        return NULL;
+    }
+
+    /* Writes back the page held by the frame, and takes it out of its
+    bucket */
+    if (frame->page != 0)
+    {
+        if (frame->dirty)
+        {
+            write_frame(disk, frame);
+        }
+
+        link = &disk->buckets[frame->page % disk->frame_count];
+        while (*link != (size_t)(frame - disk->frames) + 1)
+        {
+            link = &disk->frames[*link - 1].next;
+        }
+        *link = frame->next;
+    }
+
+    frame->page = page;
+    frame->next = disk->buckets[bucket];
+    disk->buckets[bucket] = (size_t)(frame - disk->frames) + 1;
+
+    if (fresh)
+    {
+        memset(frame->data, 0, PAGE_SIZE);
+    }
+    else if (fseeko(disk->file, (off_t)page * PAGE_SIZE, SEEK_SET) != 0
+             || fread(frame->data, 1, PAGE_SIZE, disk->file) != PAGE_SIZE)
+    {
+        memset(frame->data, 0, PAGE_SIZE);
+        disk->ok = 0;
+    }
+
+    frame->dirty = fresh;
+    frame->referenced = 1;
+    frame->pins = 1;
+
+    return frame;
+}
+
+/*
+ * A helper function to unpin a frame returned by get_page(), noting whether
+ * its page has been modified.
+ */
+static void put_page(Disk_frame *const frame, int dirty)
+{
+    frame->pins -= 1;
+    if (dirty)
+    {
+        frame->dirty = 1;
+    }
+}
+
+/*
+ * A helper function to allocate a page, reusing free pages first, and to
+ * return its frame pinned and filled with zeroes.
+ * - If no frame is available, then it will return NULL.
+ */
+static Disk_frame *alloc_page(struct fs_disk *const disk)
+{
+    Disk_frame *frame;
+
+    if (disk->free_page != 0)
+    {
+        frame = get_page(disk, disk->free_page, 0);
+        if (frame != NULL)
+        {
+            disk->free_page = get_number(frame->data + 5, 4);
+            memset(frame->data, 0, PAGE_SIZE);
+            frame->dirty = 1;
+        }
+    }
+    else
+    {
+        frame = get_page(disk, disk->page_count, 1);
+        if (frame != NULL)
+        {
+            disk->page_count += 1;
+        }
+    }
+
+    return frame;
+}
+
+/*
+ * A helper function to add page to the list of free pages.
+ */
+static void free_page(struct fs_disk *const disk, unsigned long page)
+{
+    Disk_frame *frame;
+
+    /* Its contents are no longer needed, so it is not read */
+    frame = get_page(disk, page, 1);
+    if (frame != NULL)
+    {
+        write_records(frame->data, PAGE_FREE, disk->free_page, NULL, 0, 0);
+        disk->free_page = page;
+        put_page(frame, 1);
+    }
+}
+
+/*
+ * A helper function to write the page held by frame to the image file.
+ */
+static void write_frame(struct fs_disk *const disk, Disk_frame *const frame)
+{
+    if (fseeko(disk->file, (off_t)frame->page * PAGE_SIZE,
+               SEEK_SET) == 0
+        && fwrite(frame->data, 1, PAGE_SIZE, disk->file) == PAGE_SIZE)
+    {
+        frame->dirty = 0;
+    }
+    else
+    {
+        disk->ok = 0;
+    }
+}
+
+/*
+ * A helper function for qsort(), ordering frames by the page they hold.
+ */
+static int compare_frames(const void *a, const void *b)
+{
+    unsigned long page_a = (*(Disk_frame *const *)a)->page;
+    unsigned long page_b = (*(Disk_frame *const *)b)->page;
+
+    return page_a < page_b ? -1 : page_a > page_b;
+}
+
+/*
+ * A helper function to compare the name of a record with the first length
+ * characters of name, like strcmp() would.
+ */
+static int compare_record(const unsigned char record[], const char name[],
+                          size_t length)
+{
+    size_t record_length = record[0];
+    int result;
+
+    result = memcmp(record + RECORD_HEADER_SIZE, name,
+                    record_length < length ? record_length : length);
+    if (result == 0)
+    {
+        result = record_length < length ? -1 : record_length > length;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to return the number of bytes taken by a record.
+ */
+static size_t record_size(const unsigned char record[])
+{
+    return RECORD_HEADER_SIZE + record[0];
+}
+
+/*
+ * A helper function to store the lowest size bytes of number in bytes,
+ * most significant first.
+ */
+static void put_number(unsigned char bytes[], unsigned long number,
+                       int size)
+{
+    int i;
+
+    for (i = size - 1; i >= 0; i--)
+    {
+        bytes[i] = (unsigned char)(number & 0xFF);
+        number >>= 8;
+    }
+}
+
+/*
+ * A helper function to read a number of size bytes stored by put_number().
+ */
+static unsigned long get_number(const unsigned char bytes[], int size)
+{
+    unsigned long number = 0;
+    int i;
+
+    for (i = 0; i < size; i++)
+    {
+        number = (number << 8) | bytes[i];
+    }
+
+    return number;
+}
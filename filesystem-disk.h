@@ -0,0 +1,45 @@
+/*
+ * File: filesystem-disk.h
+ *
+ * This file contains the function prototypes used to keep a file system in
+ * an image file on disk instead of in memory, for trees that do not fit in
+ * memory.
+ *
+ * A file system made with mkfs_disk() is used through the same touch(),
+ * mkdir(), cd(), ls(), pwd(), rm() and rmfs() functions as any other. Only
+ * the pages of the image that are being used are kept in memory, in a
+ * buffer cache of a chosen size. Links, handles and the functions working
+ * on whole trees are not supported on these file systems.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_DISK_H
+#define FILESYSTEM_DISK_H
+
+#include "filesystem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mkfs_disk(FileSystem *const filesystem, const char path[],
+              size_t cache_pages);
+int fs_sync(FileSystem *const filesystem);
+
+/* Used by filesystem.c for the file systems made with mkfs_disk() */
+int disk_touch(FileSystem *const filesystem, const char name[],
+               size_t length);
+int disk_mkdir(FileSystem *const filesystem, const char name[],
+               size_t length);
+int disk_cd(FileSystem *const filesystem, const char name[], size_t length);
+int disk_ls(FileSystem *const filesystem, const char name[], size_t length);
+void disk_pwd(FileSystem *const filesystem);
+int disk_rm(FileSystem *const filesystem, const char name[], size_t length);
+void disk_close(FileSystem *const filesystem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
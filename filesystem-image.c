@@ -0,0 +1,739 @@
+/*
+ * File: filesystem-image.c
+ *
+ * This file contains the source code that saves file systems into images and
+ * loads them back, as declared in filesystem-image.h.
+ *
+ * An image starts with the magic string "FSI2" and the inode epoch of the
+ * file system, followed by one record for each entry in depth-first order.
+ * The files of each directory come before its subdirectories, both in the
+ * order of their lists. Each record starts with a single character:
+ * - 'F' name timestamp: a file.
+ * - 'H' name timestamp: a file with more than one link. These records are
+ *   numbered from 0 in the order they appear.
+ * - 'L' name number: another link to the file of the 'H' record with that
+ *   number.
+ * - 'S' name target: a symbolic link.
+ * - 'D' name: a subdirectory, whose records follow until the matching 'U'.
+ * - 'U': the end of the current subdirectory.
+ * - 'C': the directory being saved is the current directory.
+ * Names and targets are stored with their terminating null character, and
+ * numbers are stored as 8 bytes, most significant first. Since the records
+ * are already sorted, loading appends every entry to the end of its list
+ * instead of searching for its place, and never walks a path.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem-image.h"
+#include "filesystem-index.h"
+#include "filesystem-internal.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The number of slots fs_save() starts its table of saved links with, as a
+power of two */
+#define LINK_SLOTS 16
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures are the slots of the table of saved links, keyed by the
+ * number of the first node linked to a file's data, which no other data
+ * shares. A key of 0 marks an empty slot.
+ */
+typedef struct image_link
+{
+
+    /* The key, and the number of the 'H' record written for the data */
+    Node_index node;
+    size_t number;
+
+} Image_link;
+
+/*
+ * These structures are used to build an image that grows as records are
+ * written to it.
+ */
+typedef struct image_buffer
+{
+    /* The bytes written so far */
+    char *bytes;
+
+    /* The number of bytes written, and the allocated size */
+    size_t size;
+    size_t capacity;
+
+    /* Files with more than one link that have been saved, so that later
+    links refer back to them by the number of their 'H' record. The table
+    doubles in size whenever it becomes half full. */
+    Image_link *links;
+    size_t link_slots;
+    size_t linked_count;
+
+    /* Set to 0 once memory could not be allocated */
+    int ok;
+
+} Image_buffer;
+
+/*
+ * These structures hold the state of fs_load() while it reads an image
+ */
+typedef struct image_loader
+{
+
+    /* The file system being loaded */
+    FileSystem *filesystem;
+
+    /* The directory whose records are being read, and the last file and
+    subdirectory appended to its lists */
+    Dir_node *dir;
+    File_node *last_file;
+    Dir_node *last_dir;
+
+    /* The data of the 'H' records read so far, in order */
+    File_data **linked_data;
+    size_t linked_count;
+    size_t linked_capacity;
+
+} Image_loader;
+
+/* -------------------- Function Prototypes -------------------- */
+static void save_dir(Image_buffer *const image, FileSystem *const filesystem,
+                     Dir_node *const dir);
+static void save_file(Image_buffer *const image, File_node *const file);
+static Image_link *find_link(Image_buffer *const image, Node_index node);
+static int grow_links(Image_buffer *const image);
+static int load_file(Image_loader *const loader, const char name[],
+                     size_t length, File_data *data, const char target[],
+                     size_t target_length);
+static int load_linked(Image_loader *const loader, File_data *data);
+static int enter_dir(Image_loader *const loader, const char name[],
+                     size_t length);
+static int leave_dir(Image_loader *const loader);
+static int distinct_names(FileSystem *const filesystem, Dir_node *const dir);
+static void write_bytes(Image_buffer *const image, const char bytes[],
+                        size_t size);
+static void write_number(Image_buffer *const image, unsigned long number);
+static unsigned long read_number(const unsigned char bytes[]);
+static size_t string_size(const char image[], size_t pos, size_t size);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Saves the whole file system into an image, and stores its size in size.
+ * The file system itself is not modified, and can be removed with rmfs()
+ * afterwards without affecting the image.
+ * - The image is allocated with malloc(), and must be freed by the caller.
+ * - If memory could not be allocated, or if the file system was made with
+ *   mkfs_disk(), then it will return NULL.
+ */
+char *fs_save(FileSystem *const filesystem, size_t *size)
+{
+    Image_buffer image;
+    unsigned long epoch, i;
+    char *result = NULL;
+
+    if (filesystem != NULL && filesystem->disk == NULL && size != NULL)
+    {
+        image.bytes = NULL;
+        image.size = 0;
+        image.capacity = 0;
+        image.links = NULL;
+        image.link_slots = 0;
+        image.linked_count = 0;
+        image.ok = 1;
+
+        /* Inodes of the loaded file system start past every generation
+        used so far, so that handles into this one are stale there */
+        epoch = filesystem->inode_epoch;
+        for (i = 1; i < filesystem->inode_count; i++)
+        {
+            if (filesystem->inodes[i].gen >= epoch)
+            {
+                epoch = filesystem->inodes[i].gen + 1;
+            }
+        }
+
+        write_bytes(&image, "FSI2", 4);
+        write_number(&image, epoch);
+        save_dir(&image, filesystem, filesystem->root);
+
+        free(image.links);
+
+        if (image.ok)
+        {
+            result = image.bytes;
+            *size = image.size;
+        }
+        else
+        {
+            free(image.bytes);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Loads an image created by fs_save() into filesystem, which must have just
+ * been initialized with mkfs() or mkfs_with(). Afterwards, the current
+ * directory is the same as it was when the image was saved.
+ * - The entries are added to the name index if there is one, but no watch
+ *   events are reported for them.
+ * - If the image is invalid, if the file system is not empty, or if memory
+ *   could not be allocated, then it will return 0. The file system may then
+ *   be partially loaded, and should be removed with rmfs().
+ * - File systems made with mkfs_disk() cannot be loaded into, returning 0.
+ */
+int fs_load(FileSystem *const filesystem, const char image[], size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)image;
+    Image_loader loader;
+    Dir_node *cur_dir;
+    File_data *data;
+    const char *name;
+    size_t pos = 12, name_size, target_size;
+    unsigned long number;
+    int result = 0;
+
+    if (filesystem != NULL && filesystem->disk == NULL && image != NULL
+        && size >= 12 && memcmp(image, "FSI2", 4) == 0
+        && filesystem->root->file_list == 0
+        && filesystem->root->subdir_list == 0)
+    {
+        result = 1;
+        cur_dir = filesystem->root;
+
+        loader.filesystem = filesystem;
+        loader.dir = filesystem->root;
+        loader.last_file = NULL;
+        loader.last_dir = NULL;
+        loader.linked_data = NULL;
+        loader.linked_count = 0;
+        loader.linked_capacity = 0;
+
+        number = read_number(bytes + 4);
+        if (number > filesystem->inode_epoch)
+        {
+            filesystem->inode_epoch = number;
+        }
+
+        while (result && pos < size)
+        {
+            /* Finds the name following the record type. Its size is 0 if
+            it is not terminated within the image. */
+            name = image + pos + 1;
+            name_size = string_size(image, pos + 1, size);
+
+            switch (image[pos])
+            {
+            case 'F':
+            case 'H':
+                data = NULL;
+                if (name_size != 0 && pos + 1 + name_size + 8 <= size)
+                {
+                    data = fs_alloc(filesystem, sizeof(*data));
+                }
+                result = data != NULL;
+
+                if (result)
+                {
+                    data->timestamp =
+                        (int)read_number(bytes + pos + 1 + name_size);
+                    data->link_count = 0;
+                    data->links = 0;
+
+                    if (!load_file(&loader, name, name_size - 1, data, NULL,
+                                   0))
+                    {
+                        fs_free(filesystem, data, sizeof(*data));
+                        result = 0;
+                    }
+                    else if (image[pos] == 'H')
+                    {
+                        result = load_linked(&loader, data);
+                    }
+                }
+                pos += 1 + name_size + 8;
+                break;
+
+            case 'L':
+                result = name_size != 0 && pos + 1 + name_size + 8 <= size;
+                if (result)
+                {
+                    number = read_number(bytes + pos + 1 + name_size);
+                    result = number < loader.linked_count
+                             && load_file(&loader, name, name_size - 1,
+                                          loader.linked_data[number], NULL,
+                                          0);
+                }
+                pos += 1 + name_size + 8;
+                break;
+
+            case 'S':
+                target_size = 0;
+                if (name_size != 0)
+                {
+                    target_size = string_size(image, pos + 1 + name_size,
+                                              size);
+                }
+                result = target_size > 1
+                         && load_file(&loader, name, name_size - 1, NULL,
+                                      name + name_size, target_size - 1);
+                pos += 1 + name_size + target_size;
+                break;
+
+            case 'D':
+                result = name_size != 0
+                         && enter_dir(&loader, name, name_size - 1);
+                pos += 1 + name_size;
+                break;
+
+            case 'U':
+                result = leave_dir(&loader);
+                pos += 1;
+                break;
+
+            case 'C':
+                cur_dir = loader.dir;
+                pos += 1;
+                break;
+
+            default:
+                result = 0;
+                break;
+            }
+        }
+
+        /* Every subdirectory must have been left again */
+        result = result && loader.dir == filesystem->root
+                 && distinct_names(filesystem, filesystem->root);
+
+        if (filesystem->name_index != NULL)
+        {
+            index_check(filesystem);
+        }
+
+        free(loader.linked_data);
+        filesystem->cur_dir = cur_dir;
+    }
+
+    return result;
+}
+
+/*
+ * A recursive helper function to write the records of all the files and
+ * subdirectories within the specified directory.
+ */
+static void save_dir(Image_buffer *const image, FileSystem *const filesystem,
+                     Dir_node *const dir)
+{
+    File_node *cur_file;
+    Dir_node *cur_dir;
+
+    if (dir == filesystem->cur_dir)
+    {
+        write_bytes(image, "C", 1);
+    }
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        save_file(image, cur_file);
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        write_bytes(image, "D", 1);
+        write_bytes(image, cur_dir->name, strlen(cur_dir->name) + 1);
+        save_dir(image, filesystem, cur_dir); /* Recursive call */
+        write_bytes(image, "U", 1);
+    }
+}
+
+/*
+ * A helper function to write the record of the specified file. Files with
+ * more than one link are written as an 'H' record the first time, and as
+ * a link to that record every time after.
+ */
+static void save_file(Image_buffer *const image, File_node *const file)
+{
+    Image_link *link = NULL;
+
+    /* Case: A symbolic link */
+    if (file->symlink != NULL)
+    {
+        write_bytes(image, "S", 1);
+        write_bytes(image, file->name, strlen(file->name) + 1);
+        write_bytes(image, file->symlink->target,
+                    strlen(file->symlink->target) + 1);
+    }
+    /* Case: A file with a single link */
+    else if (file->data->link_count == 1)
+    {
+        write_bytes(image, "F", 1);
+        write_bytes(image, file->name, strlen(file->name) + 1);
+        write_number(image, (unsigned long)file->data->timestamp);
+    }
+    else
+    {
+        if (image->linked_count < image->link_slots / 2 || grow_links(image))
+        {
+            link = find_link(image, file->data->links);
+        }
+
+        /* Case: A link to a file that has already been saved */
+        if (link != NULL && link->node != 0)
+        {
+            write_bytes(image, "L", 1);
+            write_bytes(image, file->name, strlen(file->name) + 1);
+            write_number(image, (unsigned long)link->number);
+        }
+        /* Case: The first link of a file, which is remembered so that the
+        other links refer back to it */
+        else
+        {
+            if (link != NULL)
+            {
+                link->node = file->data->links;
+                link->number = image->linked_count;
+                image->linked_count += 1;
+            }
+
+            write_bytes(image, "H", 1);
+            write_bytes(image, file->name, strlen(file->name) + 1);
+            write_number(image, (unsigned long)file->data->timestamp);
+        }
+    }
+}
+
+/*
+ * A helper function to find the slot of the table of saved links holding
+ * the specified key, or the empty slot where it would go. The table must
+ * not be full.
+ */
+static Image_link *find_link(Image_buffer *const image, Node_index node)
+{
+    size_t slot = (size_t)(node * 2654435761UL) & (image->link_slots - 1);
+
+    while (image->links[slot].node != 0 && image->links[slot].node != node)
+    {
+        slot = (slot + 1) & (image->link_slots - 1);
+    }
+
+    return &image->links[slot];
+}
+
+/*
+ * A helper function to double the size of the table of saved links, moving
+ * every saved link into the new table.
+ * - If memory could not be allocated, then the image is marked as failed
+ *   and it will return 0.
+ */
+static int grow_links(Image_buffer *const image)
+{
+    Image_link *old_links = image->links;
+    size_t old_slots = image->link_slots, i;
+    int result = 0;
+
+    image->link_slots = old_slots == 0 ? LINK_SLOTS : old_slots * 2;
+    image->links = calloc(image->link_slots, sizeof(*image->links));
+    if (image->links != NULL)
+    {
+        for (i = 0; i < old_slots; i++)
+        {
+            if (old_links[i].node != 0)
+            {
+                *find_link(image, old_links[i].node) = old_links[i];
+            }
+        }
+        free(old_links);
+        result = 1;
+    }
+    else
+    {
+        /* Malloc Error */
+        image->links = old_links;
+        image->link_slots = old_slots;
+        image->ok = 0;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function for fs_load(), appending a file with the specified
+ * name to the directory being loaded, as make_file() makes it. The name
+ * must come after the previous file's, and before any subdirectory has
+ * been loaded, as fs_save() writes them.
+ * - If the name is invalid or out of order, or if memory could not be
+ *   allocated, then nothing is added and it will return 0.
+ */
+static int load_file(Image_loader *const loader, const char name[],
+                     size_t length, File_data *data, const char target[],
+                     size_t target_length)
+{
+    File_node *file = NULL;
+
+    if (classify_name(name, length) == NAME_REGULAR
+        && loader->last_dir == NULL
+        && (loader->last_file == NULL
+            || strcmp(loader->last_file->name, name) < 0))
+    {
+        file = make_file(loader->filesystem, loader->dir, name, length, data,
+                         target, target_length);
+    }
+
+    if (file != NULL)
+    {
+        if (loader->last_file == NULL)
+        {
+            loader->dir->file_list = file->self;
+        }
+        else
+        {
+            loader->last_file->next_file = file->self;
+        }
+        loader->last_file = file;
+
+        if (loader->filesystem->name_index != NULL)
+        {
+            index_add(loader->filesystem, NULL, file);
+        }
+    }
+
+    return file != NULL;
+}
+
+/*
+ * A helper function for fs_load(), remembering the data of an 'H' record
+ * so that later 'L' records can link to it. The array of data doubles in
+ * size whenever it is full.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int load_linked(Image_loader *const loader, File_data *data)
+{
+    File_data **new_data;
+    size_t new_capacity;
+    int result = 1;
+
+    if (loader->linked_count == loader->linked_capacity)
+    {
+        new_capacity = loader->linked_capacity == 0
+                           ? 16
+                           : loader->linked_capacity * 2;
+        new_data = realloc(loader->linked_data,
+                           sizeof(*new_data) * new_capacity);
+        if (new_data != NULL)
+        {
+            loader->linked_data = new_data;
+            loader->linked_capacity = new_capacity;
+        }
+        else
+        {
+            /* Malloc Error */
+            result = 0;
+        }
+    }
+
+    if (result)
+    {
+        loader->linked_data[loader->linked_count] = data;
+        loader->linked_count += 1;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function for fs_load(), appending a subdirectory with the
+ * specified name to the directory being loaded, whose records are then
+ * read until leave_dir(). The name must come after the previous
+ * subdirectory's.
+ * - If the name is invalid or out of order, or if memory could not be
+ *   allocated, then nothing is added and it will return 0.
+ */
+static int enter_dir(Image_loader *const loader, const char name[],
+                     size_t length)
+{
+    Dir_node *dir = NULL;
+
+    if (classify_name(name, length) == NAME_REGULAR
+        && (loader->last_dir == NULL
+            || strcmp(loader->last_dir->name, name) < 0))
+    {
+        dir = make_dir(loader->filesystem, loader->dir, name, length);
+    }
+
+    if (dir != NULL)
+    {
+        if (loader->last_dir == NULL)
+        {
+            loader->dir->subdir_list = dir->self;
+        }
+        else
+        {
+            loader->last_dir->next_dir = dir->self;
+        }
+
+        if (loader->filesystem->name_index != NULL)
+        {
+            index_add(loader->filesystem, dir, NULL);
+        }
+
+        loader->dir = dir;
+        loader->last_file = NULL;
+        loader->last_dir = NULL;
+    }
+
+    return dir != NULL;
+}
+
+/*
+ * A helper function for fs_load(), going back to the parent of the
+ * directory being loaded, where the directory left is the last
+ * subdirectory appended. No more files can follow in the parent.
+ * - If the directory is the root, or a file and a subdirectory in it share
+ *   a name, then it will return 0.
+ */
+static int leave_dir(Image_loader *const loader)
+{
+    FileSystem *const filesystem = loader->filesystem;
+    int result;
+
+    result = loader->dir->par_dir != 0
+             && distinct_names(filesystem, loader->dir);
+    if (result)
+    {
+        loader->last_dir = loader->dir;
+        loader->last_file = NULL;
+        loader->dir = DIR_AT(filesystem, loader->dir->par_dir);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to check that no file of the directory has the same
+ * name as one of its subdirectories, walking both sorted lists at once.
+ * Returns 1 if the names are distinct, and 0 otherwise.
+ */
+static int distinct_names(FileSystem *const filesystem, Dir_node *const dir)
+{
+    File_node *file = FILE_AT(filesystem, dir->file_list);
+    Dir_node *subdir = DIR_AT(filesystem, dir->subdir_list);
+    int order, result = 1;
+
+    while (result && file != NULL && subdir != NULL)
+    {
+        order = strcmp(file->name, subdir->name);
+        if (order < 0)
+        {
+            file = FILE_AT(filesystem, file->next_file);
+        }
+        else if (order > 0)
+        {
+            subdir = DIR_AT(filesystem, subdir->next_dir);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to append size bytes to the image, doubling its
+ * allocated size whenever it is full.
+ */
+static void write_bytes(Image_buffer *const image, const char bytes[],
+                        size_t size)
+{
+    char *new_bytes;
+    size_t new_capacity;
+
+    if (image->ok && image->size + size > image->capacity)
+    {
+        new_capacity = image->capacity == 0 ? 256 : image->capacity * 2;
+        while (new_capacity < image->size + size)
+        {
+            new_capacity *= 2;
+        }
+
+        new_bytes = realloc(image->bytes, new_capacity);
+        if (new_bytes != NULL)
+        {
+            image->bytes = new_bytes;
+            image->capacity = new_capacity;
+        }
+        else
+        {
+            /* Malloc Error */
+            image->ok = 0;
+        }
+    }
+
+    if (image->ok)
+    {
+        memcpy(image->bytes + image->size, bytes, size);
+        image->size += size;
+    }
+}
+
+/*
+ * A helper function to append number to the image as 8 bytes, most
+ * significant first, which holds all of it however wide unsigned long is.
+ */
+static void write_number(Image_buffer *const image, unsigned long number)
+{
+    char bytes[8];
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        bytes[i] = (char)(number & 0xFF);
+        number >>= 8;
+    }
+
+    write_bytes(image, bytes, 8);
+}
+
+/*
+ * A helper function to read a number written by write_number().
+ */
+static unsigned long read_number(const unsigned char bytes[])
+{
+    unsigned long number = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        number = (number << 8) | bytes[i];
+    }
+
+    return number;
+}
+
+/*
+ * A helper function to find the size of the string starting at pos in the
+ * image, including its terminating null character. Returns 0 if the string
+ * is not terminated before the end of the image.
+ */
+static size_t string_size(const char image[], size_t pos, size_t size)
+{
+    const char *end = NULL;
+
+    if (pos < size)
+    {
+        end = memchr(image + pos, '\0', size - pos);
+    }
+
+    return end != NULL ? (size_t)(end - (image + pos)) + 1 : 0;
+}
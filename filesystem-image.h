@@ -0,0 +1,28 @@
+/*
+ * File: filesystem-image.h
+ *
+ * This file contains the function prototypes used to save a whole file
+ * system into a single block of memory (an image), and to load it back.
+ * Images keep every directory, file, timestamp, hard link and symbolic link,
+ * along with the current directory.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_IMAGE_H
+#define FILESYSTEM_IMAGE_H
+
+#include "filesystem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char *fs_save(FileSystem *const filesystem, size_t *size);
+int fs_load(FileSystem *const filesystem, const char image[], size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
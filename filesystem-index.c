@@ -0,0 +1,913 @@
+/*
+ * File: filesystem-index.c
+ *
+ * This file contains the source code of the name index and of substring
+ * searches, as declared in filesystem-index.h.
+ *
+ * Every indexed entry is given a number (its name id), and each trigram
+ * keeps the ids of the entries containing it in increasing order, as a
+ * posting list. Since new entries always get the highest id yet, adding one
+ * only appends to the lists of its trigrams. Each id is stored as its
+ * difference from the previous one, using 7 bits per byte, so most of them
+ * take a single byte. Every POSTING_BLOCK ids, a skip records where the
+ * next block starts, so that searches can jump over the parts of long lists
+ * that cannot match.
+ *
+ * Removing an entry only clears its slot in the table of entries, leaving
+ * its id in the lists, where searches skip it. The whole index is rebuilt
+ * once there are more removed entries than live ones.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem-index.h"
+#include "filesystem-internal.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The number of ids between two skips of a posting list */
+#define POSTING_BLOCK 64
+
+/* The number of removed entries the index keeps before being rebuilt,
+on top of the number of live entries */
+#define MIN_STALE_ENTRIES 1024
+
+/* The id of a cursor that has gone past the end of its list */
+#define END_ID ULONG_MAX
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures mark where blocks of a posting list start.
+ */
+typedef struct posting_skip
+{
+
+    /* The id before the first one of the block, which is the base its
+    first difference is added to */
+    unsigned long base;
+
+    /* The offset of the block within the list's bytes */
+    size_t offset;
+
+} Posting_skip;
+
+/*
+ * These structures hold the ids of the entries containing a trigram.
+ */
+typedef struct posting
+{
+
+    /* The trigram plus 1, or 0 if this slot of the table is empty */
+    unsigned long key;
+
+    /* The number of ids in the list, and the last one of them */
+    unsigned long count;
+    unsigned long last;
+
+    /* The differences between consecutive ids, 7 bits per byte */
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+
+    /* A skip for every POSTING_BLOCK ids */
+    Posting_skip *skips;
+    size_t skip_count;
+    size_t skip_capacity;
+
+} Posting;
+
+/*
+ * These structures map name ids to the entries they were given to, with
+ * both pointers set to NULL once the entry has been removed.
+ */
+typedef struct index_entry
+{
+    Dir_node *dir;
+    File_node *file;
+
+} Index_entry;
+
+/*
+ * These structures hold the name index of a file system
+ */
+struct fs_name_index
+{
+
+    /* The hash table of posting lists, indexed by trigram */
+    Posting *postings;
+    size_t posting_count;
+    size_t posting_capacity;
+
+    /* The entries, indexed by name id. Id 0 is never used. */
+    Index_entry *entries;
+    unsigned long entry_count;
+    unsigned long entry_capacity;
+
+    /* The number of entries that are still in the file system, and of
+    those that have been removed since the index was last rebuilt */
+    unsigned long live;
+    unsigned long stale;
+
+    /* Set to 0 once memory could not be allocated, which leaves the index
+    incomplete until it is rebuilt by the next search */
+    int ok;
+
+};
+
+/*
+ * These structures read the ids of a posting list one by one.
+ */
+typedef struct posting_cursor
+{
+
+    /* The list being read */
+    const Posting *posting;
+
+    /* The offset of the next difference to read */
+    size_t offset;
+
+    /* The id read last, or END_ID once there are no more */
+    unsigned long id;
+
+} Posting_cursor;
+
+/* -------------------- Function Prototypes -------------------- */
+static int rebuild_index(FileSystem *const filesystem);
+static int index_dir(FileSystem *const filesystem, Dir_node *const dir);
+static int add_entry(FileSystem *const filesystem, Dir_node *dir,
+                     File_node *file);
+static Posting *find_posting(FileSystem *const filesystem,
+                             unsigned long trigram, int create);
+static int grow_postings(FileSystem *const filesystem);
+static int append_id(FileSystem *const filesystem, Posting *const posting,
+                     unsigned long id);
+static void clear_postings(FileSystem *const filesystem);
+static void cursor_next(Posting_cursor *const cursor);
+static void cursor_seek(Posting_cursor *const cursor, unsigned long id);
+static long find_with_index(FileSystem *const filesystem,
+                            const char substring[], size_t length);
+static long find_in_dir(FileSystem *const filesystem, Dir_node *const dir,
+                        const char substring[], size_t length);
+static long check_entry(FileSystem *const filesystem, Dir_node *const dir,
+                        File_node *const file, const char substring[],
+                        size_t length);
+static unsigned long get_trigram(const char name[]);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Builds a name index for the file system, which is then kept up to date
+ * until fs_disable_index() or rmfs() is called. Searches with
+ * fs_find_substring() use it instead of walking every entry.
+ * - If the file system already has an index, then it is left as it is.
+ * - If memory could not be allocated, or if the file system was made with
+ *   mkfs_disk(), then it will return 0.
+ */
+int fs_enable_index(FileSystem *const filesystem)
+{
+    int result = 0;
+
+    if (filesystem != NULL && filesystem->disk == NULL)
+    {
+        result = 1;
+
+        if (filesystem->name_index == NULL)
+        {
+            filesystem->name_index = calloc(1, sizeof(struct fs_name_index));
+            if (filesystem->name_index != NULL)
+            {
+                filesystem->bytes_used += sizeof(struct fs_name_index);
+            }
+            if (filesystem->name_index == NULL
+                || !rebuild_index(filesystem))
+            {
+                fs_disable_index(filesystem);
+                result = 0;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Frees the name index of the file system, if it has one. Entries are no
+ * longer indexed as they are created and removed afterwards.
+ */
+void fs_disable_index(FileSystem *const filesystem)
+{
+    struct fs_name_index *index;
+
+    if (filesystem != NULL && filesystem->name_index != NULL)
+    {
+        index = filesystem->name_index;
+
+        clear_postings(filesystem);
+        filesystem->bytes_used -= sizeof(*index)
+                                  + sizeof(Posting) * index->posting_capacity
+                                  + sizeof(Index_entry)
+                                        * index->entry_capacity;
+        free(index->postings);
+        free(index->entries);
+        free(index);
+
+        filesystem->name_index = NULL;
+    }
+}
+
+/*
+ * Prints the path of every file and directory in the file system whose name
+ * contains substring, one per line. Directories end with a forward-slash,
+ * and symbolic links with an at sign (@), like ls() prints them.
+ * - With a name index, substrings of three or more characters only look at
+ *   the entries containing all of their trigrams, in the order they were
+ *   indexed. Otherwise, every entry is looked at in depth-first order.
+ * - The paths are printed wherever ls() prints.
+ * - Returns the number of paths printed, or -1 if a parameter is NULL or
+ *   the file system was made with mkfs_disk().
+ */
+long fs_find_substring(FileSystem *const filesystem, const char substring[])
+{
+    return fs_find_substring_n(filesystem, substring,
+                               substring != NULL ? strlen(substring) : 0);
+}
+
+/*
+ * Works like fs_find_substring(), but takes the length of substring instead
+ * of relying on a terminating null character, so it does not need to have
+ * one.
+ */
+long fs_find_substring_n(FileSystem *const filesystem,
+                         const char substring[], size_t length)
+{
+    long result = -1;
+
+    if (filesystem != NULL && filesystem->disk == NULL && substring != NULL)
+    {
+        result = 0;
+
+        /* Names can never contain these characters */
+        if (memchr(substring, '/', length) == NULL
+            && memchr(substring, '\0', length) == NULL)
+        {
+            /* An index that is missing entries is rebuilt first, and
+            searches without an index walk the whole tree instead */
+            if (filesystem->name_index != NULL
+                && (filesystem->name_index->ok || rebuild_index(filesystem)))
+            {
+                result = find_with_index(filesystem, substring, length);
+            }
+            else
+            {
+                result = find_in_dir(filesystem, filesystem->root,
+                                     substring, length);
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Adds a directory or file (with the other one passed as NULL) that has just
+ * been created to the file system's name index. The index is never rebuilt
+ * here, since callers adding several entries at once may have linked the
+ * others into the tree already, and index_check() is called instead once
+ * they have all been added.
+ */
+void index_add(FileSystem *const filesystem, Dir_node *dir, File_node *file)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+
+    if (index->ok && !add_entry(filesystem, dir, file))
+    {
+        index->ok = 0;
+    }
+}
+
+/*
+ * Rebuilds the file system's name index once it holds too many removed
+ * entries. Every entry in the tree must have been added with index_add(),
+ * and every entry removed from it with index_remove(), by then.
+ */
+void index_check(FileSystem *const filesystem)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+
+    if (index->ok && index->stale > index->live + MIN_STALE_ENTRIES)
+    {
+        rebuild_index(filesystem);
+    }
+}
+
+/*
+ * Removes the entry with the specified name id from the file system's name
+ * index. Its id stays in the posting lists until the next rebuild, but no
+ * longer leads anywhere.
+ */
+void index_remove(FileSystem *const filesystem, unsigned long name_id)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+
+    if (name_id != 0 && name_id < index->entry_count
+        && (index->entries[name_id].dir != NULL
+            || index->entries[name_id].file != NULL))
+    {
+        index->entries[name_id].dir = NULL;
+        index->entries[name_id].file = NULL;
+        index->live -= 1;
+        index->stale += 1;
+    }
+}
+
+/*
+ * Points the entry of a directory or file (with the other one passed as
+ * NULL) to where it has been moved by fs_compact(), using its name id.
+ */
+void index_move(FileSystem *const filesystem, Dir_node *dir, File_node *file)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    unsigned long name_id = dir != NULL ? dir->name_id : file->name_id;
+
+    if (name_id != 0 && name_id < index->entry_count
+        && (index->entries[name_id].dir != NULL
+            || index->entries[name_id].file != NULL))
+    {
+        index->entries[name_id].dir = dir;
+        index->entries[name_id].file = file;
+    }
+}
+
+/*
+ * A helper function to empty the file system's name index, and index every
+ * entry of the file system again with new ids.
+ * - If memory could not be allocated, then it will return 0, and the index
+ *   stays incomplete.
+ */
+static int rebuild_index(FileSystem *const filesystem)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+
+    clear_postings(filesystem);
+    index->posting_count = 0;
+    index->entry_count = 1;
+    index->live = 0;
+    index->stale = 0;
+
+    index->ok = index_dir(filesystem, filesystem->root);
+
+    return index->ok;
+}
+
+/*
+ * A recursive helper function to index every file and subdirectory within
+ * the specified directory.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int index_dir(FileSystem *const filesystem, Dir_node *const dir)
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    int result = 1;
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list);
+         result && cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        result = add_entry(filesystem, NULL, cur_file);
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list);
+         result && cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        result = add_entry(filesystem, cur_dir, NULL)
+                 && index_dir(filesystem, cur_dir); /* Recursive call */
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to give the next name id to a directory or file (with
+ * the other one passed as NULL), and to append it to the posting list of
+ * every trigram in its name.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int add_entry(FileSystem *const filesystem, Dir_node *dir,
+                     File_node *file)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    Index_entry *new_entries;
+    Posting *posting;
+    const char *name = dir != NULL ? dir->name : file->name;
+    unsigned long new_capacity, id;
+    size_t i, length;
+    int result = 1;
+
+    /* Makes room for the entry, keeping id 0 unused. Ids are kept by the
+    nodes in a Node_index, so there can be no more of them than fit. */
+    if (index->entry_count > (Node_index)-1)
+    {
+        result = 0;
+    }
+    else if (index->entry_count >= index->entry_capacity)
+    {
+        new_capacity = index->entry_capacity == 0
+                           ? 1024 : index->entry_capacity * 2;
+        new_entries = realloc(index->entries,
+                              sizeof(*new_entries) * new_capacity);
+        if (new_entries != NULL)
+        {
+            filesystem->bytes_used += sizeof(*new_entries)
+                                      * (new_capacity
+                                         - index->entry_capacity);
+            index->entries = new_entries;
+            index->entry_capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (result)
+    {
+        id = index->entry_count;
+        index->entry_count += 1;
+        index->entries[id].dir = dir;
+        index->entries[id].file = file;
+        index->live += 1;
+
+        if (dir != NULL)
+        {
+            dir->name_id = id;
+        }
+        else
+        {
+            file->name_id = id;
+        }
+
+        /* Names shorter than three characters have no trigrams, and are
+        only found by searches that look at every entry */
+        length = strlen(name);
+        for (i = 0; result && i + 3 <= length; i++)
+        {
+            posting = find_posting(filesystem, get_trigram(name + i), 1);
+            result = posting != NULL && append_id(filesystem, posting, id);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to find the posting list of the specified trigram in
+ * the hash table of the index, using linear probing.
+ * - If create is 1, a list is added for trigrams that have none yet.
+ * - Returns NULL if the trigram has no list and none could be added.
+ */
+static Posting *find_posting(FileSystem *const filesystem,
+                             unsigned long trigram, int create)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    Posting *result = NULL;
+    unsigned long hash;
+    size_t slot;
+
+    /* The table is kept at most half full */
+    if (create && (index->posting_count + 1) * 2 > index->posting_capacity
+        && !grow_postings(filesystem))
+    {
+        return NULL;
+    }
+
+    if (index->posting_capacity != 0)
+    {
+        hash = trigram * 2654435761UL;
+        hash ^= hash >> 15;
+        slot = (size_t)hash & (index->posting_capacity - 1);
+
+        while (index->postings[slot].key != 0
+               && index->postings[slot].key != trigram + 1)
+        {
+            slot = (slot + 1) & (index->posting_capacity - 1);
+        }
+
+        if (index->postings[slot].key != 0)
+        {
+            result = &index->postings[slot];
+        }
+        else if (create)
+        {
+            result = &index->postings[slot];
+            memset(result, 0, sizeof(*result));
+            result->key = trigram + 1;
+            index->posting_count += 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to double the size of the hash table of posting lists,
+ * moving every list to its slot in the new table.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int grow_postings(FileSystem *const filesystem)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    Posting *old_postings = index->postings, *posting;
+    size_t old_capacity = index->posting_capacity, i;
+    int result = 0;
+
+    index->posting_capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+    index->postings = calloc(index->posting_capacity, sizeof(Posting));
+
+    if (index->postings != NULL)
+    {
+        result = 1;
+        index->posting_count = 0;
+        filesystem->bytes_used += sizeof(Posting)
+                                  * (index->posting_capacity - old_capacity);
+
+        for (i = 0; i < old_capacity; i++)
+        {
+            if (old_postings[i].key != 0)
+            {
+                /* There is room for every list, so this cannot fail */
+                posting = find_posting(filesystem, old_postings[i].key - 1,
+                                       1);
+                *posting = old_postings[i];
+            }
+        }
+
+        free(old_postings);
+    }
+    else
+    {
+        index->postings = old_postings;
+        index->posting_capacity = old_capacity;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to append id to the posting list, which must only hold
+ * smaller ids. Names containing a trigram more than once append their id
+ * once.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int append_id(FileSystem *const filesystem, Posting *const posting,
+                     unsigned long id)
+{
+    Posting_skip *new_skips;
+    unsigned char *new_bytes;
+    unsigned long difference;
+    size_t new_capacity;
+    int result = 1;
+
+    if (posting->last == id)
+    {
+        return result;
+    }
+
+    /* Makes room for the longest difference, and for a skip */
+    if (posting->size + sizeof(unsigned long) * 2 > posting->capacity)
+    {
+        new_capacity = posting->capacity == 0 ? 16 : posting->capacity * 2;
+        new_bytes = realloc(posting->bytes, new_capacity);
+        if (new_bytes != NULL)
+        {
+            filesystem->bytes_used += new_capacity - posting->capacity;
+            posting->bytes = new_bytes;
+            posting->capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    if (result && posting->count % POSTING_BLOCK == 0
+        && posting->skip_count == posting->skip_capacity)
+    {
+        new_capacity = posting->skip_capacity == 0
+                           ? 4 : posting->skip_capacity * 2;
+        new_skips = realloc(posting->skips,
+                            sizeof(*new_skips) * new_capacity);
+        if (new_skips != NULL)
+        {
+            filesystem->bytes_used += sizeof(*new_skips)
+                                      * (new_capacity
+                                         - posting->skip_capacity);
+            posting->skips = new_skips;
+            posting->skip_capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (result)
+    {
+        if (posting->count % POSTING_BLOCK == 0)
+        {
+            posting->skips[posting->skip_count].base = posting->last;
+            posting->skips[posting->skip_count].offset = posting->size;
+            posting->skip_count += 1;
+        }
+
+        /* Writes the lowest 7 bits first, with the highest bit of each
+        byte set if more of them follow */
+        difference = id - posting->last;
+        while (difference >= 0x80)
+        {
+            posting->bytes[posting->size++] =
+                (unsigned char)(difference & 0x7F) | 0x80;
+            difference >>= 7;
+        }
+        posting->bytes[posting->size++] = (unsigned char)difference;
+
+        posting->last = id;
+        posting->count += 1;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to free every posting list of the index, leaving the
+ * hash table itself empty.
+ */
+static void clear_postings(FileSystem *const filesystem)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    Posting *posting;
+    size_t i;
+
+    for (i = 0; i < index->posting_capacity; i++)
+    {
+        posting = &index->postings[i];
+        if (posting->key != 0)
+        {
+            filesystem->bytes_used -= posting->capacity
+                                      + sizeof(*posting->skips)
+                                            * posting->skip_capacity;
+            free(posting->bytes);
+            free(posting->skips);
+            posting->key = 0;
+        }
+    }
+}
+
+/*
+ * A helper function to move the cursor to the next id of its list.
+ */
+static void cursor_next(Posting_cursor *const cursor)
+{
+    const unsigned char *const bytes = cursor->posting->bytes;
+    unsigned long difference = 0;
+    int shift = 0;
+
+    if (cursor->offset >= cursor->posting->size)
+    {
+        cursor->id = END_ID;
+    }
+    else
+    {
+        while (bytes[cursor->offset] & 0x80)
+        {
+            difference |= (unsigned long)(bytes[cursor->offset] & 0x7F)
+                          << shift;
+            shift += 7;
+            cursor->offset += 1;
+        }
+        difference |= (unsigned long)bytes[cursor->offset] << shift;
+        cursor->offset += 1;
+
+        cursor->id += difference;
+    }
+}
+
+/*
+ * A helper function to move the cursor forward to the first id of its list
+ * that is not smaller than id. The skips are searched for the last block
+ * that starts before id, so the blocks in between are never read.
+ */
+static void cursor_seek(Posting_cursor *const cursor, unsigned long id)
+{
+    const Posting *const posting = cursor->posting;
+    size_t low = 0, high = posting->skip_count, middle;
+
+    if (cursor->id < id)
+    {
+        /* Finds the last skip whose base is smaller than id */
+        while (high - low > 1)
+        {
+            middle = low + (high - low) / 2;
+            if (posting->skips[middle].base < id)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        if (posting->skip_count != 0
+            && posting->skips[low].offset > cursor->offset)
+        {
+            cursor->offset = posting->skips[low].offset;
+            cursor->id = posting->skips[low].base;
+        }
+
+        while (cursor->id < id)
+        {
+            cursor_next(cursor);
+        }
+    }
+}
+
+/*
+ * A helper function for fs_find_substring(), which only verifies the
+ * entries found in the posting lists of every trigram of substring.
+ * Substrings shorter than three characters verify every live entry.
+ * Returns the number of paths printed.
+ */
+static long find_with_index(FileSystem *const filesystem,
+                            const char substring[], size_t length)
+{
+    struct fs_name_index *const index = filesystem->name_index;
+    Posting_cursor *cursors, cursor;
+    Posting *posting;
+    unsigned long id;
+    size_t count = 0, i, j;
+    long result = 0;
+
+    if (length < 3)
+    {
+        for (id = 1; id < index->entry_count; id++)
+        {
+            result += check_entry(filesystem, index->entries[id].dir,
+                                  index->entries[id].file, substring,
+                                  length);
+        }
+        return result;
+    }
+
+    cursors = malloc(sizeof(*cursors) * (length - 2));
+    if (cursors == NULL)
+    {
+        return find_in_dir(filesystem, filesystem->root, substring, length);
+    }
+
+    /* Sets a cursor on the list of each trigram, which are sorted from
+    the shortest list to the longest one. If a trigram has no list, then
+    nothing can match. */
+    for (i = 0; i + 3 <= length; i++)
+    {
+        posting = find_posting(filesystem, get_trigram(substring + i), 0);
+        if (posting == NULL)
+        {
+            free(cursors);
+            return 0;
+        }
+
+        cursor.posting = posting;
+        cursor.offset = 0;
+        cursor.id = 0;
+        cursor_next(&cursor);
+
+        for (j = count; j > 0 && cursors[j - 1].posting->count
+                                     > posting->count; j--)
+        {
+            cursors[j] = cursors[j - 1];
+        }
+        cursors[j] = cursor;
+        count++;
+    }
+
+    /* Moves the cursors forward together, until they all agree on an id,
+    which is then a candidate to verify */
+    id = cursors[0].id;
+    while (id != END_ID)
+    {
+        for (i = 1; i < count && id != END_ID; i++)
+        {
+            cursor_seek(&cursors[i], id);
+            if (cursors[i].id != id)
+            {
+                cursor_seek(&cursors[0], cursors[i].id);
+                id = cursors[0].id;
+                i = 0;
+            }
+        }
+
+        if (id != END_ID)
+        {
+            result += check_entry(filesystem, index->entries[id].dir,
+                                  index->entries[id].file, substring,
+                                  length);
+            cursor_next(&cursors[0]);
+            id = cursors[0].id;
+        }
+    }
+
+    free(cursors);
+
+    return result;
+}
+
+/*
+ * A recursive helper function for fs_find_substring(), which verifies every
+ * file and subdirectory within the specified directory.
+ * Returns the number of paths printed.
+ */
+static long find_in_dir(FileSystem *const filesystem, Dir_node *const dir,
+                        const char substring[], size_t length)
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    long result = 0;
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        result += check_entry(filesystem, NULL, cur_file, substring, length);
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        result += check_entry(filesystem, cur_dir, NULL, substring, length);
+        result += find_in_dir(filesystem, cur_dir, substring,
+                              length); /* Recursive call */
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print the path of a directory or file (with the
+ * other one passed as NULL) if its name contains substring. Removed entries
+ * have both passed as NULL, and are skipped.
+ * Returns 1 if the path was printed, and 0 otherwise.
+ */
+static long check_entry(FileSystem *const filesystem, Dir_node *const dir,
+                        File_node *const file, const char substring[],
+                        size_t length)
+{
+    const char *name;
+    size_t i, name_length;
+    long result = 0;
+
+    if (dir != NULL || file != NULL)
+    {
+        name = dir != NULL ? dir->name : file->name;
+        name_length = strlen(name);
+
+        for (i = 0; !result && i + length <= name_length; i++)
+        {
+            result = strncmp(name + i, substring, length) == 0;
+        }
+    }
+
+    if (result)
+    {
+        if (dir != NULL)
+        {
+            print_text(filesystem, dir->path);
+            print_text(filesystem, "/\n");
+        }
+        else
+        {
+            print_text(filesystem, DIR_AT(filesystem, file->par_dir)->path);
+            print_text(filesystem, "/");
+            print_text(filesystem, file->name);
+            print_text(filesystem, file->symlink != NULL ? "@\n" : "\n");
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to return the trigram made of the first three
+ * characters of name, as a 24 bit number.
+ */
+static unsigned long get_trigram(const char name[])
+{
+    return ((unsigned long)(unsigned char)name[0] << 16)
+           | ((unsigned long)(unsigned char)name[1] << 8)
+           | (unsigned long)(unsigned char)name[2];
+}
@@ -0,0 +1,45 @@
+/*
+ * File: filesystem-index.h
+ *
+ * This file contains the function prototypes used to search a whole file
+ * system for entries whose names contain a substring.
+ *
+ * Searches work on any file system, but walk every entry unless the file
+ * system has a name index, enabled with fs_enable_index(). The index maps
+ * every three consecutive characters (a trigram) appearing in names to the
+ * list of entries whose names contain them, so a search only verifies the
+ * entries found in the lists of all of its trigrams. touch(), mkdir(), ln(),
+ * ln_s() and rm() keep the index up to date as entries come and go.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_INDEX_H
+#define FILESYSTEM_INDEX_H
+
+#include "filesystem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int fs_enable_index(FileSystem *const filesystem);
+void fs_disable_index(FileSystem *const filesystem);
+long fs_find_substring(FileSystem *const filesystem, const char substring[]);
+long fs_find_substring_n(FileSystem *const filesystem,
+                         const char substring[], size_t length);
+
+/* Used by filesystem.c to keep the index up to date. They must only be
+called while the file system has an index. */
+void index_add(FileSystem *const filesystem, Dir_node *dir,
+               File_node *file);
+void index_check(FileSystem *const filesystem);
+void index_remove(FileSystem *const filesystem, unsigned long name_id);
+void index_move(FileSystem *const filesystem, Dir_node *dir,
+                File_node *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * File: filesystem-internal.h
+ *
+ * This file contains the constants and function prototypes shared by the
+ * source files of the file system, which are not part of its interface.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_INTERNAL_H
+#define FILESYSTEM_INTERNAL_H
+
+#include "filesystem.h"
+
+/* The kinds of names told apart by classify_name() */
+#define NAME_INVALID 0 /* Consists of a forward-slash or null character */
+#define NAME_EMPTY 1   /* An empty string */
+#define NAME_DOT 2     /* A single period (.) */
+#define NAME_DOTDOT 3  /* A double adjacent period (..) */
+#define NAME_ROOT 4    /* Solely a forward-slash (/) */
+#define NAME_REGULAR 5 /* Any other name of a file or directory */
+
+/* The number of nodes in each chunk of a node table, as a power of two so
+that a node number splits into a chunk and a place within it */
+#define NODE_CHUNK_BITS 6
+#define NODE_CHUNK_SIZE ((Node_index)1 << NODE_CHUNK_BITS)
+#define NODE_CHUNK_MASK (NODE_CHUNK_SIZE - 1)
+
+/* The directory or file with the specified number in a file system, or
+NULL for number 0. Both arguments are evaluated more than once. */
+#define DIR_AT(filesystem, index) \
+    ((index) == 0 ? (Dir_node *)NULL \
+     : (Dir_node *)(filesystem)->dirs.chunks[(index) >> NODE_CHUNK_BITS] \
+           + ((index) & NODE_CHUNK_MASK))
+#define FILE_AT(filesystem, index) \
+    ((index) == 0 ? (File_node *)NULL \
+     : (File_node *)(filesystem)->files.chunks[(index) >> NODE_CHUNK_BITS] \
+           + ((index) & NODE_CHUNK_MASK))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int classify_name(const char name[], size_t length);
+void print_text(FileSystem *const filesystem, const char text[]);
+void *fs_alloc(FileSystem *const filesystem, size_t size);
+void fs_free(FileSystem *const filesystem, void *ptr, size_t size);
+
+/* Used by fs_load() to build a tree without searching the lists it
+appends to */
+File_node *make_file(FileSystem *const filesystem, Dir_node *dir,
+                     const char name[], size_t length, File_data *data,
+                     const char target[], size_t target_length);
+Dir_node *make_dir(FileSystem *const filesystem, Dir_node *parent,
+                   const char name[], size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
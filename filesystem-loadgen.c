@@ -0,0 +1,131 @@
+/*
+ * File: filesystem-loadgen.c
+ *
+ * This file contains the source code of filesystem-loadgen, which measures
+ * how many requests per second filesystem-server answers.
+ *
+ * Usage: filesystem-loadgen <socket path> [requests] [depth] [tenant]
+ *
+ * It touches files in a directory of its own, sending depth requests at a
+ * time before reading their replies (1 sends one request per round trip).
+ * The names cycle through a fixed set, so the first requests create files
+ * and the rest update their timestamps, and every request costs the same
+ * however many are sent.
+ * The defaults are 100000 requests, a depth of 64, and tenant 1.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#define _POSIX_C_SOURCE 200809L
+
+#include "filesystem-client.h"
+#include "filesystem-protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The number of file names touched in turn */
+#define NAME_COUNT 1024
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Sends the requests, and prints how fast they were answered.
+ */
+int main(int argc, char *argv[])
+{
+    struct timeval start, end;
+    Fs_client client;
+    Fs_reply reply;
+    char dir_name[32], name[32];
+    unsigned long requests = 100000, depth = 64, tenant = 1;
+    unsigned long sent = 0, received = 0, failed = 0, batch, i;
+    double seconds;
+    int length;
+
+    if (argc < 2 || argc > 5)
+    {
+        fprintf(stderr, "Usage: %s <socket path> [requests] [depth] "
+                        "[tenant]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2)
+    {
+        requests = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3)
+    {
+        depth = strtoul(argv[3], NULL, 10);
+    }
+    if (argc > 4)
+    {
+        tenant = strtoul(argv[4], NULL, 10);
+    }
+    if (depth == 0)
+    {
+        depth = 1;
+    }
+
+    if (!fs_client_connect(&client, argv[1]) || !fs_client_open(&client,
+                                                                tenant))
+    {
+        fprintf(stderr, "%s: could not connect to %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    /* Each run works in a new directory, so that files are really made */
+    sprintf(dir_name, "load%ld", (long)getpid());
+    if (!fs_client_call(&client, FS_OP_MKDIR, dir_name, NULL, &reply)
+        || !fs_client_call(&client, FS_OP_CD, dir_name, NULL, &reply)
+        || reply.result != 1)
+    {
+        fprintf(stderr, "%s: could not create %s\n", argv[0], dir_name);
+        fs_client_close(&client);
+        return 1;
+    }
+
+    gettimeofday(&start, NULL);
+
+    while (received < requests)
+    {
+        batch = requests - sent < depth ? requests - sent : depth;
+
+        for (i = 0; i < batch; i++)
+        {
+            length = sprintf(name, "f%lu", sent++ % NAME_COUNT);
+            fs_client_send(&client, FS_OP_TOUCH, name, (size_t)length,
+                           NULL, 0);
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            if (!fs_client_receive(&client, &reply))
+            {
+                fprintf(stderr, "%s: connection lost\n", argv[0]);
+                fs_client_close(&client);
+                return 1;
+            }
+            if (reply.result != 1)
+            {
+                failed++;
+            }
+            received++;
+        }
+    }
+
+    gettimeofday(&end, NULL);
+
+    seconds = (double)(end.tv_sec - start.tv_sec)
+              + (double)(end.tv_usec - start.tv_usec) / 1e6;
+    printf("%lu requests (%lu failed) in %.3f s: %.0f requests/s\n",
+           received, failed, seconds,
+           seconds > 0 ? (double)received / seconds : 0.0);
+
+    fs_client_close(&client);
+
+    return 0;
+}
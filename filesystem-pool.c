@@ -0,0 +1,164 @@
+/*
+ * File: filesystem-pool.c
+ *
+ * This file contains the source code for the memory pools declared in
+ * filesystem-pool.h, which let many file systems share memory without each
+ * of them going through malloc() for every directory, file and name.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem-pool.h"
+#include <stdlib.h>
+
+/* -------------------- Function Prototypes -------------------- */
+static void *carve_block(Fs_pool *const pool, size_t block_size);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Initializes the Fs_pool parameter pool to be empty. Memory is only
+ * requested once the first block is allocated. Afterwards, file systems can
+ * use the pool by passing &pool->allocator to mkfs_with().
+ */
+void pool_init(Fs_pool *const pool)
+{
+    int i;
+
+    for (i = 0; i < POOL_CLASS_COUNT; i++)
+    {
+        pool->free_lists[i] = NULL;
+    }
+
+    pool->chunks = NULL;
+    pool->cursor = NULL;
+    pool->remaining = 0;
+    pool->bytes_reserved = 0;
+
+    pool->allocator.alloc = pool_alloc;
+    pool->allocator.release = pool_release;
+    pool->allocator.context = pool;
+}
+
+/*
+ * Returns every chunk of the pool to the operating system. Any file system
+ * still using the pool must have been removed with rmfs() beforehand.
+ */
+void pool_destroy(Fs_pool *const pool)
+{
+    void *chunk;
+
+    while (pool->chunks != NULL)
+    {
+        chunk = pool->chunks;
+        pool->chunks = *(void **)chunk;
+        free(chunk);
+    }
+
+    pool_init(pool);
+}
+
+/*
+ * Allocates size bytes from the pool (passed as void * so that it can be
+ * used as an Fs_allocator). Blocks of the same size that have been released
+ * are reused first, otherwise a new block is carved out of the newest chunk.
+ * Returns NULL if memory could not be allocated.
+ */
+void *pool_alloc(void *pool, size_t size)
+{
+    Fs_pool *const fs_pool = pool;
+    size_t class_index;
+    void *block;
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    class_index = (size - 1) / POOL_ALIGNMENT;
+
+    /* Large blocks are not pooled */
+    if (class_index >= POOL_CLASS_COUNT)
+    {
+        block = malloc(size);
+    }
+    /* Case: A released block of the same size can be reused */
+    else if (fs_pool->free_lists[class_index] != NULL)
+    {
+        block = fs_pool->free_lists[class_index];
+        fs_pool->free_lists[class_index] = *(void **)block;
+    }
+    /* Case: A new block has to be carved out */
+    else
+    {
+        block = carve_block(fs_pool, (class_index + 1) * POOL_ALIGNMENT);
+    }
+
+    return block;
+}
+
+/*
+ * Gives back a block allocated by pool_alloc(), along with the size it was
+ * allocated with. The block is kept in the free list for its size rather
+ * than being returned to the operating system.
+ */
+void pool_release(void *pool, void *ptr, size_t size)
+{
+    Fs_pool *const fs_pool = pool;
+    size_t class_index;
+
+    if (ptr != NULL)
+    {
+        if (size == 0)
+        {
+            size = 1;
+        }
+
+        class_index = (size - 1) / POOL_ALIGNMENT;
+
+        if (class_index >= POOL_CLASS_COUNT)
+        {
+            free(ptr);
+        }
+        else
+        {
+            *(void **)ptr = fs_pool->free_lists[class_index];
+            fs_pool->free_lists[class_index] = ptr;
+        }
+    }
+}
+
+/*
+ * A helper function to carve a new block of block_size bytes out of the
+ * newest chunk, allocating another chunk when it runs out. Whatever is left
+ * at the end of the old chunk is too small to be used, and stays unused.
+ */
+static void *carve_block(Fs_pool *const pool, size_t block_size)
+{
+    char *chunk;
+    void *block = NULL;
+
+    if (pool->remaining < block_size)
+    {
+        chunk = malloc(POOL_CHUNK_SIZE);
+        if (chunk != NULL)
+        {
+            /* The first block of every chunk links it to the older ones */
+            *(void **)chunk = pool->chunks;
+            pool->chunks = chunk;
+            pool->cursor = chunk + POOL_ALIGNMENT;
+            pool->remaining = POOL_CHUNK_SIZE - POOL_ALIGNMENT;
+            pool->bytes_reserved += POOL_CHUNK_SIZE;
+        }
+    }
+
+    if (pool->remaining >= block_size)
+    {
+        block = pool->cursor;
+        pool->cursor += block_size;
+        pool->remaining -= block_size;
+    }
+
+    return block;
+}
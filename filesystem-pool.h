@@ -0,0 +1,70 @@
+/*
+ * File: filesystem-pool.h
+ *
+ * This file contains the structure declarations and function prototypes for
+ * memory pools, which hand out the small blocks of memory used by file
+ * systems (directories, files and names) from large chunks.
+ *
+ * Freed blocks are kept in a free list for their size and reused by the next
+ * allocation of the same size, instead of being returned to the operating
+ * system. A single pool can be shared by many file systems through the
+ * Fs_allocator it provides, while each file system still keeps count of its
+ * own memory usage.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_POOL_H
+#define FILESYSTEM_POOL_H
+
+#include "filesystem-datastructure.h"
+
+/* Blocks are rounded up to a multiple of this size, which also keeps them
+aligned for any of the file system structures */
+#define POOL_ALIGNMENT 16
+
+/* The number of block sizes with their own free list. Larger blocks are
+passed straight to malloc() and free(). */
+#define POOL_CLASS_COUNT 16
+
+/* The size of the chunks requested from malloc() */
+#define POOL_CHUNK_SIZE 65536
+
+/*
+ * These structures are used to create instances of a memory pool
+ */
+typedef struct fs_pool
+{
+
+    /* The free blocks of each size, linked through their first bytes */
+    void *free_lists[POOL_CLASS_COUNT];
+
+    /* The chunks allocated so far, linked through their first bytes */
+    void *chunks;
+
+    /* The unused part at the end of the newest chunk */
+    char *cursor;
+    size_t remaining;
+
+    /* The number of bytes requested from malloc() for chunks */
+    size_t bytes_reserved;
+
+    /* The allocator handing out blocks from this pool */
+    Fs_allocator allocator;
+
+} Fs_pool;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pool_init(Fs_pool *const pool);
+void pool_destroy(Fs_pool *const pool);
+void *pool_alloc(void *pool, size_t size);
+void pool_release(void *pool, void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * File: filesystem-protocol.h
+ *
+ * This file contains the constants describing the binary protocol spoken
+ * between filesystem-server and the client library in filesystem-client.h,
+ * over a Unix domain socket.
+ *
+ * Every request and reply is a frame starting with its length (not counting
+ * the length itself). All numbers are unsigned and most significant byte
+ * first. Clients may send any number of requests before reading replies,
+ * which come back in the same order.
+ *
+ * Request:  length (4) | id (4) | op (1) | arg_length (2) | arg2_length (2)
+ *           | arg | arg2
+ * Reply:    length (4) | id (4) | result (4) | output
+ *
+ * The result is what the operation returned (1 or 0), or FS_RESULT_ERROR
+ * for malformed requests and requests sent before FS_OP_OPEN. The output
+ * holds whatever ls() or pwd() printed.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_PROTOCOL_H
+#define FILESYSTEM_PROTOCOL_H
+
+/* The operations of a request. Those taking names use arg as the name,
+except for FS_OP_LN and FS_OP_LN_S, which use arg as the target and arg2
+as the name. FS_OP_OPEN takes a 4 byte tenant id as arg, and starts using
+that tenant's file system (creating it if needed) from its root. */
+#define FS_OP_OPEN 1
+#define FS_OP_TOUCH 2
+#define FS_OP_MKDIR 3
+#define FS_OP_CD 4
+#define FS_OP_LS 5
+#define FS_OP_PWD 6
+#define FS_OP_RM 7
+#define FS_OP_LN 8
+#define FS_OP_LN_S 9
+
+/* The sizes of the fixed parts of requests and replies, including length */
+#define FS_REQUEST_HEADER_SIZE 13
+#define FS_REPLY_HEADER_SIZE 12
+
+/* The result of a request that could not be carried out at all */
+#define FS_RESULT_ERROR 0xFFFFFFFFUL
+
+/* Requests longer than this close the connection */
+#define FS_MAX_REQUEST_SIZE (FS_REQUEST_HEADER_SIZE + 2 * 65535)
+
+#endif
@@ -0,0 +1,392 @@
+/*
+ * File: filesystem-registry.c
+ *
+ * This file contains the source code for the registries of file systems
+ * declared in filesystem-registry.h.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem-registry.h"
+#include "filesystem-image.h"
+#include "filesystem-index.h"
+#include <stdlib.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The number of buckets of a new registry's hash table. The table doubles
+in size whenever there are more tenants than buckets. */
+#define INITIAL_BUCKET_COUNT 64
+
+/* -------------------- Function Prototypes -------------------- */
+static Fs_tenant *search_tenant(Fs_registry *const registry,
+                                unsigned long id);
+static int restore_tenant(Fs_registry *const registry,
+                          Fs_tenant *const tenant);
+static void grow_buckets(Fs_registry *const registry);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Initializes the Fs_registry parameter registry to have no tenants.
+ */
+void registry_init(Fs_registry *const registry)
+{
+    pool_init(&registry->pool);
+
+    registry->buckets = NULL;
+    registry->bucket_count = 0;
+    registry->tenant_count = 0;
+    registry->clock = 0;
+}
+
+/*
+ * Removes every tenant of the registry, and returns all of the memory
+ * used by them to the operating system.
+ */
+void registry_destroy(Fs_registry *const registry)
+{
+    Fs_tenant *cur, *tenant_to_be_removed;
+    unsigned long i;
+
+    for (i = 0; i < registry->bucket_count; i++)
+    {
+        cur = registry->buckets[i];
+        while (cur != NULL)
+        {
+            tenant_to_be_removed = cur;
+            cur = cur->next_tenant;
+
+            if (tenant_to_be_removed->resident)
+            {
+                rmfs(&tenant_to_be_removed->filesystem);
+            }
+            free(tenant_to_be_removed->image);
+            pool_release(&registry->pool, tenant_to_be_removed,
+                         sizeof(*tenant_to_be_removed));
+        }
+    }
+
+    free(registry->buckets);
+    pool_destroy(&registry->pool);
+    registry_init(registry);
+}
+
+/*
+ * Creates a new tenant with the specified id, and returns its file system,
+ * which has been initialized with mkfs_with() to use the registry's pool.
+ * The file system stays at the same address until the tenant is removed.
+ * - If a tenant with the same id already exists, or memory could not be
+ *   allocated, then it will return NULL.
+ */
+FileSystem *registry_create(Fs_registry *const registry, unsigned long id)
+{
+    Fs_tenant *tenant;
+    unsigned long bucket;
+    FileSystem *result = NULL;
+
+    if (registry != NULL && search_tenant(registry, id) == NULL)
+    {
+        if (registry->tenant_count >= registry->bucket_count)
+        {
+            grow_buckets(registry);
+        }
+
+        /* Tenants are allocated from the pool, so that removed
+        tenants are reused by the next ones to be created */
+        tenant = pool_alloc(&registry->pool, sizeof(*tenant));
+        if (tenant != NULL && registry->bucket_count != 0)
+        {
+            tenant->id = id;
+            tenant->resident = 1;
+            tenant->image = NULL;
+            tenant->image_size = 0;
+            tenant->print = NULL;
+            tenant->print_context = NULL;
+            tenant->indexed = 0;
+            tenant->last_used = ++registry->clock;
+
+            mkfs_with(&tenant->filesystem, &registry->pool.allocator);
+
+            /* Insert the tenant at the head of its bucket */
+            bucket = id % registry->bucket_count;
+            tenant->next_tenant = registry->buckets[bucket];
+            registry->buckets[bucket] = tenant;
+            registry->tenant_count += 1;
+
+            result = &tenant->filesystem;
+        }
+        else
+        {
+            pool_release(&registry->pool, tenant, sizeof(*tenant));
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Returns the file system of the tenant with the specified id. Evicted
+ * tenants are loaded back from their image first, with the same current
+ * directory, output and name index. Handles looked up before the eviction
+ * are stale afterwards.
+ * - If there is no tenant with the specified id, or an evicted tenant could
+ *   not be loaded, then it will return NULL.
+ */
+FileSystem *registry_get(Fs_registry *const registry, unsigned long id)
+{
+    Fs_tenant *tenant;
+    FileSystem *result = NULL;
+
+    if (registry != NULL)
+    {
+        tenant = search_tenant(registry, id);
+        if (tenant != NULL && (tenant->resident
+                               || restore_tenant(registry, tenant)))
+        {
+            tenant->last_used = ++registry->clock;
+            result = &tenant->filesystem;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Removes the tenant with the specified id, along with everything in its
+ * file system. Its memory is kept in the registry's pool for new tenants.
+ * - If there is no tenant with the specified id, then it will return 0.
+ */
+int registry_remove(Fs_registry *const registry, unsigned long id)
+{
+    Fs_tenant *cur, *prev = NULL;
+    unsigned long bucket;
+    int result = 0;
+
+    if (registry != NULL && registry->bucket_count != 0)
+    {
+        /* Traverses the bucket to look for the desired tenant */
+        bucket = id % registry->bucket_count;
+        cur = registry->buckets[bucket];
+
+        while (cur != NULL && cur->id != id)
+        {
+            prev = cur;
+            cur = cur->next_tenant;
+        }
+
+        if (cur != NULL)
+        {
+            result = 1;
+
+            /* Case: The tenant to be removed is the head of the bucket */
+            if (prev == NULL)
+            {
+                registry->buckets[bucket] = cur->next_tenant;
+            }
+            /* Case: The tenant to be removed is between the bucket */
+            else
+            {
+                prev->next_tenant = cur->next_tenant;
+            }
+
+            if (cur->resident)
+            {
+                rmfs(&cur->filesystem);
+            }
+            free(cur->image);
+
+            pool_release(&registry->pool, cur, sizeof(*cur));
+            registry->tenant_count -= 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Evicts the tenant with the specified id, saving its file system into an
+ * image and freeing all of its nodes. The tenant is loaded back by the next
+ * call to registry_get(), and its file system must not be used until then.
+ * - Tenants with watches are never evicted, since freeing the file system
+ *   would free the watches still held by their callers.
+ * - If there is no resident tenant with the specified id, if it has
+ *   watches, or if memory for the image could not be allocated, then it
+ *   will return 0.
+ */
+int registry_evict(Fs_registry *const registry, unsigned long id)
+{
+    Fs_tenant *tenant;
+    int result = 0;
+
+    if (registry != NULL)
+    {
+        tenant = search_tenant(registry, id);
+        if (tenant != NULL && tenant->resident
+            && tenant->filesystem.watches == NULL)
+        {
+            tenant->image = fs_save(&tenant->filesystem, &tenant->image_size);
+            if (tenant->image != NULL)
+            {
+                tenant->print = tenant->filesystem.print;
+                tenant->print_context = tenant->filesystem.print_context;
+                tenant->indexed = tenant->filesystem.name_index != NULL;
+                rmfs(&tenant->filesystem);
+                tenant->resident = 0;
+                result = 1;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Evicts every resident tenant that has not been used by the last max_idle
+ * calls to registry_create() and registry_get(), apart from those with
+ * watches.
+ * Returns the number of tenants that were evicted.
+ */
+unsigned long registry_evict_idle(Fs_registry *const registry,
+                                  unsigned long max_idle)
+{
+    Fs_tenant *cur;
+    unsigned long i, result = 0;
+
+    if (registry != NULL)
+    {
+        for (i = 0; i < registry->bucket_count; i++)
+        {
+            for (cur = registry->buckets[i]; cur != NULL;
+                 cur = cur->next_tenant)
+            {
+                if (cur->resident
+                    && registry->clock - cur->last_used >= max_idle
+                    && registry_evict(registry, cur->id))
+                {
+                    result += 1;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Returns the number of bytes used by the tenant with the specified id.
+ * This is the memory allocated for its file system, or the size of its
+ * image if it has been evicted. Missing tenants use 0 bytes.
+ */
+size_t registry_usage(Fs_registry *const registry, unsigned long id)
+{
+    Fs_tenant *tenant = NULL;
+    size_t result = 0;
+
+    if (registry != NULL)
+    {
+        tenant = search_tenant(registry, id);
+    }
+
+    if (tenant != NULL)
+    {
+        result = tenant->resident ? tenant->filesystem.bytes_used
+                                  : tenant->image_size;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to search for the tenant with the specified id.
+ */
+static Fs_tenant *search_tenant(Fs_registry *const registry,
+                                unsigned long id)
+{
+    Fs_tenant *cur = NULL;
+
+    if (registry->bucket_count != 0)
+    {
+        cur = registry->buckets[id % registry->bucket_count];
+        while (cur != NULL && cur->id != id)
+        {
+            cur = cur->next_tenant;
+        }
+    }
+
+    return cur;
+}
+
+/*
+ * A helper function to load an evicted tenant back from its image, with the
+ * output and name index it had. The index is enabled first, so that the
+ * entries are indexed as they are loaded. The image is freed once the file
+ * system has been loaded.
+ */
+static int restore_tenant(Fs_registry *const registry,
+                          Fs_tenant *const tenant)
+{
+    int result;
+
+    mkfs_with(&tenant->filesystem, &registry->pool.allocator);
+    fs_set_output(&tenant->filesystem, tenant->print, tenant->print_context);
+    result = (!tenant->indexed || fs_enable_index(&tenant->filesystem))
+             && fs_load(&tenant->filesystem, tenant->image,
+                        tenant->image_size);
+
+    if (result)
+    {
+        free(tenant->image);
+        tenant->image = NULL;
+        tenant->image_size = 0;
+        tenant->resident = 1;
+    }
+    else
+    {
+        /* The image is kept so that loading can be tried again */
+        rmfs(&tenant->filesystem);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to double the number of buckets of the registry's hash
+ * table, moving every tenant to its new bucket. If memory could not be
+ * allocated, the table is left as it is.
+ */
+static void grow_buckets(Fs_registry *const registry)
+{
+    Fs_tenant **new_buckets, *cur, *next;
+    unsigned long new_count, i, bucket;
+
+    new_count = registry->bucket_count == 0 ? INITIAL_BUCKET_COUNT
+                                            : registry->bucket_count * 2;
+    new_buckets = malloc(sizeof(*new_buckets) * new_count);
+
+    if (new_buckets != NULL)
+    {
+        for (i = 0; i < new_count; i++)
+        {
+            new_buckets[i] = NULL;
+        }
+
+        for (i = 0; i < registry->bucket_count; i++)
+        {
+            cur = registry->buckets[i];
+            while (cur != NULL)
+            {
+                next = cur->next_tenant;
+                bucket = cur->id % new_count;
+                cur->next_tenant = new_buckets[bucket];
+                new_buckets[bucket] = cur;
+                cur = next;
+            }
+        }
+
+        free(registry->buckets);
+        registry->buckets = new_buckets;
+        registry->bucket_count = new_count;
+    }
+}
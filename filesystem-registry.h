@@ -0,0 +1,96 @@
+/*
+ * File: filesystem-registry.h
+ *
+ * This file contains the structure declarations and function prototypes for
+ * registries, which manage many file systems (tenants) identified by number.
+ *
+ * Every tenant of a registry takes its memory from one shared pool, so
+ * creating and removing tenants reuses memory instead of going through
+ * malloc() and free() for every node. Tenants that have not been used for a
+ * while can be evicted, which saves them into an image and frees their
+ * nodes. They are loaded back the next time they are requested. Tenants
+ * with watches stay resident, so that the watches remain valid.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_REGISTRY_H
+#define FILESYSTEM_REGISTRY_H
+
+#include "filesystem.h"
+#include "filesystem-pool.h"
+
+/*
+ * These nodes are used to create the Linked Lists of tenants within each
+ * bucket of the registry's hash table.
+ */
+typedef struct fs_tenant
+{
+
+    /* The number identifying the tenant */
+    unsigned long id;
+
+    /* The tenant's file system, which is only valid while it is resident */
+    FileSystem filesystem;
+
+    /* 1 if the file system is in memory, 0 if it has been evicted */
+    int resident;
+
+    /* The image of an evicted file system, allocated with malloc() */
+    char *image;
+    size_t image_size;
+
+    /* The output of an evicted file system, and 1 if it had a name index,
+    which are given back to it when it is loaded */
+    void (*print)(void *context, const char text[]);
+    void *print_context;
+    int indexed;
+
+    /* The value of the registry's clock when the tenant was last used */
+    unsigned long last_used;
+
+    /* A pointer to the next tenant in the bucket */
+    struct fs_tenant *next_tenant;
+
+} Fs_tenant;
+
+/*
+ * These structures are used to create instances of a registry
+ */
+typedef struct fs_registry
+{
+
+    /* The pool shared by every tenant */
+    Fs_pool pool;
+
+    /* The hash table of tenants, indexed by id modulo bucket_count */
+    Fs_tenant **buckets;
+    unsigned long bucket_count;
+
+    /* The number of tenants in the registry */
+    unsigned long tenant_count;
+
+    /* Incremented every time a tenant is used */
+    unsigned long clock;
+
+} Fs_registry;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void registry_init(Fs_registry *const registry);
+void registry_destroy(Fs_registry *const registry);
+FileSystem *registry_create(Fs_registry *const registry, unsigned long id);
+FileSystem *registry_get(Fs_registry *const registry, unsigned long id);
+int registry_remove(Fs_registry *const registry, unsigned long id);
+int registry_evict(Fs_registry *const registry, unsigned long id);
+unsigned long registry_evict_idle(Fs_registry *const registry,
+                                  unsigned long max_idle);
+size_t registry_usage(Fs_registry *const registry, unsigned long id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
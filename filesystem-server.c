@@ -0,0 +1,620 @@
+/*
+ * File: filesystem-server.c
+ *
+ * This file contains the source code of filesystem-server, a daemon that
+ * lets several processes share file systems. It hosts a registry of file
+ * systems, and serves the operations of filesystem.h to clients connected
+ * to a Unix domain socket, using the protocol in filesystem-protocol.h.
+ *
+ * Usage: filesystem-server <socket path>
+ *
+ * All connections are served by a single thread with an epoll event loop.
+ * Each connection is a session with its own tenant and current directory,
+ * so clients sharing a file system do not move each other around. Every
+ * complete request read from a connection is carried out right away, and
+ * their replies are sent back together once nothing more can be read.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#define _POSIX_C_SOURCE 200809L
+
+#include "filesystem-registry.h"
+#include "filesystem-protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* The mkdir() declared by sys/stat.h is renamed out of the way of the file
+system's own */
+#define mkdir posix_mkdir
+#include <sys/stat.h>
+#undef mkdir
+
+/* -------------------- Constants -------------------- */
+
+/* The number of events handled by each call to epoll_wait() */
+#define MAX_EVENTS 64
+
+/* The size of each read from a connection */
+#define READ_SIZE 65536
+
+/* Connections stop being read while this many reply bytes are waiting to
+be sent, and epoll stops waiting for their requests until the client has
+caught up on reading them */
+#define MAX_PENDING_OUTPUT (4 * 1024 * 1024)
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures hold the state of each connected client (a session)
+ */
+typedef struct connection
+{
+
+    /* The connected socket */
+    int fd;
+
+    /* Bytes received that do not form a complete request yet */
+    char *in;
+    size_t in_size;
+    size_t in_capacity;
+
+    /* Replies waiting to be sent, of which out_sent have been sent */
+    char *out;
+    size_t out_size;
+    size_t out_sent;
+    size_t out_capacity;
+
+    /* The file system opened with FS_OP_OPEN, or NULL before that */
+    FileSystem *filesystem;
+    unsigned long tenant;
+
+    /* The session's current directory */
+    Fs_handle cur_dir;
+
+    /* Set once the connection should be closed, e.g. after an error */
+    int closing;
+
+    /* The events epoll waits for on the socket: EPOLLIN unless too many
+    replies are waiting, and EPOLLOUT while any are */
+    unsigned int events;
+
+} Connection;
+
+/* -------------------- Function Prototypes -------------------- */
+static int open_socket(const char path[]);
+static void accept_connections(int epoll_fd, int listen_fd);
+static void read_connection(Fs_registry *const registry,
+                            Connection *const connection);
+static void handle_request(Fs_registry *const registry,
+                           Connection *const connection,
+                           const char frame[], size_t size);
+static unsigned long run_operation(Connection *const connection, int op,
+                                   const char arg[], size_t arg_length,
+                                   const char arg2[], size_t arg2_length);
+static void write_connection(int epoll_fd, Connection *const connection);
+static void close_connection(Connection *const connection);
+static void append_output(void *context, const char text[]);
+static int reserve(char **buffer, size_t *capacity, size_t size);
+static void put_number(char bytes[], unsigned long number, int size);
+static unsigned long get_number(const char bytes[], int size);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Runs the server until it is killed.
+ */
+int main(int argc, char *argv[])
+{
+    struct epoll_event event, events[MAX_EVENTS];
+    Fs_registry registry;
+    Connection *connection;
+    int epoll_fd, listen_fd, count, i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <socket path>\n", argv[0]);
+        return 1;
+    }
+
+    /* Writing to clients that have disconnected should not kill us */
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = open_socket(argv[1]);
+    epoll_fd = epoll_create1(0);
+    if (listen_fd < 0 || epoll_fd < 0)
+    {
+        perror("filesystem-server");
+        return 1;
+    }
+
+    /* The listening socket is told apart by its NULL pointer */
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+    registry_init(&registry);
+
+    for (;;)
+    {
+        count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+        for (i = 0; i < count; i++)
+        {
+            connection = events[i].data.ptr;
+
+            if (connection == NULL)
+            {
+                accept_connections(epoll_fd, listen_fd);
+            }
+            else
+            {
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    read_connection(&registry, connection);
+                }
+
+                /* Replies to everything read are sent in one batch */
+                write_connection(epoll_fd, connection);
+
+                if (connection->closing)
+                {
+                    close_connection(connection);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * A helper function to create the listening socket at path, replacing any
+ * socket left there by a previous run. Other kinds of files at path are
+ * left alone, so the socket cannot be created over them.
+ * Returns the socket, or -1 if it could not be created.
+ */
+static int open_socket(const char path[])
+{
+    struct sockaddr_un address;
+    struct stat status;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0)
+    {
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+
+        if (strlen(path) >= sizeof(address.sun_path))
+        {
+            close(fd);
+            fd = -1;
+        }
+        else
+        {
+            strcpy(address.sun_path, path);
+            if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+            {
+                unlink(path);
+            }
+
+            if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0
+                || listen(fd, SOMAXCONN) != 0
+                || fcntl(fd, F_SETFL, O_NONBLOCK) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    return fd;
+}
+
+/*
+ * A helper function to accept every pending connection, and start waiting
+ * for requests from them.
+ */
+static void accept_connections(int epoll_fd, int listen_fd)
+{
+    struct epoll_event event;
+    Connection *connection;
+    int fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0)
+    {
+        connection = malloc(sizeof(*connection));
+        if (connection == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0)
+        {
+            free(connection);
+            close(fd);
+        }
+        else
+        {
+            connection->fd = fd;
+            connection->in = NULL;
+            connection->in_size = 0;
+            connection->in_capacity = 0;
+            connection->out = NULL;
+            connection->out_size = 0;
+            connection->out_sent = 0;
+            connection->out_capacity = 0;
+            connection->filesystem = NULL;
+            connection->tenant = 0;
+            connection->cur_dir.ino = 0;
+            connection->cur_dir.gen = 0;
+            connection->closing = 0;
+            connection->events = EPOLLIN;
+
+            event.events = EPOLLIN;
+            event.data.ptr = connection;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+}
+
+/*
+ * A helper function to read everything the client has sent so far, and
+ * carry out every complete request in it. Reading stops early while too
+ * many replies are waiting to be sent.
+ */
+static void read_connection(Fs_registry *const registry,
+                            Connection *const connection)
+{
+    size_t start, length;
+    ssize_t received = 1;
+
+    while (received > 0 && !connection->closing
+           && connection->out_size - connection->out_sent
+                  < MAX_PENDING_OUTPUT)
+    {
+        if (!reserve(&connection->in, &connection->in_capacity,
+                     connection->in_size + READ_SIZE))
+        {
+            connection->closing = 1;
+        }
+        else
+        {
+            received = read(connection->fd,
+                            connection->in + connection->in_size, READ_SIZE);
+
+            if (received > 0)
+            {
+                connection->in_size += (size_t)received;
+            }
+            else if (received == 0
+                     || (errno != EAGAIN && errno != EWOULDBLOCK
+                         && errno != EINTR))
+            {
+                connection->closing = 1;
+            }
+        }
+
+        /* Carries out every complete request */
+        start = 0;
+        while (!connection->closing && connection->in_size - start >= 4)
+        {
+            length = get_number(connection->in + start, 4) + 4;
+
+            if (length < FS_REQUEST_HEADER_SIZE
+                || length > FS_MAX_REQUEST_SIZE)
+            {
+                connection->closing = 1;
+            }
+            else if (connection->in_size - start < length)
+            {
+                break;
+            }
+            else
+            {
+                handle_request(registry, connection,
+                               connection->in + start, length);
+                start += length;
+            }
+        }
+
+        /* Keeps the partial request at the front of the buffer */
+        memmove(connection->in, connection->in + start,
+                connection->in_size - start);
+        connection->in_size -= start;
+    }
+}
+
+/*
+ * A helper function to carry out the request in frame, and append its
+ * reply to the connection's output. The reply header is written first, and
+ * whatever the operation prints is appended right after it.
+ */
+static void handle_request(Fs_registry *const registry,
+                           Connection *const connection,
+                           const char frame[], size_t size)
+{
+    size_t reply_start, arg_length, arg2_length;
+    unsigned long result = FS_RESULT_ERROR;
+    int op;
+
+    op = (int)get_number(frame + 8, 1);
+    arg_length = get_number(frame + 9, 2);
+    arg2_length = get_number(frame + 11, 2);
+
+    reply_start = connection->out_size;
+    if (!reserve(&connection->out, &connection->out_capacity,
+                 reply_start + FS_REPLY_HEADER_SIZE))
+    {
+        connection->closing = 1;
+        return;
+    }
+    connection->out_size += FS_REPLY_HEADER_SIZE;
+
+    if (FS_REQUEST_HEADER_SIZE + arg_length + arg2_length == size)
+    {
+        /* Switches the session to another tenant */
+        if (op == FS_OP_OPEN && arg_length == 4)
+        {
+            connection->tenant =
+                get_number(frame + FS_REQUEST_HEADER_SIZE, 4);
+            connection->filesystem = registry_get(registry,
+                                                  connection->tenant);
+            if (connection->filesystem == NULL)
+            {
+                connection->filesystem = registry_create(registry,
+                                                         connection->tenant);
+            }
+
+            if (connection->filesystem != NULL
+                && cd(connection->filesystem, "/")
+                && fs_lookup(connection->filesystem, ".",
+                             &connection->cur_dir))
+            {
+                result = 1;
+            }
+        }
+        else if (op != FS_OP_OPEN && connection->filesystem != NULL)
+        {
+            /* The tenant may have been evicted since the last request,
+            in which case its file system is loaded again */
+            connection->filesystem = registry_get(registry,
+                                                  connection->tenant);
+            if (connection->filesystem != NULL)
+            {
+                result = run_operation(connection, op,
+                                       frame + FS_REQUEST_HEADER_SIZE,
+                                       arg_length,
+                                       frame + FS_REQUEST_HEADER_SIZE
+                                           + arg_length,
+                                       arg2_length);
+            }
+        }
+    }
+
+    put_number(connection->out + reply_start,
+               connection->out_size - reply_start - 4, 4);
+    put_number(connection->out + reply_start + 4,
+               get_number(frame + 4, 4), 4);
+    put_number(connection->out + reply_start + 8, result, 4);
+}
+
+/*
+ * A helper function to carry out the operation op within the session's
+ * current directory, which is moved to the root if it has been removed by
+ * another session.
+ * Returns what the operation returned, or FS_RESULT_ERROR for unknown ones.
+ */
+static unsigned long run_operation(Connection *const connection, int op,
+                                   const char arg[], size_t arg_length,
+                                   const char arg2[], size_t arg2_length)
+{
+    FileSystem *const filesystem = connection->filesystem;
+    unsigned long result = 1;
+
+    if (!cd_h(filesystem, connection->cur_dir))
+    {
+        cd(filesystem, "/");
+    }
+
+    fs_set_output(filesystem, append_output, connection);
+
+    switch (op)
+    {
+    case FS_OP_TOUCH:
+        result = touch_n(filesystem, arg, arg_length);
+        break;
+
+    case FS_OP_MKDIR:
+        result = mkdir_n(filesystem, arg, arg_length);
+        break;
+
+    case FS_OP_CD:
+        result = cd_n(filesystem, arg, arg_length);
+        break;
+
+    case FS_OP_LS:
+        result = ls_n(filesystem, arg_length != 0 ? arg : "", arg_length);
+        break;
+
+    case FS_OP_PWD:
+        pwd(filesystem);
+        break;
+
+    case FS_OP_RM:
+        result = rm_n(filesystem, arg, arg_length);
+        break;
+
+    case FS_OP_LN:
+        result = ln_n(filesystem, arg, arg_length, arg2, arg2_length);
+        break;
+
+    case FS_OP_LN_S:
+        result = ln_s_n(filesystem, arg, arg_length, arg2, arg2_length);
+        break;
+
+    default:
+        result = FS_RESULT_ERROR;
+        break;
+    }
+
+    fs_set_output(filesystem, NULL, NULL);
+    fs_lookup(filesystem, ".", &connection->cur_dir);
+
+    return result;
+}
+
+/*
+ * A helper function to send as much of the connection's pending replies as
+ * the socket accepts. If some are left, epoll also waits for the socket to
+ * become writable, so that the rest is sent later. While too many are
+ * left, epoll stops waiting for requests, since read_connection() would
+ * not read them, until enough have been sent.
+ */
+static void write_connection(int epoll_fd, Connection *const connection)
+{
+    struct epoll_event event;
+    ssize_t written = 1;
+    unsigned int events;
+
+    while (written > 0 && connection->out_sent < connection->out_size)
+    {
+        written = write(connection->fd,
+                        connection->out + connection->out_sent,
+                        connection->out_size - connection->out_sent);
+
+        if (written > 0)
+        {
+            connection->out_sent += (size_t)written;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            connection->closing = 1;
+        }
+    }
+
+    if (connection->out_sent == connection->out_size)
+    {
+        connection->out_sent = 0;
+        connection->out_size = 0;
+    }
+
+    /* Only waits for the socket to become writable while needed, and for
+    requests while they would be read */
+    events = connection->out_size - connection->out_sent < MAX_PENDING_OUTPUT
+                 ? EPOLLIN
+                 : 0;
+    if (connection->out_size != 0)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != connection->events && !connection->closing)
+    {
+        event.events = events;
+        event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+/*
+ * A helper function to close the connection and free its buffers. Closing
+ * the socket also removes it from epoll.
+ */
+static void close_connection(Connection *const connection)
+{
+    close(connection->fd);
+    free(connection->in);
+    free(connection->out);
+    free(connection);
+}
+
+/*
+ * A helper function receiving the text printed by file system operations,
+ * which is appended to the reply being built for the connection (passed as
+ * context).
+ */
+static void append_output(void *context, const char text[])
+{
+    Connection *const connection = context;
+    size_t length = strlen(text);
+
+    if (reserve(&connection->out, &connection->out_capacity,
+                connection->out_size + length))
+    {
+        memcpy(connection->out + connection->out_size, text, length);
+        connection->out_size += length;
+    }
+    else
+    {
+        connection->closing = 1;
+    }
+}
+
+/*
+ * A helper function to make sure that buffer has room for size bytes,
+ * doubling its capacity as needed.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int reserve(char **buffer, size_t *capacity, size_t size)
+{
+    char *new_buffer;
+    size_t new_capacity;
+    int result = 1;
+
+    if (size > *capacity)
+    {
+        new_capacity = *capacity == 0 ? 4096 : *capacity * 2;
+        while (new_capacity < size)
+        {
+            new_capacity *= 2;
+        }
+
+        new_buffer = realloc(*buffer, new_capacity);
+        if (new_buffer != NULL)
+        {
+            *buffer = new_buffer;
+            *capacity = new_capacity;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to store the lowest size bytes of number in bytes,
+ * most significant first.
+ */
+static void put_number(char bytes[], unsigned long number, int size)
+{
+    int i;
+
+    for (i = size - 1; i >= 0; i--)
+    {
+        bytes[i] = (char)(number & 0xFF);
+        number >>= 8;
+    }
+}
+
+/*
+ * A helper function to read a number of size bytes stored by put_number().
+ */
+static unsigned long get_number(const char bytes[], int size)
+{
+    unsigned long number = 0;
+    int i;
+
+    for (i = 0; i < size; i++)
+    {
+        number = (number << 8) | (unsigned char)bytes[i];
+    }
+
+    return number;
+}
@@ -0,0 +1,835 @@
+/*
+ * File: filesystem-test.c
+ *
+ * This file contains regression tests for the file system, run as a
+ * program that prints every failed check and exits with a non-zero status
+ * if there were any:
+ *
+ *     gcc -o filesystem-test filesystem-test.c filesystem.c
+ *         filesystem-disk.c filesystem-image.c filesystem-index.c
+ *         filesystem-watch.c filesystem-registry.c filesystem-pool.c
+ *     ./filesystem-test
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem.h"
+#include "filesystem-disk.h"
+#include "filesystem-image.h"
+#include "filesystem-index.h"
+#include "filesystem-registry.h"
+#include "filesystem-watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The largest output of a single call captured by the tests */
+#define OUTPUT_SIZE 4096
+
+/* The image file made by the tests of mkfs_disk(), removed afterwards */
+#define TEST_IMAGE "filesystem-test.img"
+
+/* Reports a failed check, along with where it is */
+#define CHECK(condition) \
+    check((condition), #condition, __FILE__, __LINE__)
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures capture what ls() and pwd() print
+ */
+typedef struct output
+{
+
+    /* The text printed so far, always null terminated */
+    char text[OUTPUT_SIZE];
+    size_t length;
+
+} Output;
+
+/*
+ * These structures record the events drained from a watch
+ */
+typedef struct events
+{
+
+    /* The kinds of the events, and their names joined by spaces */
+    int kinds[64];
+    size_t count;
+    Output names;
+
+} Events;
+
+/* -------------------- Function Prototypes -------------------- */
+static void check(int condition, const char text[], const char file[],
+                  int line);
+static void capture(void *context, const char text[]);
+static void count_lines(void *context, const char text[]);
+static void record_event(void *context, const Fs_event *event);
+static const char *ls_output(FileSystem *const filesystem,
+                             Output *const output, const char name[]);
+static void test_txn_replace_watched(void);
+static void test_txn_matches_plain_calls(void);
+static void test_disk_reinsert_separators(void);
+static void test_disk_rejects_tree_functions(void);
+static void test_registry_keeps_watched(void);
+static void test_registry_restores_state(void);
+static void test_symlink_records(void);
+static void test_symlink_cache_and_limit(void);
+static void test_image_round_trip(void);
+static void test_txn_index_rebuild(void);
+static void test_watch_capacity_limit(void);
+static void test_diff_hash_lanes(void);
+static void test_compact_renumbers(void);
+
+/* -------------------- Global Variables -------------------- */
+
+/* The number of checks that failed */
+static int failures = 0;
+
+/* -------------------- Function Definitions -------------------- */
+
+int main(void)
+{
+    test_txn_replace_watched();
+    test_txn_matches_plain_calls();
+    test_disk_reinsert_separators();
+    test_disk_rejects_tree_functions();
+    test_registry_keeps_watched();
+    test_registry_restores_state();
+    test_symlink_records();
+    test_symlink_cache_and_limit();
+    test_image_round_trip();
+    test_txn_index_rebuild();
+    test_watch_capacity_limit();
+    test_diff_hash_lanes();
+    test_compact_renumbers();
+
+    if (failures == 0)
+    {
+        printf("All tests passed\n");
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Removing a name and making it again within a transaction replaces the
+ * node, and watches must be told about both before the old one is freed.
+ */
+static void test_txn_replace_watched(void)
+{
+    FileSystem filesystem;
+    Fs_handle handle;
+    Fs_watch *watch;
+    Fs_txn *txn;
+    Events events;
+    Output output;
+
+    mkfs(&filesystem);
+    touch(&filesystem, "a");
+    touch(&filesystem, "b");
+    CHECK(fs_lookup(&filesystem, ".", &handle));
+    watch = fs_watch(&filesystem, handle, 0, 0);
+    CHECK(watch != NULL);
+
+    txn = fs_txn_begin(&filesystem);
+    CHECK(fs_txn_rm(txn, "a"));
+    CHECK(fs_txn_mkdir(txn, "a"));
+    CHECK(fs_txn_rm(txn, "b"));
+    CHECK(fs_txn_touch(txn, "b"));
+    CHECK(fs_txn_commit(txn));
+
+    memset(&events, 0, sizeof(events));
+    CHECK(fs_watch_drain(watch, record_event, &events) == 4);
+    CHECK(events.kinds[0] == FS_EVENT_REMOVE);
+    CHECK(events.kinds[1] == FS_EVENT_MKDIR);
+    CHECK(events.kinds[2] == FS_EVENT_REMOVE);
+    CHECK(events.kinds[3] == FS_EVENT_CREATE);
+    CHECK(strcmp(events.names.text, "a a b b ") == 0);
+    CHECK(strcmp(ls_output(&filesystem, &output, "."), "a/\nb\n") == 0);
+
+    rmfs(&filesystem);
+}
+
+/*
+ * Random sequences of calls staged in a transaction must return what the
+ * plain calls return, and leave the same tree once committed, reporting
+ * no more events than the plain calls did.
+ */
+static void test_txn_matches_plain_calls(void)
+{
+    static const char *const names[] = {"a", "b", "c", "d", "..", "/"};
+    FileSystem plain, staged;
+    Fs_handle handle;
+    Fs_watch *plain_watch, *staged_watch;
+    Fs_txn *txn;
+    Events plain_events, staged_events;
+    const char *name;
+    unsigned seed;
+    int i, op, plain_result, staged_result;
+
+    for (seed = 1; seed <= 500; seed++)
+    {
+        mkfs(&plain);
+        mkfs(&staged);
+        srand(seed);
+        for (i = 0; i < 40; i++)
+        {
+            name = names[rand() % 6];
+            op = rand() % 4;
+            if (op == 0)
+            {
+                touch(&plain, name);
+                touch(&staged, name);
+            }
+            else if (op == 1)
+            {
+                mkdir(&plain, name);
+                mkdir(&staged, name);
+            }
+            else
+            {
+                cd(&plain, name);
+                cd(&staged, name);
+            }
+        }
+        cd(&plain, "/");
+        cd(&staged, "/");
+
+        fs_lookup(&plain, "/", &handle);
+        plain_watch = fs_watch(&plain, handle, 1, 1 << 16);
+        fs_lookup(&staged, "/", &handle);
+        staged_watch = fs_watch(&staged, handle, 1, 1 << 16);
+
+        txn = fs_txn_begin(&staged);
+        for (i = 0; i < 60; i++)
+        {
+            name = names[rand() % 6];
+            op = rand() % 4;
+            if (op == 0)
+            {
+                plain_result = touch(&plain, name);
+                staged_result = fs_txn_touch(txn, name);
+            }
+            else if (op == 1)
+            {
+                plain_result = mkdir(&plain, name);
+                staged_result = fs_txn_mkdir(txn, name);
+            }
+            else if (op == 2)
+            {
+                plain_result = rm(&plain, name);
+                staged_result = fs_txn_rm(txn, name);
+            }
+            else
+            {
+                plain_result = cd(&plain, name);
+                staged_result = fs_txn_cd(txn, name);
+            }
+            CHECK(plain_result == staged_result);
+        }
+        CHECK(fs_txn_commit(txn));
+        CHECK(fs_diff(&plain, &staged) == 0);
+
+        /* A transaction only reports names whose final state changed */
+        memset(&plain_events, 0, sizeof(plain_events));
+        memset(&staged_events, 0, sizeof(staged_events));
+        fs_watch_drain(plain_watch, record_event, &plain_events);
+        fs_watch_drain(staged_watch, record_event, &staged_events);
+        CHECK(staged_events.count <= plain_events.count);
+
+        rmfs(&plain);
+        rmfs(&staged);
+    }
+}
+
+/*
+ * Removing names from a file system made with mkfs_disk() leaves them
+ * behind as separators in the internal pages of the B+ tree. Touching them
+ * again must put them where lookups will find them.
+ */
+static void test_disk_reinsert_separators(void)
+{
+    FileSystem filesystem;
+    unsigned long lines = 0;
+    char name[16];
+    int i, found = 0;
+
+    remove(TEST_IMAGE);
+    CHECK(mkfs_disk(&filesystem, TEST_IMAGE, 16));
+
+    /* Enough names to split the root page several times */
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(name, "n%04d", i);
+        touch(&filesystem, name);
+    }
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(name, "n%04d", i);
+        CHECK(rm(&filesystem, name));
+    }
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(name, "n%04d", i);
+        CHECK(touch(&filesystem, name));
+    }
+
+    fs_set_output(&filesystem, count_lines, &lines);
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(name, "n%04d", i);
+        found += ls(&filesystem, name);
+    }
+    CHECK(found == 2000);
+
+    lines = 0;
+    ls(&filesystem, ".");
+    CHECK(lines == 2000);
+
+    rmfs(&filesystem);
+    remove(TEST_IMAGE);
+}
+
+/*
+ * The functions that walk the in-memory tree cannot see the names of a
+ * file system made with mkfs_disk(), so they must fail rather than report
+ * an empty tree.
+ */
+static void test_disk_rejects_tree_functions(void)
+{
+    FileSystem disk, memory;
+    size_t size = 0;
+    char *image;
+
+    remove(TEST_IMAGE);
+    CHECK(mkfs_disk(&disk, TEST_IMAGE, 16));
+    CHECK(touch(&disk, "abc"));
+    mkfs(&memory);
+    CHECK(touch(&memory, "abc"));
+
+    CHECK(fs_enable_index(&disk) == 0);
+    CHECK(fs_find_substring(&disk, "b") == -1);
+    CHECK(fs_save(&disk, &size) == NULL);
+    CHECK(fs_diff(&disk, &memory) == -1);
+    CHECK(fs_diff(&memory, &disk) == -1);
+
+    image = fs_save(&memory, &size);
+    CHECK(image != NULL);
+    CHECK(fs_load(&disk, image, size) == 0);
+    free(image);
+
+    rmfs(&memory);
+    rmfs(&disk);
+    remove(TEST_IMAGE);
+}
+
+/*
+ * Evicting a tenant frees its file system, along with any watches on it,
+ * so tenants with watches must stay resident until they are unwatched.
+ */
+static void test_registry_keeps_watched(void)
+{
+    Fs_registry registry;
+    FileSystem *filesystem;
+    Fs_handle handle;
+    Fs_watch *watch;
+    Events events;
+
+    registry_init(&registry);
+    filesystem = registry_create(&registry, 1);
+    CHECK(filesystem != NULL);
+    CHECK(registry_create(&registry, 2) != NULL);
+    CHECK(fs_lookup(filesystem, ".", &handle));
+    watch = fs_watch(filesystem, handle, 0, 0);
+    CHECK(watch != NULL);
+
+    CHECK(registry_evict(&registry, 1) == 0);
+    CHECK(registry_evict_idle(&registry, 0) == 1);
+    CHECK(registry_get(&registry, 1) == filesystem);
+
+    /* The watch is still valid, and sees changes to the tenant */
+    CHECK(touch(filesystem, "a"));
+    memset(&events, 0, sizeof(events));
+    CHECK(fs_watch_drain(watch, record_event, &events) == 1);
+    CHECK(events.kinds[0] == FS_EVENT_CREATE);
+
+    fs_unwatch(filesystem, watch);
+    CHECK(registry_evict(&registry, 1) == 1);
+
+    registry_destroy(&registry);
+}
+
+/*
+ * An evicted tenant must come back printing where it printed before and
+ * with its name index, and its usage must count the memory of its inode
+ * table, name index and watches.
+ */
+static void test_registry_restores_state(void)
+{
+    Fs_registry registry;
+    FileSystem *filesystem;
+    Fs_handle handle;
+    Fs_watch *watch;
+    Output output;
+    size_t before;
+
+    registry_init(&registry);
+    filesystem = registry_create(&registry, 1);
+    CHECK(filesystem != NULL);
+    CHECK(touch(filesystem, "abcd"));
+
+    before = registry_usage(&registry, 1);
+    CHECK(fs_enable_index(filesystem));
+    CHECK(registry_usage(&registry, 1) > before);
+    before = registry_usage(&registry, 1);
+    CHECK(fs_lookup(filesystem, "abcd", &handle));
+    CHECK(registry_usage(&registry, 1) > before);
+    before = registry_usage(&registry, 1);
+    CHECK(fs_lookup(filesystem, ".", &handle));
+    watch = fs_watch(filesystem, handle, 0, 1024);
+    CHECK(watch != NULL);
+    CHECK(registry_usage(&registry, 1) >= before + 1024);
+    fs_unwatch(filesystem, watch);
+    CHECK(registry_usage(&registry, 1) == before);
+
+    output.text[0] = '\0';
+    output.length = 0;
+    fs_set_output(filesystem, capture, &output);
+    CHECK(registry_evict(&registry, 1));
+    CHECK(registry_get(&registry, 1) == filesystem);
+    CHECK(filesystem->name_index != NULL);
+    CHECK(fs_find_substring(filesystem, "bcd") == 1);
+    CHECK(strcmp(output.text, "/abcd\n") == 0);
+
+    registry_destroy(&registry);
+}
+
+/*
+ * Symbolic links keep their target and cached resolution in a record of
+ * their own, which must follow the link through compaction, images and
+ * removal.
+ */
+static void test_symlink_records(void)
+{
+    FileSystem filesystem, loaded;
+    Output output;
+    char before[OUTPUT_SIZE];
+    size_t size = 0;
+    char *image;
+
+    mkfs(&filesystem);
+    CHECK(mkdir(&filesystem, "d"));
+    CHECK(cd(&filesystem, "d"));
+    CHECK(touch(&filesystem, "f"));
+    CHECK(cd(&filesystem, ".."));
+    CHECK(ln_s(&filesystem, "d/f", "l"));
+    CHECK(ln_s(&filesystem, "missing", "x"));
+
+    CHECK(touch(&filesystem, "l"));
+    strcpy(before, ls_output(&filesystem, &output, "l"));
+    CHECK(strcmp(before, "") != 0);
+
+    /* The cached resolution is dropped, and made again after compaction */
+    CHECK(fs_compact(&filesystem));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l"), before) == 0);
+    CHECK(touch(&filesystem, "l"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l"), before) != 0);
+    CHECK(strcmp(ls_output(&filesystem, &output, "x"), "") == 0);
+
+    image = fs_save(&filesystem, &size);
+    CHECK(image != NULL);
+    mkfs(&loaded);
+    CHECK(fs_load(&loaded, image, size));
+    CHECK(fs_diff(&filesystem, &loaded) == 0);
+    free(image);
+    rmfs(&loaded);
+
+    CHECK(rm(&filesystem, "l"));
+    CHECK(rm(&filesystem, "x"));
+    rmfs(&filesystem);
+}
+
+/*
+ * A cached resolution must be dropped when a directory that a nested link
+ * looked a name up in changes, and the links followed one after another by
+ * a path must count towards the limit as much as nested ones.
+ */
+static void test_symlink_cache_and_limit(void)
+{
+    FileSystem filesystem;
+    Output output;
+    char path[128];
+    int i;
+
+    mkfs(&filesystem);
+    CHECK(mkdir(&filesystem, "a"));
+    CHECK(mkdir(&filesystem, "x"));
+    CHECK(mkdir(&filesystem, "y"));
+    CHECK(cd(&filesystem, "y"));
+    CHECK(touch(&filesystem, "f"));
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "x"));
+    CHECK(ln_s(&filesystem, "../y/f", "l2"));
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "a"));
+    CHECK(ln_s(&filesystem, "../x/l2", "l1"));
+    CHECK(touch(&filesystem, "l1"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l1"), "l1 2\n") == 0);
+
+    /* Changes elsewhere keep the resolution, and changes along the
+    nested link's path replace it */
+    CHECK(mkdir(&filesystem, "z"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l1"), "l1 2\n") == 0);
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "y"));
+    CHECK(rm(&filesystem, "f"));
+    CHECK(touch(&filesystem, "f"));
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "a"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l1"), "l1 1\n") == 0);
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "y"));
+    CHECK(rm(&filesystem, "f"));
+    CHECK(mkdir(&filesystem, "f"));
+    CHECK(cd(&filesystem, ".."));
+    CHECK(cd(&filesystem, "a"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "l1"), "") == 0);
+
+    /* A path through 40 links resolves, and one through 41 does not */
+    CHECK(cd(&filesystem, "/"));
+    CHECK(ln_s(&filesystem, ".", "s"));
+    CHECK(touch(&filesystem, "g"));
+    path[0] = '\0';
+    for (i = 0; i < 40; i++)
+    {
+        strcat(path, "s/");
+    }
+    strcat(path, "g");
+    CHECK(ln(&filesystem, path, "h1"));
+    CHECK(ln(&filesystem, path + 2, "h2"));
+    memmove(path + 2, path, strlen(path) + 1);
+    CHECK(ln(&filesystem, path, "h3") == 0);
+
+    rmfs(&filesystem);
+}
+
+/*
+ * Loading an image appends its sorted records to the ends of the lists, so
+ * it must rebuild the same tree, including many hard links and the current
+ * directory, and refuse records that are out of order.
+ */
+static void test_image_round_trip(void)
+{
+    static const char unsorted[] = "FSI2\0\0\0\0\0\0\0\0"
+                                   "Fb\0\0\0\0\0\0\0\0\1"
+                                   "Fa\0\0\0\0\0\0\0\0\1";
+    FileSystem filesystem, loaded;
+    Output output;
+    char name[16];
+    size_t size = 0;
+    char *image;
+    int i;
+
+    mkfs(&filesystem);
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(name, "f%05d", i);
+        touch(&filesystem, name);
+    }
+    CHECK(mkdir(&filesystem, "a"));
+    CHECK(cd(&filesystem, "a"));
+    for (i = 0; i < 500; i++)
+    {
+        sprintf(name, "../f%05d", i);
+        CHECK(ln(&filesystem, name, name + 3));
+    }
+    CHECK(cd(&filesystem, ".."));
+    CHECK(mkdir(&filesystem, "b"));
+    CHECK(cd(&filesystem, "b"));
+    CHECK(touch(&filesystem, "x"));
+    CHECK(ln(&filesystem, "x", "y"));
+    CHECK(ln(&filesystem, "/f00001", "z"));
+    CHECK(mkdir(&filesystem, "c"));
+    CHECK(cd(&filesystem, "c"));
+
+    image = fs_save(&filesystem, &size);
+    CHECK(image != NULL);
+    mkfs(&loaded);
+    CHECK(fs_load(&loaded, image, size));
+    CHECK(fs_diff(&filesystem, &loaded) == 0);
+    free(image);
+
+    /* The current directory and the hard links come back too */
+    fs_set_output(&loaded, capture, &output);
+    output.text[0] = '\0';
+    output.length = 0;
+    pwd(&loaded);
+    fs_set_output(&loaded, NULL, NULL);
+    CHECK(strcmp(output.text, "/b/c\n") == 0);
+    CHECK(cd(&loaded, ".."));
+    CHECK(touch(&loaded, "y"));
+    CHECK(strcmp(ls_output(&loaded, &output, "x"), "x 2\n") == 0);
+    CHECK(touch(&loaded, "z"));
+    CHECK(cd(&loaded, "/"));
+    CHECK(strcmp(ls_output(&loaded, &output, "f00001"), "f00001 2\n") == 0);
+    rmfs(&loaded);
+
+    mkfs(&loaded);
+    CHECK(fs_load(&loaded, unsorted, sizeof(unsorted) - 1) == 0);
+    rmfs(&loaded);
+
+    rmfs(&filesystem);
+}
+
+/*
+ * A commit publishing many entries into an index full of removed ones must
+ * give each of them a single name id, even if the index is rebuilt.
+ */
+static void test_txn_index_rebuild(void)
+{
+    FileSystem filesystem;
+    unsigned long lines = 0;
+    Fs_txn *txn;
+    char name[16];
+    int i;
+
+    mkfs(&filesystem);
+    CHECK(fs_enable_index(&filesystem));
+    for (i = 0; i < 1100; i++)
+    {
+        sprintf(name, "f%04d", i);
+        CHECK(touch(&filesystem, name));
+    }
+    for (i = 0; i < 1100; i++)
+    {
+        sprintf(name, "f%04d", i);
+        CHECK(rm(&filesystem, name));
+    }
+
+    txn = fs_txn_begin(&filesystem);
+    for (i = 0; i < 10; i++)
+    {
+        sprintf(name, "abc%02d", i);
+        CHECK(fs_txn_touch(txn, name));
+    }
+    CHECK(fs_txn_commit(txn));
+    CHECK(rm(&filesystem, "abc05"));
+
+    fs_set_output(&filesystem, count_lines, &lines);
+    CHECK(fs_find_substring(&filesystem, "abc") == 9);
+    CHECK(lines == 9);
+
+    rmfs(&filesystem);
+}
+
+/*
+ * Rings are a power of 2 in size, so capacities past the largest power of 2
+ * a size_t holds must be refused instead of doubling forever.
+ */
+static void test_watch_capacity_limit(void)
+{
+    FileSystem filesystem;
+    Fs_handle handle;
+    Fs_watch *watch;
+    size_t largest = (size_t)-1 / 2 + 1;
+
+    mkfs(&filesystem);
+    CHECK(fs_lookup(&filesystem, ".", &handle));
+    CHECK(fs_watch(&filesystem, handle, 0, (size_t)-1) == NULL);
+    CHECK(fs_watch(&filesystem, handle, 0, largest + 1) == NULL);
+    CHECK(filesystem.watches == NULL);
+
+    watch = fs_watch(&filesystem, handle, 0, 5000);
+    CHECK(watch != NULL);
+    CHECK(touch(&filesystem, "a"));
+    rmfs(&filesystem);
+}
+
+/*
+ * These two names give directories holding only one of them the same hash
+ * in the first 32 bit lane, so fs_diff() must tell them apart by the second
+ * lane.
+ */
+static void test_diff_hash_lanes(void)
+{
+    FileSystem a, b;
+    unsigned long lines = 0;
+
+    mkfs(&a);
+    mkfs(&b);
+    CHECK(touch(&a, "n112782"));
+    CHECK(touch(&b, "n349199"));
+
+    fs_set_output(&a, count_lines, &lines);
+    CHECK(fs_diff(&a, &b) == 2);
+    CHECK(lines == 2);
+
+    rmfs(&a);
+    rmfs(&b);
+}
+
+/*
+ * Compaction renumbers every node and gives back the chunks freed by
+ * removals, so the tree, its hard links, handles and the current directory
+ * must all be the same afterwards, and new entries must still be made.
+ */
+static void test_compact_renumbers(void)
+{
+    FileSystem filesystem, copy;
+    Fs_handle handle;
+    Output output;
+    unsigned long lines = 0;
+    size_t before;
+    char name[16];
+    int i;
+
+    mkfs(&filesystem);
+    mkfs(&copy);
+    CHECK(fs_enable_index(&filesystem));
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(name, "f%04d", i);
+        CHECK(touch(&filesystem, name));
+    }
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(name, "f%04d", i);
+        CHECK(rm(&filesystem, name));
+    }
+
+    CHECK(mkdir(&filesystem, "a"));
+    CHECK(mkdir(&copy, "a"));
+    CHECK(cd(&filesystem, "a"));
+    CHECK(cd(&copy, "a"));
+    CHECK(touch(&filesystem, "x"));
+    CHECK(touch(&copy, "x"));
+    CHECK(fs_lookup(&filesystem, "x", &handle));
+    CHECK(mkdir(&filesystem, "b"));
+    CHECK(mkdir(&copy, "b"));
+    CHECK(cd(&filesystem, "b"));
+    CHECK(cd(&copy, "b"));
+    CHECK(ln(&filesystem, "../x", "y"));
+    CHECK(ln(&copy, "../x", "y"));
+    CHECK(ln_s(&filesystem, "../x", "z"));
+    CHECK(ln_s(&copy, "../x", "z"));
+
+    before = filesystem.bytes_used;
+    CHECK(fs_compact(&filesystem));
+    CHECK(filesystem.bytes_used < before);
+    CHECK(fs_diff(&filesystem, &copy) == 0);
+
+    /* The current directory, the hard link and the handle still work */
+    CHECK(touch(&filesystem, "y"));
+    CHECK(touch(&copy, "y"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "y"), "y 2\n") == 0);
+    CHECK(touch_h(&filesystem, handle));
+    CHECK(touch(&copy, "y"));
+    CHECK(strcmp(ls_output(&filesystem, &output, "y"), "y 3\n") == 0);
+    CHECK(touch(&filesystem, "w"));
+    CHECK(touch(&copy, "w"));
+    CHECK(cd(&filesystem, "/"));
+    CHECK(cd(&copy, "/"));
+    CHECK(mkdir(&filesystem, "c"));
+    CHECK(mkdir(&copy, "c"));
+    CHECK(fs_diff(&filesystem, &copy) == 0);
+
+    fs_set_output(&filesystem, count_lines, &lines);
+    CHECK(fs_find_substring(&filesystem, "x") == 1);
+    CHECK(lines == 1);
+    fs_set_output(&filesystem, NULL, NULL);
+
+    rmfs(&copy);
+    rmfs(&filesystem);
+}
+
+/*
+ * A helper function to count a failed check and print it.
+ */
+static void check(int condition, const char text[], const char file[],
+                  int line)
+{
+    if (!condition)
+    {
+        printf("%s:%d: check failed: %s\n", file, line, text);
+        failures += 1;
+    }
+}
+
+/*
+ * A helper function passed to fs_set_output(), appending the text to the
+ * Output passed as context.
+ */
+static void capture(void *context, const char text[])
+{
+    Output *const output = context;
+    size_t length = strlen(text);
+
+    if (output->length + length < OUTPUT_SIZE)
+    {
+        memcpy(output->text + output->length, text, length + 1);
+        output->length += length;
+    }
+}
+
+/*
+ * A helper function passed to fs_set_output(), counting the lines printed
+ * into the unsigned long passed as context.
+ */
+static void count_lines(void *context, const char text[])
+{
+    unsigned long *const lines = context;
+
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '\n')
+        {
+            *lines += 1;
+        }
+    }
+}
+
+/*
+ * A helper function passed to fs_watch_drain(), adding the event to the
+ * Events passed as context.
+ */
+static void record_event(void *context, const Fs_event *event)
+{
+    Events *const events = context;
+    char name[256];
+    size_t length = event->length < sizeof(name) - 2 ? event->length
+                                                     : sizeof(name) - 2;
+
+    if (events->count < sizeof(events->kinds) / sizeof(events->kinds[0]))
+    {
+        events->kinds[events->count] = event->kind;
+    }
+    events->count += 1;
+
+    if (event->name != NULL)
+    {
+        memcpy(name, event->name, length);
+        name[length] = ' ';
+        name[length + 1] = '\0';
+        capture(&events->names, name);
+    }
+}
+
+/*
+ * A helper function to return what ls() prints for the name.
+ */
+static const char *ls_output(FileSystem *const filesystem,
+                             Output *const output, const char name[])
+{
+    output->text[0] = '\0';
+    output->length = 0;
+    fs_set_output(filesystem, capture, output);
+    ls(filesystem, name);
+    fs_set_output(filesystem, NULL, NULL);
+
+    return output->text;
+}
@@ -0,0 +1,430 @@
+/*
+ * File: filesystem-watch.c
+ *
+ * This file contains the source code of directory watches, as declared in
+ * filesystem-watch.h.
+ *
+ * Each watch has a ring of bytes holding one record per event: a
+ * Watch_record followed by the entry's name. The file system is the only
+ * writer of the ring and the reader is the only one consuming it, so each
+ * side keeps its own position (tail and head) and only reads the other's.
+ * Positions only ever grow, and the capacity is a power of 2 so that they
+ * map to the same place in the ring even once they wrap around. Records
+ * are never split at the end of the ring: the rest of it is skipped
+ * instead, marked by a WATCH_WRAP record when there is room for one.
+ *
+ * When an event does not fit, it is dropped, and an FS_EVENT_OVERFLOW record
+ * is written in its place unless the last record already is one. Every
+ * other record leaves room for one after it, so that the reader always
+ * learns where events started being dropped.
+ *
+ * With GCC and compatible compilers, the positions are read and written
+ * with acquire and release ordering, so that a record is complete before
+ * the reader sees it, and is not overwritten before the reader is done.
+ *
+ * Author: Samuel Kosasih
+ */
+
+/* -------------------- Include files -------------------- */
+#include "filesystem-watch.h"
+#include "filesystem-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------- Constants -------------------- */
+
+/* The smallest ring of a watch, in bytes */
+#define MIN_RING_CAPACITY 4096
+
+/* The largest ring of a watch, which is the largest power of 2 a size_t
+can hold, so that doubling the capacity up to it never wraps around */
+#define MAX_RING_CAPACITY ((size_t)-1 / 2 + 1)
+
+/* The kind of record marking that the rest of the ring is skipped */
+#define WATCH_WRAP 0
+
+/* The room left after each event for an FS_EVENT_OVERFLOW record, which
+may have to skip the end of the ring first */
+#define OVERFLOW_ROOM (2 * sizeof(Watch_record))
+
+/* Reads and writes of the positions shared between the two sides */
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(ptr, value) \
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(ptr) (*(ptr))
+#define STORE_RELEASE(ptr, value) (*(ptr) = (value))
+#endif
+
+/* -------------------- Structures -------------------- */
+
+/*
+ * These structures start every record of a ring, and are followed by the
+ * name of the entry.
+ */
+typedef struct watch_record
+{
+
+    /* One of the FS_EVENT_ constants, or WATCH_WRAP */
+    int kind;
+
+    /* The handle of the directory holding the entry */
+    unsigned long ino;
+    unsigned long gen;
+
+    /* The length of the name following the record */
+    size_t length;
+
+} Watch_record;
+
+/*
+ * These structures hold a watch on a directory
+ */
+struct fs_watch
+{
+
+    /* The watched directory, and whether its subdirectories are watched */
+    Fs_handle dir;
+    int recursive;
+
+    /* Set to 0 once the watched directory has been removed */
+    int active;
+
+    /* The ring of records, whose capacity is a power of 2 */
+    unsigned char *ring;
+    size_t capacity;
+
+    /* The positions of the next record to read and to write, the first
+    only written by fs_watch_drain() and the second by the file system */
+    size_t head;
+    size_t tail;
+
+    /* The number of events dropped so far, only written by the file
+    system */
+    unsigned long lost;
+
+    /* Set when the last record written is an FS_EVENT_OVERFLOW record */
+    int overflowed;
+
+    /* The next watch of the same file system */
+    struct fs_watch *next;
+
+};
+
+/* -------------------- Function Prototypes -------------------- */
+static int watches_dir(FileSystem *const filesystem, Fs_watch *const watch,
+                       Dir_node *dir);
+static void push_event(Fs_watch *const watch, int kind, Fs_handle handle,
+                       const char name[], size_t length);
+static int write_record(Fs_watch *const watch, int kind, Fs_handle handle,
+                        const char name[], size_t length, size_t room);
+
+/* -------------------- Function Definitions -------------------- */
+
+/*
+ * Starts watching the directory with the specified handle (returned by
+ * fs_lookup()), keeping up to capacity bytes of events until they are
+ * drained. Each event takes a few dozen bytes plus the length of its name.
+ * - If recursive is 1, changes anywhere below the directory are reported.
+ * - The watch lasts until fs_unwatch() or rmfs() is called, which must not
+ *   happen while another thread is draining it.
+ * - If the handle is stale, if the file system was made with mkfs_disk(),
+ *   if capacity is larger than the largest power of 2 a size_t can hold,
+ *   or if memory could not be allocated, then it will return NULL.
+ */
+Fs_watch *fs_watch(FileSystem *const filesystem, Fs_handle dir,
+                   int recursive, size_t capacity)
+{
+    Fs_watch *result = NULL;
+    size_t ring_capacity = MIN_RING_CAPACITY;
+
+    if (filesystem != NULL && filesystem->disk == NULL && dir.ino != 0
+        && dir.ino < filesystem->inode_count
+        && filesystem->inodes[dir.ino].dir != NULL
+        && filesystem->inodes[dir.ino].gen == dir.gen
+        && capacity <= MAX_RING_CAPACITY)
+    {
+        while (ring_capacity < capacity)
+        {
+            ring_capacity *= 2;
+        }
+
+        result = calloc(1, sizeof(*result));
+        if (result != NULL)
+        {
+            result->ring = malloc(ring_capacity);
+            if (result->ring != NULL)
+            {
+                result->dir = dir;
+                result->recursive = recursive;
+                result->active = 1;
+                result->capacity = ring_capacity;
+                filesystem->bytes_used += sizeof(*result) + ring_capacity;
+
+                result->next = filesystem->watches;
+                filesystem->watches = result;
+            }
+            else
+            {
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Stops the specified watch of the file system, and frees it along with the
+ * events it has not delivered.
+ */
+void fs_unwatch(FileSystem *const filesystem, Fs_watch *watch)
+{
+    Fs_watch *cur, *prev = NULL;
+
+    if (filesystem != NULL && watch != NULL)
+    {
+        cur = filesystem->watches;
+        while (cur != NULL && cur != watch)
+        {
+            prev = cur;
+            cur = cur->next;
+        }
+
+        if (cur != NULL)
+        {
+            if (prev == NULL)
+            {
+                filesystem->watches = cur->next;
+            }
+            else
+            {
+                prev->next = cur->next;
+            }
+
+            filesystem->bytes_used -= sizeof(*cur) + cur->capacity;
+            free(cur->ring);
+            free(cur);
+        }
+    }
+}
+
+/*
+ * Passes every event the watch holds to callback, in the order they
+ * happened, and then frees their space in the ring at once. Where events
+ * were dropped because the ring was full, an FS_EVENT_OVERFLOW event gives
+ * the number of events the watch has dropped so far. More may be dropped
+ * until the batch ends, so the directory should be looked at again after
+ * it.
+ * - It may be called from another thread than the one changing the file
+ *   system, as long as only one thread drains each watch.
+ * - Returns the number of events passed to callback.
+ */
+size_t fs_watch_drain(Fs_watch *const watch,
+                      void (*callback)(void *context, const Fs_event *event),
+                      void *context)
+{
+    Watch_record record;
+    Fs_event event;
+    size_t head, tail, offset, result = 0;
+
+    if (watch != NULL && callback != NULL)
+    {
+        tail = LOAD_ACQUIRE(&watch->tail);
+        head = watch->head;
+
+        while (head != tail)
+        {
+            offset = head & (watch->capacity - 1);
+
+            /* Skips the end of the ring when there is no room for a
+            record, or when it is marked as skipped */
+            if (watch->capacity - offset < sizeof(record))
+            {
+                head += watch->capacity - offset;
+            }
+            else
+            {
+                memcpy(&record, watch->ring + offset, sizeof(record));
+
+                if (record.kind == WATCH_WRAP)
+                {
+                    head += watch->capacity - offset;
+                }
+                else
+                {
+                    event.kind = record.kind;
+                    event.dir.ino = record.ino;
+                    event.dir.gen = record.gen;
+                    event.name = record.length != 0
+                                     ? (const char *)watch->ring + offset
+                                           + sizeof(record)
+                                     : NULL;
+                    event.length = record.length;
+                    event.lost = record.kind == FS_EVENT_OVERFLOW
+                                     ? LOAD_ACQUIRE(&watch->lost)
+                                     : 0;
+
+                    callback(context, &event);
+                    result++;
+
+                    head += sizeof(record) + record.length;
+                }
+            }
+        }
+
+        /* The space is only given back once the names are no longer used */
+        STORE_RELEASE(&watch->head, head);
+    }
+
+    return result;
+}
+
+/*
+ * Adds an event about the entry with the specified name in dir, which has
+ * the specified handle, to every watch of the file system on dir or on a
+ * directory above it (for recursive watches).
+ */
+void watch_notify(FileSystem *const filesystem, Dir_node *dir,
+                  Fs_handle handle, int kind, const char name[],
+                  size_t length)
+{
+    Fs_watch *watch;
+
+    for (watch = filesystem->watches; watch != NULL; watch = watch->next)
+    {
+        if (watch->active && watches_dir(filesystem, watch, dir))
+        {
+            push_event(watch, kind, handle, name, length);
+        }
+    }
+}
+
+/*
+ * Ends every watch of the file system on dir, which is being removed, with
+ * an FS_EVENT_UNWATCHED event. The watches stay until fs_unwatch() is
+ * called, but receive no more events.
+ */
+void watch_forget(FileSystem *const filesystem, Dir_node *dir)
+{
+    Fs_watch *watch;
+
+    for (watch = filesystem->watches; watch != NULL; watch = watch->next)
+    {
+        if (watch->active && dir->ino == watch->dir.ino
+            && filesystem->inodes[dir->ino].gen == watch->dir.gen)
+        {
+            push_event(watch, FS_EVENT_UNWATCHED, watch->dir, NULL, 0);
+            watch->active = 0;
+        }
+    }
+}
+
+/*
+ * Frees every watch of the file system. Called by rmfs().
+ */
+void watch_free_all(FileSystem *const filesystem)
+{
+    while (filesystem->watches != NULL)
+    {
+        fs_unwatch(filesystem, filesystem->watches);
+    }
+}
+
+/*
+ * A helper function to check whether the watch is on dir, or on one of the
+ * directories above it if the watch is recursive. Directories are compared
+ * by inode, since nodes can be moved by fs_compact().
+ */
+static int watches_dir(FileSystem *const filesystem, Fs_watch *const watch,
+                       Dir_node *dir)
+{
+    int result = 0;
+
+    while (dir != NULL && !result)
+    {
+        result = dir->ino == watch->dir.ino
+                 && filesystem->inodes[dir->ino].gen == watch->dir.gen;
+
+        dir = watch->recursive ? DIR_AT(filesystem, dir->par_dir) : NULL;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to add an event to the ring of the watch, or to count
+ * it as dropped if the ring is full.
+ */
+static void push_event(Fs_watch *const watch, int kind, Fs_handle handle,
+                       const char name[], size_t length)
+{
+    if (write_record(watch, kind, handle, name, length, OVERFLOW_ROOM))
+    {
+        watch->overflowed = 0;
+    }
+    else
+    {
+        STORE_RELEASE(&watch->lost, watch->lost + 1);
+
+        /* The room left by the last event always fits this record */
+        if (!watch->overflowed)
+        {
+            write_record(watch, FS_EVENT_OVERFLOW, watch->dir, NULL, 0, 0);
+            watch->overflowed = 1;
+        }
+    }
+}
+
+/*
+ * A helper function to write a record to the ring of the watch, leaving at
+ * least room bytes free after it.
+ * - If there is not enough room, then nothing is written and it will
+ *   return 0.
+ */
+static int write_record(Fs_watch *const watch, int kind, Fs_handle handle,
+                        const char name[], size_t length, size_t room)
+{
+    Watch_record record;
+    size_t head, offset, skip = 0, size = sizeof(record) + length;
+    int result = 0;
+
+    head = LOAD_ACQUIRE(&watch->head);
+    offset = watch->tail & (watch->capacity - 1);
+
+    /* Records that do not fit before the end of the ring go at its start */
+    if (watch->capacity - offset < size)
+    {
+        skip = watch->capacity - offset;
+    }
+
+    if (watch->tail + skip + size + room - head <= watch->capacity)
+    {
+        if (skip >= sizeof(record))
+        {
+            record.kind = WATCH_WRAP;
+            record.ino = 0;
+            record.gen = 0;
+            record.length = 0;
+            memcpy(watch->ring + offset, &record, sizeof(record));
+        }
+
+        offset = (watch->tail + skip) & (watch->capacity - 1);
+        record.kind = kind;
+        record.ino = handle.ino;
+        record.gen = handle.gen;
+        record.length = length;
+        memcpy(watch->ring + offset, &record, sizeof(record));
+        if (length != 0)
+        {
+            memcpy(watch->ring + offset + sizeof(record), name, length);
+        }
+
+        STORE_RELEASE(&watch->tail, watch->tail + skip + size);
+        result = 1;
+    }
+
+    return result;
+}
@@ -0,0 +1,85 @@
+/*
+ * File: filesystem-watch.h
+ *
+ * This file contains the structure declarations and function prototypes
+ * used to watch directories for changes, instead of polling them with ls().
+ *
+ * A watch made with fs_watch() receives an event every time touch(),
+ * mkdir(), ln(), ln_s() or rm() succeeds in its directory (or anywhere
+ * below it, for recursive watches). Events are kept in a ring buffer of
+ * their own for each watch until they are read in batches with
+ * fs_watch_drain(). A single thread may drain a watch while another one
+ * changes the file system, since the ring needs no lock. When the ring is
+ * full, new events are dropped and counted, and an FS_EVENT_OVERFLOW event
+ * takes their place so that the reader knows to look again.
+ *
+ * File systems without watches only check for them once per change.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_WATCH_H
+#define FILESYSTEM_WATCH_H
+
+#include "filesystem.h"
+
+/* The kinds of events */
+#define FS_EVENT_CREATE 1    /* A file or link was made with the name */
+#define FS_EVENT_MODIFY 2    /* The file's timestamp was incremented */
+#define FS_EVENT_MKDIR 3     /* A subdirectory was made with the name */
+#define FS_EVENT_REMOVE 4    /* The file or subdirectory was removed */
+#define FS_EVENT_OVERFLOW 5  /* Events were dropped since the ring was full */
+#define FS_EVENT_UNWATCHED 6 /* The watched directory itself was removed */
+
+/*
+ * These structures describe a change to an entry of a watched directory
+ */
+typedef struct fs_event
+{
+
+    /* One of the FS_EVENT_ constants */
+    int kind;
+
+    /* The directory holding the entry. Events about the watched directory
+    itself (FS_EVENT_OVERFLOW and FS_EVENT_UNWATCHED) give its handle. */
+    Fs_handle dir;
+
+    /* The name of the entry, without a terminating null character, which
+    is only valid until the callback returns. It is NULL when the event is
+    not about an entry. */
+    const char *name;
+    size_t length;
+
+    /* The number of events the watch has dropped so far, for
+    FS_EVENT_OVERFLOW */
+    unsigned long lost;
+
+} Fs_event;
+
+/* A watch on a directory, holding the events that have not been read */
+typedef struct fs_watch Fs_watch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+Fs_watch *fs_watch(FileSystem *const filesystem, Fs_handle dir,
+                   int recursive, size_t capacity);
+void fs_unwatch(FileSystem *const filesystem, Fs_watch *watch);
+size_t fs_watch_drain(Fs_watch *const watch,
+                      void (*callback)(void *context, const Fs_event *event),
+                      void *context);
+
+/* Used by filesystem.c to report changes. They must only be called while
+the file system has watches. */
+void watch_notify(FileSystem *const filesystem, Dir_node *dir,
+                  Fs_handle handle, int kind, const char name[],
+                  size_t length);
+void watch_forget(FileSystem *const filesystem, Dir_node *dir);
+void watch_free_all(FileSystem *const filesystem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -9,20 +9,151 @@
  */
 
 /* -------------------- Include files -------------------- */
-#include "filesystem.h"
+#include "filesystem-internal.h"
+#include "filesystem-disk.h"
+#include "filesystem-index.h"
+#include "filesystem-watch.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 /* -------------------- Function Prototypes -------------------- */
-static File_node *search_file(Dir_node *const dir, const char name[]);
-static Dir_node *search_subdir(Dir_node *const dir, const char name[]);
-static void print_whole_dir(Dir_node *const dir);
-static Name_node *insert_name(Name_node *head, char *name, int is_dir);
-static int search_and_remove_dir(Dir_node *const cur_dir, const char name[]);
-static void remove_dir(Dir_node *dir);
-static int search_and_remove_file(Dir_node *const cur_dir, const char name[]);
-static void remove_file(File_node *file);
+static int compare_name(const char stored[], const char name[],
+                        size_t length);
+static File_node *search_file(FileSystem *const filesystem,
+                              Dir_node *const dir, const char name[],
+                              size_t length);
+static Dir_node *search_subdir(FileSystem *const filesystem,
+                               Dir_node *const dir, const char name[],
+                               size_t length);
+static int resolve_path(FileSystem *const filesystem, Dir_node *dir,
+                        const char path[], size_t length,
+                        Dir_node **dir_out, File_node **file_out);
+static int follow_link(FileSystem *const filesystem, Dir_node *link_dir,
+                       File_node *link, Dir_node **dir_out,
+                       File_node **file_out);
+static int walk_path(FileSystem *const filesystem, Link_walk *const walk,
+                     Dir_node *dir, const char path[], size_t length,
+                     Dir_node **dir_out, File_node **file_out);
+static int walk_link(FileSystem *const filesystem, Link_walk *const walk,
+                     Dir_node *link_dir, File_node *link,
+                     Dir_node **dir_out, File_node **file_out);
+static void add_step(Link_walk *const walk, Node_index dir,
+                     unsigned long gen);
+static int link_cached(FileSystem *const filesystem,
+                       Symlink_data *const symlink);
+static int cache_link(FileSystem *const filesystem, Link_walk *const walk,
+                      Symlink_data *const symlink, size_t first_step);
+static void drop_link(FileSystem *const filesystem,
+                      Symlink_data *const symlink);
+static int insert_file(FileSystem *const filesystem, const char name[],
+                       size_t length, File_data *data, const char target[],
+                       size_t target_length);
+static int touch_file(FileSystem *const filesystem, File_node *const file);
+static int ls_file(FileSystem *const filesystem, File_node *const file);
+static unsigned long assign_inode(FileSystem *const filesystem,
+                                  Dir_node *dir, File_node *file);
+static int find_inode(FileSystem *const filesystem, Fs_handle handle,
+                      Dir_node **dir_out, File_node **file_out);
+static void release_inode(FileSystem *const filesystem, unsigned long ino);
+static void notify(FileSystem *const filesystem, Dir_node *dir, int kind,
+                   const char name[], size_t length);
+static void print_whole_dir(FileSystem *const filesystem,
+                            Dir_node *const dir);
+static Name_node *insert_name(Name_node *head, char *name,
+                              const char suffix[]);
+static int search_and_remove_dir(FileSystem *const filesystem,
+                                 Dir_node *const cur_dir, const char name[],
+                                 size_t length);
+static void remove_dir(FileSystem *const filesystem, Dir_node *dir);
+static int search_and_remove_file(FileSystem *const filesystem,
+                                  Dir_node *const cur_dir, const char name[],
+                                  size_t length);
+static void remove_file(FileSystem *const filesystem, File_node *file);
+static void mark_dirty(FileSystem *const filesystem, Dir_node *dir);
+static void mark_changed(FileSystem *const filesystem, Dir_node *dir);
+static const unsigned long *dir_hash(FileSystem *const filesystem,
+                                     Dir_node *const dir);
+static unsigned long hash_bytes(unsigned long hash, const char bytes[],
+                                size_t length);
+static unsigned long hash_number(unsigned long hash, unsigned long number);
+static long diff_dir(FileSystem *const a, FileSystem *const b,
+                     Dir_node *const a_dir, Dir_node *const b_dir);
+static long diff_files(FileSystem *const a, FileSystem *const b,
+                       Dir_node *const a_dir, Dir_node *const b_dir,
+                       int removals);
+static long diff_subdirs(FileSystem *const a, FileSystem *const b,
+                         Dir_node *const a_dir, Dir_node *const b_dir,
+                         int removals);
+static long print_added_dir(FileSystem *const a, FileSystem *const b,
+                            Dir_node *const dir);
+static void print_entry(FileSystem *const filesystem, const char change[],
+                        Dir_node *const dir, File_node *const file,
+                        Dir_node *const subdir);
+static void *alloc_node(FileSystem *const filesystem, Node_table *const table,
+                        size_t node_size, Node_index *index);
+static void free_node(Node_table *const table, void *node, Node_index index);
+static void free_table(FileSystem *const filesystem, Node_table *const table,
+                       size_t node_size);
+static void *node_at(Node_table *const table, size_t node_size,
+                     Node_index index);
+static void number_dir(FileSystem *const filesystem, Dir_node *const dir,
+                       Node_index dir_map[], Node_index file_map[],
+                       Node_index *dir_count, Node_index *file_count);
+static void relink_dir(FileSystem *const filesystem, Dir_node *const dir,
+                       const Node_index dir_map[],
+                       const Node_index file_map[]);
+static void sort_table(FileSystem *const filesystem, Node_table *const table,
+                       size_t node_size, Node_index map[], Node_index count);
+static size_t packed_size(FileSystem *const filesystem, Dir_node *const dir);
+static void pack_dir(FileSystem *const filesystem, char *const block,
+                     size_t *offset, size_t *live, Dir_node *const dir,
+                     const Node_index file_map[]);
+static char *pack_string(FileSystem *const filesystem, char *const block,
+                         size_t *offset, size_t *live, char *string);
+static Txn_dir *txn_add_dir(Fs_txn *const txn, Dir_node *node,
+                            Txn_dir *parent);
+static Txn_dir *txn_old_dir(Fs_txn *const txn, Dir_node *node);
+static Txn_entry *txn_entry(Fs_txn *const txn, Txn_dir *dir,
+                            const char name[], size_t length, int create);
+static int txn_load(Fs_txn *const txn, Txn_dir *dir);
+static Txn_entry *txn_slot(Fs_txn *const txn, Txn_dir *dir,
+                           const char name[], size_t length);
+static int txn_reserve(Fs_txn *const txn, size_t count);
+static const char *txn_name(Fs_txn *const txn, const char name[],
+                            size_t length);
+static int txn_taken(Txn_entry *const entry);
+static int txn_changed(Txn_entry *const entry);
+static int txn_dropped(Txn_dir *dir);
+static void txn_publish(Fs_txn *const txn, Txn_dir *const dir);
+static void txn_end(Fs_txn *txn, int committed);
+static int compare_changes(const void *a, const void *b);
+static int compare_depths(const void *a, const void *b);
+
+/* -------------------- Constants -------------------- */
+
+/* The maximum number of symbolic links followed while resolving a single
+path, after which the path is treated as a loop (like ELOOP in UNIX) */
+#define MAX_SYMLINK_DEPTH 40
+
+/* The starting value and multiplier of hash_bytes() (32 bit FNV-1a), and
+the mask keeping hashes to 32 bits where unsigned long is wider. The
+hashes of directories have a second lane, started from HASH_BASIS_2. */
+#define HASH_BASIS 2166136261UL
+#define HASH_BASIS_2 1553458183UL
+#define HASH_PRIME 16777619UL
+#define HASH_MASK 0xFFFFFFFFUL
+
+/* The alignment of the nodes packed by fs_compact(), which is enough for
+the pointers and numbers they hold */
+#define PACK_ALIGNMENT sizeof(double)
+
+/* Rounds size up to a multiple of PACK_ALIGNMENT */
+#define PACK_ROUND(size) \
+    (((size) + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT)
+
+/* The size of the blocks a transaction copies new names into */
+#define TXN_NAME_BLOCK 65536
 
 /* -------------------- Function Definitions -------------------- */
 
@@ -33,19 +164,82 @@ static void remove_file(File_node *file);
  */
 void mkfs(FileSystem *const filesystem)
 {
+    mkfs_with(filesystem, NULL);
+}
+
+/*
+ * Initializes the FileSystem parameter filesystem like mkfs(), but takes the
+ * memory for its directories, files and names from allocator instead of
+ * malloc(). This allows many file systems to share a pool of memory.
+ * - If allocator is NULL, malloc() and free() are used.
+ * - The allocator must outlive the file system, until rmfs() is called.
+ */
+void mkfs_with(FileSystem *const filesystem, const Fs_allocator *allocator)
+{
+    Dir_node *root;
+    Node_index index;
+
+    filesystem->allocator = allocator;
+    filesystem->bytes_used = 0;
+    filesystem->print = NULL;
+    filesystem->print_context = NULL;
+    filesystem->name_index = NULL;
+    filesystem->disk = NULL;
+    filesystem->packed = NULL;
+    filesystem->packed_size = 0;
+    filesystem->packed_live = 0;
+    filesystem->watches = NULL;
+    filesystem->dirs.chunks = NULL;
+    filesystem->dirs.chunk_capacity = 0;
+    filesystem->dirs.used = 0;
+    filesystem->dirs.free_node = 0;
+    filesystem->files = filesystem->dirs;
+
     /* Create and initialize root directory */
-    Dir_node *root = malloc(sizeof(*root));
+    root = alloc_node(filesystem, &filesystem->dirs, sizeof(*root), &index);
 
     root->name = "root";
     root->path = "";
-    root->file_list = NULL;
-    root->subdir_list = NULL;
-    root->next_dir = NULL;
-    root->par_dir = NULL;
+    root->file_list = 0;
+    root->subdir_list = 0;
+    root->next_dir = 0;
+    root->par_dir = 0;
+    root->self = index;
+    root->ino = 0;
+    root->name_id = 0;
+    root->hash[0] = 0;
+    root->hash[1] = 0;
+    root->hash_valid = 0;
+    root->generation = 0;
 
     /* Assign root directory to the filesystem */
     filesystem->root = root;
     filesystem->cur_dir = root;
+    filesystem->generation = 0;
+
+    /* The inode table is allocated on the first lookup */
+    filesystem->inodes = NULL;
+    filesystem->inode_count = 0;
+    filesystem->inode_capacity = 0;
+    filesystem->free_inode = 0;
+    filesystem->inode_epoch = 0;
+}
+
+/*
+ * Sends everything ls() and pwd() print to the function print, along with
+ * context, instead of printing it to the standard output. Text is passed in
+ * pieces, with a newline character after each line.
+ * - If print is NULL, printing goes back to the standard output.
+ */
+void fs_set_output(FileSystem *const filesystem,
+                   void (*print)(void *context, const char text[]),
+                   void *context)
+{
+    if (filesystem != NULL)
+    {
+        filesystem->print = print;
+        filesystem->print_context = context;
+    }
 }
 
 /*
@@ -53,74 +247,72 @@ void mkfs(FileSystem *const filesystem)
  * directory.
  * - If a file with the same name already exists, then it simply
  *   updates the timestamp by incrementing it by 1.
+ * - If a symbolic link with the same name exists, the timestamp of the file
+ *   it points to is updated instead. A dangling link returns 0.
  * - If a subdirectory with the same name exists, then it will not make any
  *   modifications.
  */
 int touch(FileSystem *const filesystem, const char name[])
 {
-    File_node *cur, *prev = NULL, *new_file;
-    char *new_name;
-    int result = 0;
+    return touch_n(filesystem, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like touch(), but takes the length of name instead of relying on a
+ * terminating null character, so name does not need to have one.
+ */
+int touch_n(FileSystem *const filesystem, const char name[], size_t length)
+{
+    File_node *cur;
+    File_data *new_data;
+    int kind, result = 0;
+
+    /* File systems kept in an image file are handled by filesystem-disk.c */
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        return disk_touch(filesystem, name, length);
+    }
 
     /* Checks if parameters are valid, and also whether
     name consists of a forward-slash character */
-    if (filesystem != NULL && name != NULL && strlen(name) != 0 
-        && strchr(name, '/') == NULL)
+    kind = classify_name(name, length);
+    if (filesystem != NULL && (kind == NAME_DOT || kind == NAME_DOTDOT
+                               || kind == NAME_REGULAR))
     {
         result = 1;
 
         /* These names would cause the function to have no
         effects, but are not classified as error cases */
-        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0 
-            && strcmp(name, "/") != 0)
+        if (kind == NAME_REGULAR)
         {
             /* Searches subdirectories with the same name.
             If there is no directory with the same name, continue. */
-            if (search_subdir(filesystem->cur_dir, name) == NULL)
+            if (search_subdir(filesystem, filesystem->cur_dir, name,
+                              length) == NULL)
             {
-                /* Set cur to the head of the file
-                list in the current directory */
-                cur = filesystem->cur_dir->file_list;
+                cur = search_file(filesystem, filesystem->cur_dir, name,
+                                  length);
 
-                /* Find location to insert node within file_list */
-                while (cur != NULL && strcmp(name, cur->name) >= 0)
+                /* If there is a file or symbolic link of the same name,
+                increment the timestamp of the file it refers to */
+                if (cur != NULL)
                 {
-                    /* If there is a file of the same name,
-                    increment timestamp and return 1*/
-                    if (strcmp(name, cur->name) == 0)
-                    {
-                        cur->timestamp += 1;
-                        return result;
-                    }
-
-                    prev = cur;
-                    cur = cur->next_file;
+                    result = touch_file(filesystem, cur);
                 }
-
                 /* Insert new File node */
-                new_file = malloc(sizeof(*new_file));
-                if (new_file != NULL)
+                else
                 {
-                    new_name = malloc(sizeof(char) * (strlen(name) + 1));
-                    if (new_name != NULL)
+                    new_data = fs_alloc(filesystem, sizeof(*new_data));
+                    if (new_data != NULL)
                     {
-                        /* Copies name to the allocated string */
-                        strcpy(new_name, name);
-
-                        /* Initializes new file structure members */
-                        new_file->name = new_name;
-                        new_file->timestamp = 1;
-                        new_file->next_file = cur;
+                        new_data->timestamp = 1;
+                        new_data->link_count = 0;
+                        new_data->links = 0;
 
-                        /* Case: File is inserted at the head */
-                        if (prev == NULL)
+                        if (!insert_file(filesystem, name, length, new_data,
+                                         NULL, 0))
                         {
-                            filesystem->cur_dir->file_list = new_file;
-                        }
-                        /* Case: File is inserted elsewhere */
-                        else
-                        {
-                            prev->next_file = new_file;
+                            fs_free(filesystem, new_data, sizeof(*new_data));
                         }
                     }
                 }
@@ -138,81 +330,87 @@ int touch(FileSystem *const filesystem, const char name[])
  *   is invalid, then it will return 0.
  */
 int mkdir(FileSystem *const filesystem, const char name[])
+{
+    return mkdir_n(filesystem, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like mkdir(), but takes the length of name instead of relying on a
+ * terminating null character, so name does not need to have one.
+ */
+int mkdir_n(FileSystem *const filesystem, const char name[], size_t length)
 {
     Dir_node *cur, *prev = NULL, *new_dir;
-    char *new_name;
-    char *new_path;
-    int result = 0;
+    int order, result = 0;
+
+    /* File systems kept in an image file are handled by filesystem-disk.c */
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        return disk_mkdir(filesystem, name, length);
+    }
 
     /* Checks if parameters are valid, and also whether name is an illegal
     special case in this context or it consists of a forward-slash character */
-    if (filesystem != NULL && name != NULL && strlen(name) != 0 
-        && strcmp(name, ".") != 0 && strcmp(name, "..") != 0 
-        && strcmp(name, "/") != 0 && strchr(name, '/') == NULL)
+    if (filesystem != NULL && classify_name(name, length) == NAME_REGULAR)
     {
-        /* Searches files with the same name.
-        If there is no file with the same name, continue. */
-        if (search_subdir(filesystem->cur_dir, name) == NULL)
+        /* Searches subdirectories and files with the same name.
+        If there is neither, continue. */
+        if (search_subdir(filesystem, filesystem->cur_dir, name,
+                          length) == NULL
+            && search_file(filesystem, filesystem->cur_dir, name,
+                           length) == NULL)
         {
 
             result = 1;
 
             /* Set cur to the head of the
             subdirectory list of the current directory */
-            cur = filesystem->cur_dir->subdir_list;
+            cur = DIR_AT(filesystem, filesystem->cur_dir->subdir_list);
 
             /* Find location to insert node within subdir_list */
-            while (cur != NULL && strcmp(name, cur->name) >= 0)
+            while (cur != NULL
+                   && (order = compare_name(cur->name, name, length)) <= 0)
             {
                 /* If there is a subdirectory of the same name,
                 do nothing and return 1 */
-                if (strcmp(name, cur->name) == 0)
+                if (order == 0)
                 {
                     return result;
                 }
                 prev = cur;
-                cur = cur->next_dir;
+                cur = DIR_AT(filesystem, cur->next_dir);
             }
 
             /* Insert new Subdirectory node */
-            new_dir = malloc(sizeof(*new_dir));
+            new_dir = make_dir(filesystem, filesystem->cur_dir, name, length);
             if (new_dir != NULL)
             {
-                new_name = malloc(sizeof(char) * (strlen(name) + 1));
-                if (new_name != NULL)
+                new_dir->next_dir = cur != NULL ? cur->self : 0;
+
+                /* Case: Directory is inserted at the head */
+                if (prev == NULL)
+                {
+                    filesystem->cur_dir->subdir_list = new_dir->self;
+                }
+                /* Case: Directory is inserted elsewhere */
+                else
                 {
-                    new_path = malloc(sizeof(char) * (strlen(name) 
-                                + strlen(filesystem->cur_dir->path) + 2));
+                    prev->next_dir = new_dir->self;
+                }
 
-                    if (new_path != NULL)
-                    {
-                        /* Copies name to the allocated name string */
-                        strcpy(new_name, name);
-                        /* Creates path name to the allocated path string */
-                        strcpy(new_path, filesystem->cur_dir->path);
-                        strcat(new_path, "/");
-                        strcat(new_path, name);
-
-                        /* Initializes new directory structure members */
-                        new_dir->name = new_name;
-                        new_dir->path = new_path;
-                        new_dir->file_list = NULL;
-                        new_dir->subdir_list = NULL;
-                        new_dir->next_dir = cur;
-                        new_dir->par_dir = filesystem->cur_dir;
-
-                        /* Case: Directory is inserted at the head */
-                        if (prev == NULL)
-                        {
-                            filesystem->cur_dir->subdir_list = new_dir;
-                        }
-                        /* Case: Directory is inserted elsewhere */
-                        else
-                        {
-                            prev->next_dir = new_dir;
-                        }
-                    }
+                if (filesystem->name_index != NULL)
+                {
+                    index_add(filesystem, new_dir, NULL);
+                    index_check(filesystem);
                 }
+                if (filesystem->watches != NULL)
+                {
+                    notify(filesystem, filesystem->cur_dir, FS_EVENT_MKDIR,
+                           name, length);
+                }
+
+                mark_dirty(filesystem, filesystem->cur_dir);
+                mark_changed(filesystem, filesystem->cur_dir);
             }
         }
     }
@@ -232,56 +430,87 @@ int mkdir(FileSystem *const filesystem, const char name[])
  *   directory to the root directory.
  * - If name is a valid name of an existing subdirectory, then it will move
  *   the current directory there.
+ * - If name is a symbolic link that resolves to a directory, then it will
+ *   move the current directory to that directory.
  * - Other cases would be errors, including consists a forward-slash, but
  *   is not solely a forward-slash.
  */
 int cd(FileSystem *const filesystem, const char name[])
+{
+    return cd_n(filesystem, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like cd(), but takes the length of name instead of relying on a
+ * terminating null character, so name does not need to have one.
+ */
+int cd_n(FileSystem *const filesystem, const char name[], size_t length)
 {
     Dir_node *dir;
-    int result = 0;
+    File_node *file;
+    int kind, result = 0;
+
+    /* File systems kept in an image file are handled by filesystem-disk.c */
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        return disk_cd(filesystem, name, length);
+    }
 
     /* Checks if parameters are valid */
-    if (filesystem != NULL && name != NULL && strlen(name) != 0)
+    kind = classify_name(name, length);
+    if (filesystem != NULL)
     {
         /* Move to current directory (no effect) */
-        if (strcmp(".", name) == 0)
+        if (kind == NAME_DOT)
         {
             result = 1;
         }
         /* Move to parent directory */
-        else if (strcmp("..", name) == 0)
+        else if (kind == NAME_DOTDOT)
         {
             /* If the current directory is the root directory, then its
             parent directory would be NULL, and therefore, should be
             prevented from crashing the program */
-            if (filesystem->cur_dir->par_dir != NULL)
+            if (filesystem->cur_dir->par_dir != 0)
             {
-                filesystem->cur_dir = filesystem->cur_dir->par_dir;
+                filesystem->cur_dir = DIR_AT(filesystem,
+                                             filesystem->cur_dir->par_dir);
             }
             result = 1;
         }
         /* Move to root directory */
-        else if (strcmp("/", name) == 0)
+        else if (kind == NAME_ROOT)
         {
             filesystem->cur_dir = filesystem->root;
             result = 1;
         }
-        /* Move to an existing subdirectory */
-        else
+        /* Move to an existing subdirectory. If name consists
+        of a forward-slash, it is invalid. */
+        else if (kind == NAME_REGULAR)
         {
-            /* If name consists of a forward-slash, it is invalid */
-            if (strchr(name, '/') == NULL)
+            /* Searches for subdirectories with the specified name,
+            and sets the current directory to be inside it. If not
+            found, then 0 will be returned. */
+            dir = search_subdir(filesystem, filesystem->cur_dir, name, length);
+
+            /* If a subdirectory is not found, try following a
+            symbolic link with the specified name instead */
+            if (dir == NULL)
             {
-                /* Searches for subdirectories with the specified name,
-                and sets the current directory to be inside it. If not
-                found, then 0 will be returned. */
-                dir = search_subdir(filesystem->cur_dir, name);
-                if (dir != NULL)
+                file = search_file(filesystem, filesystem->cur_dir, name,
+                                   length);
+                if (file != NULL && file->symlink != NULL)
                 {
-                    filesystem->cur_dir = dir;
-                    result = 1;
+                    follow_link(filesystem, filesystem->cur_dir, file, &dir,
+                                &file);
                 }
             }
+
+            if (dir != NULL)
+            {
+                filesystem->cur_dir = dir;
+                result = 1;
+            }
         }
     }
 
@@ -295,6 +524,8 @@ int cd(FileSystem *const filesystem, const char name[])
  * - If name is an existing subdirectory in the current directory, then it
  *   will print all the files and and subdirectories within it in
  *   lexicographic order.
+ * - If name is a symbolic link, it will be followed and whatever it points
+ *   to is printed as above, with files printed under the link's name.
  * - If name is a single period (.), or name is an empty string, it will print
  *   out the current directory.
  * - If name is a double adjacent period (..), it will print out the parent
@@ -304,66 +535,81 @@ int cd(FileSystem *const filesystem, const char name[])
  *   is not solely a forward-slash.
  */
 int ls(FileSystem *const filesystem, const char name[])
+{
+    return ls_n(filesystem, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like ls(), but takes the length of name instead of relying on a
+ * terminating null character, so name does not need to have one.
+ */
+int ls_n(FileSystem *const filesystem, const char name[], size_t length)
 {
     Dir_node *dir;
     File_node *file;
-    int result = 0;
+    int kind, result = 0;
+
+    /* File systems kept in an image file are handled by filesystem-disk.c */
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        return disk_ls(filesystem, name, length);
+    }
 
     /* Checks if parameters are valid */
-    if (filesystem != NULL && name != NULL)
+    kind = classify_name(name, length);
+    if (filesystem != NULL)
     {
 
         /* Prints out current directory */
-        if (strcmp(".", name) == 0 || strlen(name) == 0)
+        if (kind == NAME_DOT || kind == NAME_EMPTY)
         {
-            print_whole_dir(filesystem->cur_dir);
+            print_whole_dir(filesystem, filesystem->cur_dir);
             result = 1;
         }
         /* Prints out parent directory */
-        else if (strcmp("..", name) == 0)
+        else if (kind == NAME_DOTDOT)
         {
             /* If the current directory is the root directory, then its
             parent directory would be NULL, and therefore, should be
             prevented from crashing the program */
-            if (filesystem->cur_dir->par_dir != NULL)
+            if (filesystem->cur_dir->par_dir != 0)
             {
-                print_whole_dir(filesystem->cur_dir->par_dir);
+                print_whole_dir(filesystem,
+                                DIR_AT(filesystem,
+                                       filesystem->cur_dir->par_dir));
             }
             result = 1;
         }
         /* Prints out root directory */
-        else if (strcmp("/", name) == 0)
+        else if (kind == NAME_ROOT)
         {
-            print_whole_dir(filesystem->root);
+            print_whole_dir(filesystem, filesystem->root);
             result = 1;
         }
-        /* Prints out an existing file or subdirectory */
-        else
+        /* Prints out an existing file or subdirectory. If name
+        consists of a forward-slash, it is invalid. */
+        else if (kind == NAME_REGULAR)
         {
-            /* If name consists of a forward-slash, it is invalid */
-            if (strchr(name, '/') == NULL)
+            /* Searches for a subdirectory with the specified name and
+            prints it out. */
+            dir = search_subdir(filesystem, filesystem->cur_dir, name, length);
+            if (dir != NULL)
             {
-                /* Searches for a subdirectory with the specified name and
-                prints it out. */
-                dir = search_subdir(filesystem->cur_dir, name);
-                if (dir != NULL)
-                {
-                    print_whole_dir(dir);
-                    result = 1;
-                }
-                /* If a subdirectory is not found, then it will try searching
-                for files with the specified name */
-                else
+                print_whole_dir(filesystem, dir);
+                result = 1;
+            }
+            /* If a subdirectory is not found, then it will try searching
+            for files with the specified name */
+            else
+            {
+                file = search_file(filesystem, filesystem->cur_dir, name,
+                                   length);
+                if (file != NULL)
                 {
-                    file = search_file(filesystem->cur_dir, name);
-                    if (file != NULL)
-                    {
-                        printf("%s %d\n", file->name, file->timestamp);
-                        result = 1;
-                    }
+                    result = ls_file(filesystem, file);
                 }
-                /* If both are not found, then function will return 0 */
             }
+            /* If both are not found, then function will return 0 */
         }
     }
 
@@ -377,7 +623,11 @@ int ls(FileSystem *const filesystem, const char name[])
 void pwd(FileSystem *const filesystem)
 {
     /* Check if parameter is valid */
-    if (filesystem != NULL)
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        disk_pwd(filesystem);
+    }
+    else if (filesystem != NULL)
     {
         /* If the current directory is the root directory, then print out
         a forward-slash. The root is initialized such that its path would
@@ -385,11 +635,12 @@ void pwd(FileSystem *const filesystem)
         other directory paths */
         if (strcmp(filesystem->cur_dir->path, "") == 0)
         {
-            printf("/\n");
+            print_text(filesystem, "/\n");
         }
         else
         {
-            printf("%s\n", filesystem->cur_dir->path);
+            print_text(filesystem, filesystem->cur_dir->path);
+            print_text(filesystem, "\n");
         }
     }
 }
@@ -406,7 +657,18 @@ void rmfs(FileSystem *const filesystem)
     /* Checks if paramter is valid */
     if (filesystem != NULL)
     {
-        remove_dir(filesystem->root);
+        if (filesystem->disk != NULL)
+        {
+            disk_close(filesystem);
+        }
+        watch_free_all(filesystem);
+        fs_disable_index(filesystem);
+        remove_dir(filesystem, filesystem->root);
+        free_table(filesystem, &filesystem->dirs, sizeof(Dir_node));
+        free_table(filesystem, &filesystem->files, sizeof(File_node));
+        filesystem->bytes_used -= sizeof(*filesystem->inodes)
+                                  * filesystem->inode_capacity;
+        free(filesystem->inodes);
     }
 }
 
@@ -415,390 +677,3625 @@ void rmfs(FileSystem *const filesystem)
  * means that whatever content is stored within them is also removed,
  * as any allocated memory being used within it freed and returned to the
  * memory pool.
+ * - Symbolic links are removed themselves, without following them.
+ * - Removing a hard link leaves the file reachable through its other links.
  */
 int rm(FileSystem *const filesystem, const char name[])
+{
+    return rm_n(filesystem, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like rm(), but takes the length of name instead of relying on a
+ * terminating null character, so name does not need to have one.
+ */
+int rm_n(FileSystem *const filesystem, const char name[], size_t length)
 {
     int result = 0;
 
+    /* File systems kept in an image file are handled by filesystem-disk.c */
+    if (filesystem != NULL && filesystem->disk != NULL)
+    {
+        return disk_rm(filesystem, name, length);
+    }
+
     /* Checks if parameters are valid, and also whether name is an illegal
     special case in this context or it consists of a forward-slash character */
-    if (filesystem != NULL && name != NULL && strlen(name) != 0 
-        && strcmp(name, ".") != 0 && strcmp(name, "..") != 0 
-        && strcmp(name, "/") != 0 && strchr(name, '/') == NULL)
+    if (filesystem != NULL && classify_name(name, length) == NAME_REGULAR)
     {
         /* Tries removing a directory with the specified name */
-        result = search_and_remove_dir(filesystem->cur_dir, name);
+        result = search_and_remove_dir(filesystem, filesystem->cur_dir,
+                                       name, length);
 
         /* If directory is not found, it will try
         removing a file with the specified name */
         if (!result)
         {
-            result = search_and_remove_file(filesystem->cur_dir, name);
+            result = search_and_remove_file(filesystem, filesystem->cur_dir,
+                                            name, length);
         }
 
         /* If both a directory or file is not
         found, then result would stay 0 */
+        if (result)
+        {
+            if (filesystem->watches != NULL)
+            {
+                notify(filesystem, filesystem->cur_dir, FS_EVENT_REMOVE,
+                       name, length);
+            }
+
+            mark_dirty(filesystem, filesystem->cur_dir);
+            mark_changed(filesystem, filesystem->cur_dir);
+        }
     }
 
     return result;
 }
 
 /*
- * A helper function to search for a file with the specified name within
- * the specified directory.
+ * Creates a hard link with the specified name in the file system's current
+ * directory, pointing to the file at the path target. The path is resolved
+ * from the current directory, and may go through subdirectories and
+ * symbolic links (e.g. "../docs/notes").
+ * - Both names refer to the same file afterwards, so touching one of them
+ *   updates the timestamp seen through the other. The file itself is only
+ *   freed once every link to it has been removed.
+ * - If target does not resolve to a file (directories cannot be hard
+ *   linked), or if name is invalid or already exists, then it will return 0.
  */
-static File_node *search_file(Dir_node *const dir, const char name[])
+int ln(FileSystem *const filesystem, const char target[], const char name[])
 {
-    File_node *cur;
+    return ln_n(filesystem, target, target != NULL ? strlen(target) : 0,
+                name, name != NULL ? strlen(name) : 0);
+}
 
-    /* Set cur to the head of the file
-    list in the specified directory */
-    cur = dir->file_list;
+/*
+ * Works like ln(), but takes the lengths of target and name instead of
+ * relying on terminating null characters, so they do not need to have one.
+ */
+int ln_n(FileSystem *const filesystem, const char target[],
+         size_t target_length, const char name[], size_t length)
+{
+    Dir_node *dir;
+    File_node *file;
+    int result = 0;
 
-    /* Traverses the file list to search for the desired file */
-    while (cur != NULL)
+    /* Checks if parameters are valid, and also whether name is an illegal
+    special case in this context or it consists of a forward-slash character */
+    if (filesystem != NULL && filesystem->disk == NULL && target != NULL
+        && memchr(target, '\0', target_length) == NULL
+        && classify_name(name, length) == NAME_REGULAR)
     {
-        if (strcmp(cur->name, name) == 0)
+        /* The name must not already be taken by a subdirectory or file,
+        and the target must resolve to a file */
+        if (search_subdir(filesystem, filesystem->cur_dir, name,
+                          length) == NULL
+            && search_file(filesystem, filesystem->cur_dir, name,
+                           length) == NULL
+            && resolve_path(filesystem, filesystem->cur_dir, target,
+                            target_length, &dir, &file)
+            && file != NULL)
         {
-            return cur;
+            result = insert_file(filesystem, name, length, file->data,
+                                 NULL, 0);
         }
-        cur = cur->next_file;
     }
 
-    /* If a file with the specified name is not found,
-    then it will return NULL */
-    return NULL;
+    return result;
 }
 
 /*
- * A helper function to search for a directory with the specified name within
- * the specified directory.
+ * Creates a symbolic link with the specified name in the file system's
+ * current directory, storing the path target. The target does not need to
+ * exist, and is only resolved when the link is used by cd(), ls() or
+ * touch(). Relative targets are resolved from the directory holding the link.
+ * - If target is empty, or if name is invalid or already exists, then it
+ *   will return 0.
  */
-static Dir_node *search_subdir(Dir_node *const dir, const char name[])
+int ln_s(FileSystem *const filesystem, const char target[], const char name[])
 {
-    Dir_node *cur;
+    return ln_s_n(filesystem, target, target != NULL ? strlen(target) : 0,
+                  name, name != NULL ? strlen(name) : 0);
+}
 
-    /* Set cur to the head of the subdirectory
-    list in the specified directory */
-    cur = dir->subdir_list;
+/*
+ * Works like ln_s(), but takes the lengths of target and name instead of
+ * relying on terminating null characters, so they do not need to have one.
+ */
+int ln_s_n(FileSystem *const filesystem, const char target[],
+           size_t target_length, const char name[], size_t length)
+{
+    int result = 0;
 
-    /* Traverses the subdirectory list to search for the
-    desired subdirectory */
-    while (cur != NULL)
+    /* Checks if parameters are valid, and also whether name is an illegal
+    special case in this context or it consists of a forward-slash
+    character. The target is stored as a string, so it cannot contain
+    null characters. */
+    if (filesystem != NULL && filesystem->disk == NULL && target != NULL
+        && target_length != 0
+        && memchr(target, '\0', target_length) == NULL
+        && classify_name(name, length) == NAME_REGULAR)
     {
-        if (strcmp(cur->name, name) == 0)
+        /* The name must not already be taken by a subdirectory or file */
+        if (search_subdir(filesystem, filesystem->cur_dir, name,
+                          length) == NULL
+            && search_file(filesystem, filesystem->cur_dir, name,
+                           length) == NULL)
         {
-            return cur;
+            result = insert_file(filesystem, name, length, NULL,
+                                 target, target_length);
         }
-        cur = cur->next_dir;
     }
 
-    /* If a subdirectory with the specified name is not found,
-    then it will return NULL */
-    return NULL;
+    return result;
 }
 
 /*
- * A helper function to print the contents of the whole specified directory.
- * To do this, the function takes two steps:
- * 1. It will create an ordered linked list (arranged in lexicographic order)
- *    storing the names of all files and subdirectories (if any) within the
- *    specified directory.
- * 2. Prints all the names being stored in the ordered linked list while
- *    deallocating any memory being used by it. We can safely do this since
- *    the linked list will be of no use for us in the future.
+ * Looks up a file or subdirectory in the current directory, and stores a
+ * stable handle to it in handle. The handle can then be passed to touch_h(),
+ * ls_h(), cd_h() and rm_h(), which find the node in constant time instead of
+ * searching for its name again, even after the current directory changes.
+ * - Names accepted by cd() are looked up the same way, so ".", ".." and "/"
+ *   give handles to the current, parent and root directories.
+ * - Symbolic links are not followed, so the handle refers to the link itself.
+ * - If name does not exist or is invalid, then it will return 0.
  */
-static void print_whole_dir(Dir_node *const dir)
+int fs_lookup(FileSystem *const filesystem, const char name[],
+              Fs_handle *handle)
 {
-    Name_node *name_list = NULL, *printed_name;
-    Dir_node *cur_dir;
-    File_node *cur_file;
-
-    /* Make an ordered Linked List of File/Directory names. */
+    return fs_lookup_n(filesystem, name, name != NULL ? strlen(name) : 0,
+                       handle);
+}
 
-    /* Traverse directory's files. */
-    cur_file = dir->file_list;
+/*
+ * Works like fs_lookup(), but takes the length of name instead of relying
+ * on a terminating null character, so name does not need to have one.
+ */
+int fs_lookup_n(FileSystem *const filesystem, const char name[],
+                size_t length, Fs_handle *handle)
+{
+    Dir_node *dir = NULL;
+    File_node *file = NULL;
+    unsigned long ino = 0;
+    int kind, result = 0;
 
-    while (cur_file != NULL)
+    /* Checks if parameters are valid. Entries of file systems kept in an
+    image file have no inodes, so they cannot be looked up. */
+    kind = classify_name(name, length);
+    if (filesystem != NULL && filesystem->disk == NULL && handle != NULL)
     {
-        name_list = insert_name(name_list, cur_file->name, 0);
-        cur_file = cur_file->next_file;
-    }
+        /* Looks up the current directory */
+        if (kind == NAME_DOT || kind == NAME_EMPTY)
+        {
+            dir = filesystem->cur_dir;
+        }
+        /* Looks up the parent directory, which is the root itself
+        if the current directory is the root directory */
+        else if (kind == NAME_DOTDOT)
+        {
+            dir = DIR_AT(filesystem, filesystem->cur_dir->par_dir);
+            if (dir == NULL)
+            {
+                dir = filesystem->cur_dir;
+            }
+        }
+        /* Looks up the root directory */
+        else if (kind == NAME_ROOT)
+        {
+            dir = filesystem->root;
+        }
+        /* If name consists of a forward-slash, it is invalid */
+        else if (kind == NAME_REGULAR)
+        {
+            dir = search_subdir(filesystem, filesystem->cur_dir, name, length);
+            if (dir == NULL)
+            {
+                file = search_file(filesystem, filesystem->cur_dir, name,
+                                   length);
+            }
+        }
 
-    /* Traverse directory's subdirectories. */
-    cur_dir = dir->subdir_list;
+        /* Nodes keep their inode once it has been assigned */
+        if (dir != NULL)
+        {
+            ino = dir->ino != 0 ? dir->ino
+                                : assign_inode(filesystem, dir, NULL);
+        }
+        else if (file != NULL)
+        {
+            ino = file->ino != 0 ? file->ino
+                                 : assign_inode(filesystem, NULL, file);
+        }
 
-    while (cur_dir != NULL)
-    {
-        name_list = insert_name(name_list, cur_dir->name, 1);
-        cur_dir = cur_dir->next_dir;
+        if (ino != 0)
+        {
+            handle->ino = ino;
+            handle->gen = filesystem->inodes[ino].gen;
+            result = 1;
+        }
     }
 
-    /* Start printing names. If the name_list is NULL, it indicates that
-    the directory is empty, and therefore, nothing is printed. */
-    while (name_list != NULL)
-    {
-        printf("%s\n", name_list->name);
+    return result;
+}
 
-        /* Set printed_name to the name that has just been printed
-        and move name_list to the next node. */
-        printed_name = name_list;
-        name_list = name_list->next_name;
+/*
+ * Works like touch() on the node referred to by handle, which must already
+ * exist. Files have their timestamp incremented, symbolic links are followed,
+ * and directories are left unmodified.
+ * - If the handle is stale (its node has been removed), then it will return 0.
+ */
+int touch_h(FileSystem *const filesystem, Fs_handle handle)
+{
+    Dir_node *dir;
+    File_node *file;
+    int result = 0;
 
-        /* Free allocated memory being used by printed_name. */
-        free(printed_name->name);
-        free(printed_name);
+    if (filesystem != NULL && find_inode(filesystem, handle, &dir, &file))
+    {
+        result = dir != NULL ? 1 : touch_file(filesystem, file);
     }
+
+    return result;
 }
 
 /*
- * A helper function to assist the print_whole_dir() function in creating
- * an ordered linked list of names.
- * - The head parameter represents the head of the name linked list.
- * - The name parameter represents the name to be stored within the node.
- * - The is_dir parameter indicates whether the node being inserted will
- *   store the name of a directory. This distinction is important since
- *   directories are printed with a preceding forward-slash.
+ * Works like ls() on the node referred to by handle, printing either the
+ * whole directory or the file's name followed by its timestamp.
+ * - If the handle is stale (its node has been removed), then it will return 0.
  */
-static Name_node *insert_name(Name_node *head, char *name, int is_dir)
+int ls_h(FileSystem *const filesystem, Fs_handle handle)
 {
-    Name_node *cur, *prev = NULL, *new_node;
-    char *new_name;
-
-    /* The boolean value flag is used to indicate whether an error has
-    occured in the process of allocating memory, to prevent the function
-    from executing more statements and causing the program to crash. */
-    int flag = 1;
-
-    /* Initialize new_name node. */
-    new_node = malloc(sizeof(*new_node));
+    Dir_node *dir;
+    File_node *file;
+    int result = 0;
 
-    if (new_node != NULL)
+    if (filesystem != NULL && find_inode(filesystem, handle, &dir, &file))
     {
-        new_name = malloc(sizeof(char) * (strlen(name) + 2));
-        if (new_name != NULL)
+        if (dir != NULL)
         {
-            strcpy(new_name, name);
-
-            /* If the name being inserted is the name of a directory,
-            concatenate a forward-slash to the end of the string. */
-            if (is_dir)
-            {
-                strcat(new_name, "/");
-            }
-
-            /* Initialize values of new_name node */
-            new_node->name = new_name;
-            new_node->next_name = NULL;
+            print_whole_dir(filesystem, dir);
+            result = 1;
         }
         else
         {
-            /* Malloc Error */
-            flag = 0;
+            result = ls_file(filesystem, file);
         }
     }
-    else
+
+    return result;
+}
+
+/*
+ * Works like cd() on the node referred to by handle, moving the current
+ * directory to it, or to the directory a symbolic link points to.
+ * - If the handle is stale, or does not refer to a directory, then it will
+ *   return 0.
+ */
+int cd_h(FileSystem *const filesystem, Fs_handle handle)
+{
+    Dir_node *dir;
+    File_node *file;
+    int result = 0;
+
+    if (filesystem != NULL && find_inode(filesystem, handle, &dir, &file))
+    {
+        if (file != NULL && file->symlink != NULL)
+        {
+            follow_link(filesystem, DIR_AT(filesystem, file->par_dir), file,
+                        &dir, &file);
+        }
+
+        if (dir != NULL)
+        {
+            filesystem->cur_dir = dir;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Works like rm() on the node referred to by handle, which does not need to
+ * be in the current directory. Every handle to the removed node (or any of
+ * its contents) becomes stale afterwards.
+ * - The root directory, and directories containing the current directory,
+ *   cannot be removed. For these, or for stale handles, it will return 0.
+ */
+int rm_h(FileSystem *const filesystem, Fs_handle handle)
+{
+    Dir_node *dir, *parent, *cur_dir, *prev_dir = NULL;
+    File_node *file, *cur_file, *prev_file = NULL;
+    int result = 0;
+
+    if (filesystem != NULL && find_inode(filesystem, handle, &dir, &file))
+    {
+        /* Removes a subdirectory, after making sure that
+        the current directory is not inside of it */
+        if (dir != NULL)
+        {
+            result = 1;
+            for (cur_dir = filesystem->cur_dir; cur_dir != NULL;
+                 cur_dir = DIR_AT(filesystem, cur_dir->par_dir))
+            {
+                if (cur_dir == dir)
+                {
+                    result = 0;
+                }
+            }
+
+            if (result)
+            {
+                /* Find the node before it in its parent's list */
+                parent = DIR_AT(filesystem, dir->par_dir);
+                cur_dir = DIR_AT(filesystem, parent->subdir_list);
+                while (cur_dir != dir)
+                {
+                    prev_dir = cur_dir;
+                    cur_dir = DIR_AT(filesystem, cur_dir->next_dir);
+                }
+
+                if (prev_dir == NULL)
+                {
+                    parent->subdir_list = dir->next_dir;
+                }
+                else
+                {
+                    prev_dir->next_dir = dir->next_dir;
+                }
+
+                if (filesystem->watches != NULL)
+                {
+                    notify(filesystem, parent, FS_EVENT_REMOVE, dir->name,
+                           strlen(dir->name));
+                }
+
+                mark_dirty(filesystem, parent);
+                remove_dir(filesystem, dir);
+            }
+        }
+        /* Removes a file or symbolic link */
+        else
+        {
+            result = 1;
+
+            /* Find the node before it in its directory's list */
+            parent = DIR_AT(filesystem, file->par_dir);
+            cur_file = FILE_AT(filesystem, parent->file_list);
+            while (cur_file != file)
+            {
+                prev_file = cur_file;
+                cur_file = FILE_AT(filesystem, cur_file->next_file);
+            }
+
+            if (prev_file == NULL)
+            {
+                parent->file_list = file->next_file;
+            }
+            else
+            {
+                prev_file->next_file = file->next_file;
+            }
+
+            if (filesystem->watches != NULL)
+            {
+                notify(filesystem, parent, FS_EVENT_REMOVE, file->name,
+                       strlen(file->name));
+            }
+
+            mark_dirty(filesystem, parent);
+            remove_file(filesystem, file);
+        }
+
+        if (result)
+        {
+            mark_changed(filesystem, parent);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Prints the differences between the file systems a and b, as the changes
+ * that would turn a into b, with one entry per line:
+ *
+ *     - /path      the file or directory only exists in a
+ *     + /path      the file or directory only exists in b
+ *     ~ /path      the file exists in both, but has changed
+ *
+ * Paths are printed like ls() prints names: directories end with a
+ * forward-slash, files are followed by their timestamp, and symbolic links
+ * end with an at sign (@) followed by their target. Added directories are
+ * followed by everything inside of them, while removed ones are not.
+ * Within a directory, removals come first, so that replaying the entries
+ * in order never finds a name already taken.
+ * - Directories are compared by their hashes first, and skipped without
+ *   looking inside of them if they match. The time taken therefore depends
+ *   on the directories that changed, rather than on the whole file systems.
+ *   Each hash is made of two 32 bit FNV-1a lanes started from different
+ *   values, so a changed directory is only missed if both lanes happen to
+ *   collide with the other one's at once.
+ * - The entries are printed wherever ls() on a prints.
+ * - Returns the number of entries printed, which is 0 if both file systems
+ *   are the same, or -1 if a or b is NULL or was made with mkfs_disk().
+ */
+long fs_diff(FileSystem *const a, FileSystem *const b)
+{
+    long result = -1;
+
+    if (a != NULL && b != NULL && a->disk == NULL && b->disk == NULL)
+    {
+        result = diff_dir(a, b, a->root, b->root);
+    }
+
+    return result;
+}
+
+/*
+ * Renumbers every directory and file of the file system in depth-first
+ * order, so that the nodes of each directory's lists sit next to each
+ * other in the node tables, and moves the names and file records into a
+ * single block of memory in the same order. Walking the tree then reads
+ * memory in order instead of jumping around the heap. The nodes freed
+ * since the tables were last compacted are left at their ends, and whole
+ * chunks of them are given back. Entries made afterwards are allocated as
+ * usual, so it can be called again once many of them have been made.
+ * - Handles, the current directory and the name index stay valid, while
+ *   cached symbolic link resolutions are dropped.
+ * - Nodes are swapped into place within their tables, which takes a few
+ *   numbers per node, but the names are copied. If this memory could not
+ *   be allocated, nothing changes and it will return 0.
+ * - File systems made with mkfs_disk() are not compacted, returning 0.
+ */
+int fs_compact(FileSystem *const filesystem)
+{
+    Node_index *dir_map = NULL, *file_map = NULL, *order = NULL;
+    Node_index dir_count = 0, file_count = 0, cur_dir;
+    char *block = NULL;
+    size_t size = 0, offset = 0, live = 0, count;
+    int result = 0;
+
+    if (filesystem != NULL && filesystem->disk == NULL)
+    {
+        /* The maps hold the new number of each node, or 0 for the nodes
+        that are free, and order is a copy used up while sorting */
+        count = (size_t)(filesystem->dirs.used > filesystem->files.used
+                             ? filesystem->dirs.used
+                             : filesystem->files.used) + 1;
+        dir_map = calloc((size_t)filesystem->dirs.used + 1,
+                         sizeof(*dir_map));
+        file_map = calloc((size_t)filesystem->files.used + 1,
+                          sizeof(*file_map));
+        order = malloc(sizeof(*order) * count);
+        if (dir_map != NULL && file_map != NULL && order != NULL)
+        {
+            size = packed_size(filesystem, filesystem->root);
+            block = size != 0 ? fs_alloc(filesystem, size) : NULL;
+        }
+
+        if (dir_map != NULL && file_map != NULL && order != NULL
+            && (size == 0 || block != NULL))
+        {
+            /* The root comes first */
+            dir_count = 1;
+            dir_map[filesystem->root->self] = dir_count;
+            number_dir(filesystem, filesystem->root, dir_map, file_map,
+                       &dir_count, &file_count);
+            relink_dir(filesystem, filesystem->root, dir_map, file_map);
+
+            /* The current directory already has its new number */
+            cur_dir = filesystem->cur_dir->self;
+            memcpy(order, dir_map,
+                   sizeof(*order) * ((size_t)filesystem->dirs.used + 1));
+            sort_table(filesystem, &filesystem->dirs, sizeof(Dir_node),
+                       order, dir_count);
+            memcpy(order, file_map,
+                   sizeof(*order) * ((size_t)filesystem->files.used + 1));
+            sort_table(filesystem, &filesystem->files, sizeof(File_node),
+                       order, file_count);
+            filesystem->root = DIR_AT(filesystem, 1);
+            filesystem->cur_dir = DIR_AT(filesystem, cur_dir);
+
+            /* The block of an earlier compaction is freed along with the
+            last of its names, as they are moved out of it */
+            pack_dir(filesystem, block, &offset, &live, filesystem->root,
+                     file_map);
+            filesystem->packed = block;
+            filesystem->packed_size = size;
+            filesystem->packed_live = live;
+            result = 1;
+        }
+
+        free(dir_map);
+        free(file_map);
+        free(order);
+    }
+
+    return result;
+}
+
+/*
+ * Starts a transaction on the file system, staging touch(), mkdir(), cd()
+ * and rm() calls made with fs_txn_touch(), fs_txn_mkdir(), fs_txn_cd() and
+ * fs_txn_rm() until fs_txn_commit() applies all of them at once, or
+ * fs_txn_abort() drops them. Each of these returns what the call it stands
+ * for would return at that point, so a sequence can be given up as soon as
+ * one of them fails, without having changed anything.
+ * - New files and directories are made off to the side, and the changes
+ *   are kept in a table grouped by directory. Directories are therefore
+ *   only searched once, however many changes are made within them.
+ * - The transaction has its own current directory, starting at the file
+ *   system's, which stays where it is.
+ * - Until the transaction ends, the file system must not be changed, its
+ *   current directory must not move, and no other transaction may be
+ *   started on it.
+ * - If the file system was made with mkfs_disk(), or if memory could not
+ *   be allocated, then it will return NULL.
+ */
+Fs_txn *fs_txn_begin(FileSystem *const filesystem)
+{
+    Fs_txn *result = NULL;
+
+    if (filesystem != NULL && filesystem->disk == NULL)
+    {
+        result = calloc(1, sizeof(*result));
+        if (result != NULL)
+        {
+            result->filesystem = filesystem;
+            result->cur_dir = txn_old_dir(result, filesystem->cur_dir);
+            if (result->cur_dir == NULL)
+            {
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Stages touch() of the specified name in the current directory of the
+ * transaction. Files made by the transaction are touched right away, while
+ * existing ones are touched when it is committed.
+ * - Symbolic links are followed as the tree was before the transaction.
+ * - If memory could not be allocated, then it will return 0.
+ */
+int fs_txn_touch(Fs_txn *const txn, const char name[])
+{
+    return fs_txn_touch_n(txn, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like fs_txn_touch(), but takes the length of name instead of
+ * relying on a terminating null character, so name does not need to have
+ * one.
+ */
+int fs_txn_touch_n(Fs_txn *const txn, const char name[], size_t length)
+{
+    Txn_entry *entry;
+    File_data *new_data;
+    File_node *target;
+    Dir_node *dir;
+    int kind, result = 0;
+
+    kind = classify_name(name, length);
+    if (txn != NULL && (kind == NAME_DOT || kind == NAME_DOTDOT
+                        || kind == NAME_REGULAR))
+    {
+        result = 1;
+
+        /* Like touch(), other names have no effects */
+        if (kind == NAME_REGULAR)
+        {
+            entry = txn_entry(txn, txn->cur_dir, name, length, 1);
+            if (entry == NULL)
+            {
+                result = 0;
+            }
+            /* Case: A file made by the transaction, which nothing else
+            can see yet */
+            else if (entry->new_file != NULL)
+            {
+                entry->new_file->data->timestamp += 1;
+            }
+            /* Case: A file or symbolic link that already existed */
+            else if (entry->old_file != NULL && !entry->removed)
+            {
+                target = entry->old_file;
+                if (target->symlink != NULL)
+                {
+                    result = follow_link(txn->filesystem,
+                                         DIR_AT(txn->filesystem,
+                                                target->par_dir),
+                                         target, &dir, &target);
+                }
+
+                if (target != NULL)
+                {
+                    entry->touches += 1;
+                }
+            }
+            /* Case: No file or subdirectory has the name, so a new file is
+            made */
+            else if (!txn_taken(entry))
+            {
+                new_data = fs_alloc(txn->filesystem, sizeof(*new_data));
+                if (new_data != NULL)
+                {
+                    new_data->timestamp = 1;
+                    new_data->link_count = 0;
+                    new_data->links = 0;
+
+                    entry->new_file = make_file(txn->filesystem,
+                                                txn->cur_dir->node, name,
+                                                length, new_data, NULL, 0);
+                    if (entry->new_file == NULL)
+                    {
+                        fs_free(txn->filesystem, new_data,
+                                sizeof(*new_data));
+                    }
+                }
+
+                result = entry->new_file != NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Stages mkdir() of the specified name in the current directory of the
+ * transaction. The new directory can be entered with fs_txn_cd() right
+ * away, and changed like any other.
+ * - If the name is taken, if it is invalid, or if memory could not be
+ *   allocated, then it will return 0.
+ */
+int fs_txn_mkdir(Fs_txn *const txn, const char name[])
+{
+    return fs_txn_mkdir_n(txn, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like fs_txn_mkdir(), but takes the length of name instead of
+ * relying on a terminating null character, so name does not need to have
+ * one.
+ */
+int fs_txn_mkdir_n(Fs_txn *const txn, const char name[], size_t length)
+{
+    Txn_entry *entry;
+    Dir_node *new_dir;
+    int result = 0;
+
+    if (txn != NULL && classify_name(name, length) == NAME_REGULAR)
+    {
+        entry = txn_entry(txn, txn->cur_dir, name, length, 1);
+        if (entry != NULL && !txn_taken(entry))
+        {
+            new_dir = make_dir(txn->filesystem, txn->cur_dir->node, name,
+                               length);
+            if (new_dir != NULL)
+            {
+                entry->new_dir = txn_add_dir(txn, new_dir, txn->cur_dir);
+                if (entry->new_dir != NULL)
+                {
+                    result = 1;
+                }
+                else
+                {
+                    remove_dir(txn->filesystem, new_dir);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Moves the current directory of the transaction like cd() would, into
+ * directories that existed before it as well as the ones it made. The
+ * current directory of the file system does not move.
+ * - Symbolic links are followed as the tree was before the transaction.
+ */
+int fs_txn_cd(Fs_txn *const txn, const char name[])
+{
+    return fs_txn_cd_n(txn, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like fs_txn_cd(), but takes the length of name instead of relying
+ * on a terminating null character, so name does not need to have one.
+ */
+int fs_txn_cd_n(Fs_txn *const txn, const char name[], size_t length)
+{
+    Txn_entry *entry;
+    Txn_dir *dir = NULL;
+    Dir_node *node = NULL;
+    File_node *file;
+    int kind, result = 0;
+
+    kind = classify_name(name, length);
+    if (txn != NULL)
+    {
+        /* Move to current directory (no effect) */
+        if (kind == NAME_DOT)
+        {
+            dir = txn->cur_dir;
+        }
+        /* Move to parent directory, unless this is the root directory */
+        else if (kind == NAME_DOTDOT)
+        {
+            dir = txn->cur_dir;
+            if (dir->parent == NULL && dir->node->par_dir != 0)
+            {
+                dir->parent = txn_old_dir(txn,
+                                          DIR_AT(txn->filesystem,
+                                                 dir->node->par_dir));
+            }
+            if (dir->node->par_dir != 0)
+            {
+                dir = dir->parent;
+            }
+        }
+        /* Move to root directory */
+        else if (kind == NAME_ROOT)
+        {
+            dir = txn_old_dir(txn, txn->filesystem->root);
+        }
+        /* Move to a subdirectory, or to where a symbolic link points */
+        else if (kind == NAME_REGULAR)
+        {
+            entry = txn_entry(txn, txn->cur_dir, name, length, 0);
+            if (entry != NULL && entry->new_dir != NULL)
+            {
+                dir = entry->new_dir;
+            }
+            else if (entry != NULL && entry->old_dir != NULL
+                     && !entry->removed)
+            {
+                if (entry->sub == NULL)
+                {
+                    entry->sub = txn_old_dir(txn, entry->old_dir);
+                }
+                dir = entry->sub;
+            }
+            else if (entry != NULL && entry->old_file != NULL
+                     && !entry->removed && entry->old_file->symlink != NULL)
+            {
+                follow_link(txn->filesystem,
+                            DIR_AT(txn->filesystem,
+                                   entry->old_file->par_dir),
+                            entry->old_file, &node, &file);
+                if (node != NULL)
+                {
+                    dir = txn_old_dir(txn, node);
+                }
+            }
+        }
+
+        if (dir != NULL)
+        {
+            txn->cur_dir = dir;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Stages rm() of the specified name in the current directory of the
+ * transaction. Files and directories made by the transaction are dropped
+ * right away, while existing ones are removed when it is committed.
+ * - Like rm_h(), directories containing the current directory of the file
+ *   system cannot be removed, returning 0.
+ */
+int fs_txn_rm(Fs_txn *const txn, const char name[])
+{
+    return fs_txn_rm_n(txn, name, name != NULL ? strlen(name) : 0);
+}
+
+/*
+ * Works like fs_txn_rm(), but takes the length of name instead of relying
+ * on a terminating null character, so name does not need to have one.
+ */
+int fs_txn_rm_n(Fs_txn *const txn, const char name[], size_t length)
+{
+    Txn_entry *entry;
+    Dir_node *dir;
+    int result = 0;
+
+    if (txn != NULL && classify_name(name, length) == NAME_REGULAR)
+    {
+        entry = txn_entry(txn, txn->cur_dir, name, length, 0);
+
+        /* Case: A file made by the transaction */
+        if (entry != NULL && entry->new_file != NULL)
+        {
+            remove_file(txn->filesystem, entry->new_file);
+            entry->new_file = NULL;
+            result = 1;
+        }
+        /* Case: A directory made by the transaction, which is freed along
+        with everything made inside of it once the transaction ends */
+        else if (entry != NULL && entry->new_dir != NULL)
+        {
+            entry->new_dir->removed = 1;
+            entry->new_dir = NULL;
+            result = 1;
+        }
+        /* Case: A file or directory that already existed */
+        else if (entry != NULL && !entry->removed
+                 && (entry->old_file != NULL || entry->old_dir != NULL))
+        {
+            result = 1;
+            for (dir = txn->filesystem->cur_dir; dir != NULL;
+                 dir = DIR_AT(txn->filesystem, dir->par_dir))
+            {
+                if (dir == entry->old_dir)
+                {
+                    result = 0;
+                }
+            }
+
+            entry->removed = result;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Applies every change staged by the transaction, and ends it.
+ * - Existing files are touched first. Then each changed directory gets its
+ *   new lists of files and subdirectories by merging its changes, sorted by
+ *   name, into the old lists in a single pass, and publishes both at once.
+ *   The deepest directories come first, so that removing a directory
+ *   always comes after the changes made inside of it.
+ * - Watches receive one event per name that changed in the end, rather
+ *   than one per staged call.
+ * - If memory could not be allocated, then nothing changes, the
+ *   transaction is aborted, and it will return 0.
+ */
+int fs_txn_commit(Fs_txn *txn)
+{
+    Txn_entry *entry, **changes = NULL;
+    Txn_dir *dir, **order = NULL;
+    size_t i, change_count = 0, dir_count = 0;
+    unsigned long j;
+    int result = 0;
+
+    if (txn != NULL)
+    {
+        /* Counts the changes within each directory */
+        for (i = 0; i < txn->entry_capacity; i++)
+        {
+            entry = &txn->entries[i];
+            if (entry->dir != NULL && txn_changed(entry))
+            {
+                entry->dir->change_count += 1;
+                change_count += 1;
+            }
+        }
+        for (dir = txn->old_dirs; dir != NULL; dir = dir->next)
+        {
+            dir_count += 1;
+        }
+
+        changes = malloc(sizeof(*changes) * (change_count + 1));
+        order = malloc(sizeof(*order) * dir_count);
+        if (changes != NULL && order != NULL)
+        {
+            result = 1;
+
+            /* Gives each directory its part of the array of changes */
+            change_count = 0;
+            for (dir = txn->old_dirs; dir != NULL; dir = dir->next)
+            {
+                dir->changes = changes + change_count;
+                change_count += dir->change_count;
+                dir->change_count = 0;
+            }
+            for (dir = txn->new_dirs; dir != NULL; dir = dir->next)
+            {
+                dir->changes = changes + change_count;
+                change_count += dir->change_count;
+                dir->change_count = 0;
+            }
+
+            for (i = 0; i < txn->entry_capacity; i++)
+            {
+                entry = &txn->entries[i];
+                if (entry->dir != NULL && txn_changed(entry))
+                {
+                    entry->dir->changes[entry->dir->change_count] = entry;
+                    entry->dir->change_count += 1;
+                }
+            }
+
+            /* Existing files are touched before anything is removed, since
+            hard links may still reach them afterwards */
+            for (i = 0; i < change_count; i++)
+            {
+                for (j = 0; j < changes[i]->touches; j++)
+                {
+                    touch_file(txn->filesystem, changes[i]->old_file);
+                }
+            }
+
+            i = 0;
+            for (dir = txn->old_dirs; dir != NULL; dir = dir->next)
+            {
+                order[i] = dir;
+                i += 1;
+            }
+
+            qsort(order, dir_count, sizeof(*order), compare_depths);
+            for (i = 0; i < dir_count; i++)
+            {
+                txn_publish(txn, order[i]);
+            }
+
+            /* The index is only rebuilt once every change is in the tree,
+            so that no entry is given two ids */
+            if (txn->filesystem->name_index != NULL)
+            {
+                index_check(txn->filesystem);
+            }
+        }
+
+        free(changes);
+        free(order);
+        txn_end(txn, result);
+    }
+
+    return result;
+}
+
+/*
+ * Ends the transaction without changing anything, freeing the files and
+ * directories it made.
+ */
+void fs_txn_abort(Fs_txn *txn)
+{
+    if (txn != NULL)
+    {
+        txn_end(txn, 0);
+    }
+}
+
+/*
+ * Tells which kind of name the first length characters of name are (one of
+ * the NAME_ constants), looking at each of them once. NULL names are
+ * invalid.
+ */
+int classify_name(const char name[], size_t length)
+{
+    size_t i;
+    int result = NAME_REGULAR;
+
+    if (name == NULL)
+    {
+        result = NAME_INVALID;
+    }
+    else if (length == 0)
+    {
+        result = NAME_EMPTY;
+    }
+    else if (length == 1 && name[0] == '.')
+    {
+        result = NAME_DOT;
+    }
+    else if (length == 2 && name[0] == '.' && name[1] == '.')
+    {
+        result = NAME_DOTDOT;
+    }
+    else if (length == 1 && name[0] == '/')
+    {
+        result = NAME_ROOT;
+    }
+    else
+    {
+        for (i = 0; i < length && result == NAME_REGULAR; i++)
+        {
+            if (name[i] == '/' || name[i] == '\0')
+            {
+                result = NAME_INVALID;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to compare a stored name with the first length
+ * characters of name, which must not contain null characters. Like strcmp(),
+ * it returns a negative number, zero or a positive number if the stored name
+ * comes before, is equal to or comes after name in lexicographic order.
+ */
+static int compare_name(const char stored[], const char name[],
+                        size_t length)
+{
+    int result = strncmp(stored, name, length);
+
+    /* Both start the same way, but the stored name is longer */
+    if (result == 0 && stored[length] != '\0')
+    {
+        result = 1;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to search for a file with the specified name within
+ * the specified directory.
+ */
+static File_node *search_file(FileSystem *const filesystem,
+                              Dir_node *const dir, const char name[],
+                              size_t length)
+{
+    File_node *cur;
+
+    /* Set cur to the head of the file
+    list in the specified directory */
+    cur = FILE_AT(filesystem, dir->file_list);
+
+    /* Traverses the file list to search for the desired file */
+    while (cur != NULL)
+    {
+        if (compare_name(cur->name, name, length) == 0)
+        {
+            return cur;
+        }
+        cur = FILE_AT(filesystem, cur->next_file);
+    }
+
+    /* If a file with the specified name is not found,
+    then it will return NULL */
+    return NULL;
+}
+
+/*
+ * A helper function to search for a directory with the specified name within
+ * the specified directory.
+ */
+static Dir_node *search_subdir(FileSystem *const filesystem,
+                               Dir_node *const dir, const char name[],
+                               size_t length)
+{
+    Dir_node *cur;
+
+    /* Set cur to the head of the subdirectory
+    list in the specified directory */
+    cur = DIR_AT(filesystem, dir->subdir_list);
+
+    /* Traverses the subdirectory list to search for the
+    desired subdirectory */
+    while (cur != NULL)
+    {
+        if (compare_name(cur->name, name, length) == 0)
+        {
+            return cur;
+        }
+        cur = DIR_AT(filesystem, cur->next_dir);
+    }
+
+    /* If a subdirectory with the specified name is not found,
+    then it will return NULL */
+    return NULL;
+}
+
+/*
+ * A helper function to resolve a path of the specified length, starting from
+ * the directory dir, to the directory or file it names. Components are
+ * separated by forward-slashes and may be single periods (.), double adjacent
+ * periods (..), names of subdirectories and files, or names of symbolic
+ * links, which are followed. A path starting with a forward-slash is
+ * resolved from the root instead. The path must not contain null characters.
+ * - On success, 1 is returned and exactly one of dir_out and file_out is
+ *   set, with the other set to NULL. file_out is never a symbolic link.
+ * - If a component does not exist, a file is used as a directory, or more
+ *   than MAX_SYMLINK_DEPTH links are followed, 0 is returned and both are
+ *   set to NULL.
+ */
+static int resolve_path(FileSystem *const filesystem, Dir_node *dir,
+                        const char path[], size_t length,
+                        Dir_node **dir_out, File_node **file_out)
+{
+    Link_walk walk;
+    int result;
+
+    walk.links = 0;
+    walk.steps = NULL;
+    walk.step_count = 0;
+    walk.step_capacity = 0;
+    walk.ok = 1;
+
+    result = walk_path(filesystem, &walk, dir, path, length, dir_out,
+                       file_out);
+
+    free(walk.steps);
+    return result;
+}
+
+/*
+ * A helper function to resolve the symbolic link link, found in the directory
+ * link_dir, to the directory or file it points to. Relative targets are
+ * resolved from link_dir, and results are returned as in resolve_path().
+ */
+static int follow_link(FileSystem *const filesystem, Dir_node *link_dir,
+                       File_node *link, Dir_node **dir_out,
+                       File_node **file_out)
+{
+    Link_walk walk;
+    int result;
+
+    walk.links = 0;
+    walk.steps = NULL;
+    walk.step_count = 0;
+    walk.step_capacity = 0;
+    walk.ok = 1;
+
+    result = walk_link(filesystem, &walk, link_dir, link, dir_out,
+                       file_out);
+
+    free(walk.steps);
+    return result;
+}
+
+/*
+ * A helper function for resolve_path(), resolving the path as part of the
+ * walk, which counts the links followed and records every directory a name
+ * is looked up in.
+ */
+static int walk_path(FileSystem *const filesystem, Link_walk *const walk,
+                     Dir_node *dir, const char path[], size_t length,
+                     Dir_node **dir_out, File_node **file_out)
+{
+    Dir_node *next_dir;
+    File_node *file = NULL;
+    size_t start = 0, end;
+    int kind, result = 1;
+
+    *dir_out = NULL;
+    *file_out = NULL;
+
+    /* Absolute paths are resolved from the root */
+    if (length != 0 && path[0] == '/')
+    {
+        dir = filesystem->root;
+    }
+
+    while (result && start < length)
+    {
+        /* The current component ends at the next forward-slash */
+        end = start;
+        while (end < length && path[end] != '/')
+        {
+            end++;
+        }
+
+        kind = classify_name(path + start, end - start);
+
+        /* A file can only be the last component of a path */
+        if (file != NULL && kind != NAME_EMPTY)
+        {
+            result = 0;
+        }
+        /* Moves to the parent directory, staying at the root */
+        else if (kind == NAME_DOTDOT)
+        {
+            if (dir->par_dir != 0)
+            {
+                dir = DIR_AT(filesystem, dir->par_dir);
+            }
+        }
+        /* Empty components (from repeated forward-slashes) and single
+        periods leave the directory unchanged */
+        else if (kind == NAME_REGULAR)
+        {
+            add_step(walk, dir->self, dir->generation);
+
+            next_dir = search_subdir(filesystem, dir, path + start,
+                                     end - start);
+            if (next_dir != NULL)
+            {
+                dir = next_dir;
+            }
+            else
+            {
+                file = search_file(filesystem, dir, path + start, end - start);
+                if (file == NULL)
+                {
+                    result = 0;
+                }
+                /* Symbolic links are replaced by what they point to */
+                else if (file->symlink != NULL)
+                {
+                    result = walk_link(filesystem, walk, dir, file,
+                                       &next_dir, &file);
+                    if (next_dir != NULL)
+                    {
+                        dir = next_dir;
+                    }
+                }
+            }
+        }
+
+        start = end + 1;
+    }
+
+    if (result)
+    {
+        if (file != NULL)
+        {
+            *file_out = file;
+        }
+        else
+        {
+            *dir_out = dir;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function for follow_link(), resolving the link as part of the
+ * walk.
+ * - The resolution is cached in the link, along with the directories it
+ *   looked names up in, and reused until an entry is created in or removed
+ *   from one of them. This way, links that are used often do not walk
+ *   their target path on every access, and changes elsewhere in the file
+ *   system leave them cached. Reusing it records those directories in the
+ *   walk too, so that the links leading to this one depend on them as well.
+ * - At most MAX_SYMLINK_DEPTH links are followed by the whole walk, whether
+ *   they are nested or one after the other, so that links pointing to each
+ *   other fail with 0 instead of recursing forever.
+ */
+static int walk_link(FileSystem *const filesystem, Link_walk *const walk,
+                     Dir_node *link_dir, File_node *link,
+                     Dir_node **dir_out, File_node **file_out)
+{
+    Symlink_data *const symlink = link->symlink;
+    size_t first_step = walk->step_count, i;
+    int links = walk->links, result = 0;
+
+    *dir_out = NULL;
+    *file_out = NULL;
+
+    /* Case: The cached resolution is still valid */
+    if (link_cached(filesystem, symlink))
+    {
+        walk->links += symlink->cached_links;
+        if (walk->links <= MAX_SYMLINK_DEPTH)
+        {
+            for (i = 0; i < symlink->cached_step_count; i++)
+            {
+                add_step(walk, symlink->cached_steps[i].dir,
+                         symlink->cached_steps[i].gen);
+            }
+
+            *dir_out = symlink->cached_dir;
+            *file_out = symlink->cached_file;
+            result = 1;
+        }
+    }
+    /* Case: The target path has to be walked again */
+    else
+    {
+        walk->links += 1;
+        if (walk->links <= MAX_SYMLINK_DEPTH)
+        {
+            result = walk_path(filesystem, walk, link_dir, symlink->target,
+                               strlen(symlink->target), dir_out, file_out);
+        }
+
+        if (result && cache_link(filesystem, walk, symlink, first_step))
+        {
+            symlink->cached_dir = *dir_out;
+            symlink->cached_file = *file_out;
+            symlink->cached_links = walk->links - links;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to record that a name was looked up in the directory
+ * with the specified number and generation during the walk. The steps
+ * double in size whenever they are full.
+ */
+static void add_step(Link_walk *const walk, Node_index dir,
+                     unsigned long gen)
+{
+    Link_step *new_steps;
+    size_t new_capacity;
+
+    if (walk->ok && walk->step_count == walk->step_capacity)
+    {
+        new_capacity = walk->step_capacity == 0 ? 8
+                                                : walk->step_capacity * 2;
+        new_steps = realloc(walk->steps, sizeof(*new_steps) * new_capacity);
+        if (new_steps != NULL)
+        {
+            walk->steps = new_steps;
+            walk->step_capacity = new_capacity;
+        }
+        else
+        {
+            /* Malloc Error */
+            walk->ok = 0;
+        }
+    }
+
+    if (walk->ok)
+    {
+        walk->steps[walk->step_count].dir = dir;
+        walk->steps[walk->step_count].gen = gen;
+        walk->step_count += 1;
+    }
+}
+
+/*
+ * A helper function to check whether the cached resolution of a symbolic
+ * link is still valid, which is when none of the directories it looked
+ * names up in has changed since. They are checked in the order they were
+ * walked, so a directory is only looked at while every directory leading
+ * to it is unchanged, and therefore still holds it.
+ * Returns 1 if it is valid, and 0 otherwise.
+ */
+static int link_cached(FileSystem *const filesystem,
+                       Symlink_data *const symlink)
+{
+    Link_step *step;
+    size_t i;
+    int result;
+
+    result = symlink->cached_dir != NULL || symlink->cached_file != NULL;
+    for (i = 0; result && i < symlink->cached_step_count; i++)
+    {
+        step = &symlink->cached_steps[i];
+        result = DIR_AT(filesystem, step->dir)->generation == step->gen;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to replace the cached steps of a symbolic link with
+ * those the walk has recorded from first_step on, while resolving it. The
+ * caller then caches the resolution itself.
+ * - If memory could not be allocated, or the walk is missing steps, then
+ *   nothing is cached and it will return 0.
+ */
+static int cache_link(FileSystem *const filesystem, Link_walk *const walk,
+                      Symlink_data *const symlink, size_t first_step)
+{
+    size_t count = walk->step_count - first_step;
+    Link_step *steps = NULL;
+    int result;
+
+    drop_link(filesystem, symlink);
+
+    if (walk->ok && count != 0)
+    {
+        steps = fs_alloc(filesystem, sizeof(*steps) * count);
+    }
+
+    result = walk->ok && (count == 0 || steps != NULL);
+    if (result && count != 0)
+    {
+        memcpy(steps, walk->steps + first_step, sizeof(*steps) * count);
+        symlink->cached_steps = steps;
+        symlink->cached_step_count = count;
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to drop the cached resolution of a symbolic link,
+ * freeing its steps.
+ */
+static void drop_link(FileSystem *const filesystem,
+                      Symlink_data *const symlink)
+{
+    fs_free(filesystem, symlink->cached_steps,
+            sizeof(*symlink->cached_steps) * symlink->cached_step_count);
+    symlink->cached_dir = NULL;
+    symlink->cached_file = NULL;
+    symlink->cached_steps = NULL;
+    symlink->cached_step_count = 0;
+    symlink->cached_links = 0;
+}
+
+/*
+ * A helper function to insert a new file with the specified name (of the
+ * specified length) into the file list of the file system's current
+ * directory, keeping the list in lexicographic order. The name must not
+ * already be taken.
+ * - Regular files and hard links pass the File_data they share, and leave
+ *   target as NULL.
+ * - Symbolic links pass the path they point to, and leave data as NULL.
+ * If memory could not be allocated, nothing is modified and 0 is returned.
+ */
+static int insert_file(FileSystem *const filesystem, const char name[],
+                       size_t length, File_data *data, const char target[],
+                       size_t target_length)
+{
+    File_node *cur, *prev = NULL, *new_file;
+    int result = 0;
+
+    new_file = make_file(filesystem, filesystem->cur_dir, name, length, data,
+                         target, target_length);
+    if (new_file != NULL)
+    {
+        result = 1;
+
+        /* Set cur to the head of the file
+        list in the current directory */
+        cur = FILE_AT(filesystem, filesystem->cur_dir->file_list);
+
+        /* Find location to insert node within file_list */
+        while (cur != NULL && compare_name(cur->name, name, length) < 0)
+        {
+            prev = cur;
+            cur = FILE_AT(filesystem, cur->next_file);
+        }
+        new_file->next_file = cur != NULL ? cur->self : 0;
+
+        /* Case: File is inserted at the head */
+        if (prev == NULL)
+        {
+            filesystem->cur_dir->file_list = new_file->self;
+        }
+        /* Case: File is inserted elsewhere */
+        else
+        {
+            prev->next_file = new_file->self;
+        }
+
+        if (filesystem->name_index != NULL)
+        {
+            index_add(filesystem, NULL, new_file);
+            index_check(filesystem);
+        }
+        if (filesystem->watches != NULL)
+        {
+            notify(filesystem, filesystem->cur_dir, FS_EVENT_CREATE, name,
+                   length);
+        }
+
+        mark_dirty(filesystem, filesystem->cur_dir);
+        mark_changed(filesystem, filesystem->cur_dir);
+    }
+
+    return result;
+}
+
+/*
+ * Makes a file with the specified name in dir, without adding it to the
+ * directory's list of files. Like insert_file(), regular files and hard
+ * links pass their data, while symbolic links pass their target and leave
+ * data as NULL.
+ * - If memory could not be allocated, then nothing is modified and it will
+ *   return NULL.
+ */
+File_node *make_file(FileSystem *const filesystem, Dir_node *dir,
+                     const char name[], size_t length, File_data *data,
+                     const char target[], size_t target_length)
+{
+    File_node *new_file;
+    Symlink_data *new_symlink = NULL;
+    Node_index index;
+    char *new_name, *new_target = NULL;
+
+    new_file = alloc_node(filesystem, &filesystem->files, sizeof(*new_file),
+                          &index);
+    new_name = fs_alloc(filesystem, sizeof(char) * (length + 1));
+    if (target != NULL)
+    {
+        new_symlink = fs_alloc(filesystem, sizeof(*new_symlink));
+        new_target = fs_alloc(filesystem,
+                              sizeof(char) * (target_length + 1));
+    }
+
+    if (new_file != NULL && new_name != NULL
+        && (target == NULL || (new_symlink != NULL && new_target != NULL)))
+    {
+        /* Copies name and target to the allocated strings */
+        memcpy(new_name, name, length);
+        new_name[length] = '\0';
+        if (target != NULL)
+        {
+            memcpy(new_target, target, target_length);
+            new_target[target_length] = '\0';
+
+            new_symlink->target = new_target;
+            new_symlink->cached_dir = NULL;
+            new_symlink->cached_file = NULL;
+            new_symlink->cached_steps = NULL;
+            new_symlink->cached_step_count = 0;
+            new_symlink->cached_links = 0;
+        }
+
+        /* Initializes new file structure members */
+        new_file->name = new_name;
+        new_file->data = data;
+        new_file->symlink = new_symlink;
+        new_file->next_file = 0;
+        new_file->next_link = 0;
+        new_file->par_dir = dir->self;
+        new_file->self = index;
+        new_file->ino = 0;
+        new_file->name_id = 0;
+
+        if (data != NULL)
+        {
+            new_file->next_link = data->links;
+            data->links = index;
+            data->link_count += 1;
+        }
+    }
+    else
+    {
+        /* Malloc Error */
+        if (new_file != NULL)
+        {
+            free_node(&filesystem->files, new_file, index);
+        }
+        fs_free(filesystem, new_name, sizeof(char) * (length + 1));
+        if (target != NULL)
+        {
+            fs_free(filesystem, new_symlink, sizeof(*new_symlink));
+            fs_free(filesystem, new_target,
+                    sizeof(char) * (target_length + 1));
+        }
+        new_file = NULL;
+    }
+
+    return new_file;
+}
+
+/*
+ * Makes a subdirectory with the specified name in parent, without adding it
+ * to the parent's list of subdirectories.
+ * - If memory could not be allocated, then nothing is modified and it will
+ *   return NULL.
+ */
+Dir_node *make_dir(FileSystem *const filesystem, Dir_node *parent,
+                   const char name[], size_t length)
+{
+    Dir_node *new_dir;
+    Node_index index;
+    char *new_name, *new_path;
+    size_t path_length = strlen(parent->path);
+
+    new_dir = alloc_node(filesystem, &filesystem->dirs, sizeof(*new_dir),
+                         &index);
+    new_name = fs_alloc(filesystem, sizeof(char) * (length + 1));
+    new_path = fs_alloc(filesystem,
+                        sizeof(char) * (length + path_length + 2));
+
+    if (new_dir != NULL && new_name != NULL && new_path != NULL)
+    {
+        /* Copies name to the allocated name string */
+        memcpy(new_name, name, length);
+        new_name[length] = '\0';
+        /* Creates path name to the allocated path string */
+        memcpy(new_path, parent->path, path_length);
+        new_path[path_length] = '/';
+        memcpy(new_path + path_length + 1, name, length);
+        new_path[path_length + 1 + length] = '\0';
+
+        /* Initializes new directory structure members */
+        new_dir->name = new_name;
+        new_dir->path = new_path;
+        new_dir->file_list = 0;
+        new_dir->subdir_list = 0;
+        new_dir->next_dir = 0;
+        new_dir->par_dir = parent->self;
+        new_dir->self = index;
+        new_dir->ino = 0;
+        new_dir->name_id = 0;
+        new_dir->hash[0] = 0;
+        new_dir->hash[1] = 0;
+        new_dir->hash_valid = 0;
+        new_dir->generation = filesystem->generation;
+    }
+    else
+    {
+        /* Malloc Error */
+        if (new_dir != NULL)
+        {
+            free_node(&filesystem->dirs, new_dir, index);
+        }
+        fs_free(filesystem, new_name, sizeof(char) * (length + 1));
+        fs_free(filesystem, new_path,
+                sizeof(char) * (length + path_length + 2));
+        new_dir = NULL;
+    }
+
+    return new_dir;
+}
+
+/*
+ * A helper function to increment the timestamp of the specified file, or of
+ * the file a symbolic link points to. Links pointing to directories leave
+ * them unmodified, and dangling links return 0.
+ */
+static int touch_file(FileSystem *const filesystem, File_node *const file)
+{
+    Dir_node *dir;
+    File_node *target = file, *link;
+    int result = 1;
+
+    if (file->symlink != NULL)
+    {
+        result = follow_link(filesystem, DIR_AT(filesystem, file->par_dir),
+                             file, &dir, &target);
+    }
+
+    if (target != NULL)
+    {
+        target->data->timestamp += 1;
+
+        if (filesystem->watches != NULL)
+        {
+            notify(filesystem, DIR_AT(filesystem, target->par_dir),
+                   FS_EVENT_MODIFY, target->name, strlen(target->name));
+        }
+
+        /* The new timestamp is seen in every directory linking to it */
+        for (link = FILE_AT(filesystem, target->data->links); link != NULL;
+             link = FILE_AT(filesystem, link->next_link))
+        {
+            mark_dirty(filesystem, DIR_AT(filesystem, link->par_dir));
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print the specified file's name followed by its
+ * timestamp. Symbolic links are followed first, printing the whole directory
+ * they point to, or the timestamp of their file under the link's name.
+ * Dangling links return 0.
+ */
+static int ls_file(FileSystem *const filesystem, File_node *const file)
+{
+    Dir_node *dir = NULL;
+    File_node *target = file;
+    char timestamp[32];
+    int result = 1;
+
+    if (file->symlink != NULL)
+    {
+        result = follow_link(filesystem, DIR_AT(filesystem, file->par_dir),
+                             file, &dir, &target);
+    }
+
+    if (dir != NULL)
+    {
+        print_whole_dir(filesystem, dir);
+    }
+    else if (target != NULL)
+    {
+        sprintf(timestamp, " %d\n", target->data->timestamp);
+        print_text(filesystem, file->name);
+        print_text(filesystem, timestamp);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to assign an inode to the specified directory or file,
+ * with the other one passed as NULL. Freed inodes are reused first, and the
+ * table doubles in size when it is full.
+ * Returns the inode number, or 0 if memory could not be allocated.
+ */
+static unsigned long assign_inode(FileSystem *const filesystem,
+                                  Dir_node *dir, File_node *file)
+{
+    Inode_entry *new_table;
+    unsigned long new_capacity, ino = 0;
+
+    /* Case: A freed inode can be reused */
+    if (filesystem->free_inode != 0)
+    {
+        ino = filesystem->free_inode;
+        filesystem->free_inode = filesystem->inodes[ino].next_free;
+    }
+    /* Case: A new inode is added at the end of the table */
+    else
+    {
+        if (filesystem->inode_count == filesystem->inode_capacity)
+        {
+            new_capacity = filesystem->inode_capacity == 0
+                               ? 16 : filesystem->inode_capacity * 2;
+            new_table = realloc(filesystem->inodes,
+                                sizeof(*new_table) * new_capacity);
+            if (new_table != NULL)
+            {
+                filesystem->bytes_used += sizeof(*new_table)
+                                          * (new_capacity
+                                             - filesystem->inode_capacity);
+                filesystem->inodes = new_table;
+                filesystem->inode_capacity = new_capacity;
+
+                /* Inode 0 is reserved to mean "no inode" */
+                if (filesystem->inode_count == 0)
+                {
+                    filesystem->inodes[0].dir = NULL;
+                    filesystem->inodes[0].file = NULL;
+                    filesystem->inodes[0].gen = 0;
+                    filesystem->inodes[0].next_free = 0;
+                    filesystem->inode_count = 1;
+                }
+            }
+        }
+
+        if (filesystem->inode_count < filesystem->inode_capacity)
+        {
+            ino = filesystem->inode_count;
+            filesystem->inodes[ino].gen = filesystem->inode_epoch;
+            filesystem->inode_count += 1;
+        }
+    }
+
+    if (ino != 0)
+    {
+        filesystem->inodes[ino].dir = dir;
+        filesystem->inodes[ino].file = file;
+        filesystem->inodes[ino].next_free = 0;
+
+        if (dir != NULL)
+        {
+            dir->ino = ino;
+        }
+        else
+        {
+            file->ino = ino;
+        }
+    }
+
+    return ino;
+}
+
+/*
+ * A helper function to find the node referred to by handle, storing it in
+ * dir_out or file_out and setting the other one to NULL.
+ * Returns 0 if the handle is stale, meaning that its inode has been freed
+ * (and possibly reused) since the handle was created.
+ */
+static int find_inode(FileSystem *const filesystem, Fs_handle handle,
+                      Dir_node **dir_out, File_node **file_out)
+{
+    Inode_entry *entry;
+    int result = 0;
+
+    *dir_out = NULL;
+    *file_out = NULL;
+
+    if (handle.ino != 0 && handle.ino < filesystem->inode_count)
+    {
+        entry = &filesystem->inodes[handle.ino];
+        if (entry->gen == handle.gen
+            && (entry->dir != NULL || entry->file != NULL))
+        {
+            *dir_out = entry->dir;
+            *file_out = entry->file;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to free the specified inode so that it can be reused.
+ * Its generation is incremented, which makes every existing handle to it
+ * stale. Inode 0 (meaning no inode was assigned) is ignored.
+ */
+static void release_inode(FileSystem *const filesystem, unsigned long ino)
+{
+    if (ino != 0)
+    {
+        filesystem->inodes[ino].dir = NULL;
+        filesystem->inodes[ino].file = NULL;
+        filesystem->inodes[ino].gen += 1;
+        filesystem->inodes[ino].next_free = filesystem->free_inode;
+        filesystem->free_inode = ino;
+    }
+}
+
+/*
+ * A helper function to report a change to the entry with the specified
+ * name in dir, as one of the FS_EVENT_ constants, to the file system's
+ * watches. The directory is given an inode, so that events can refer to it
+ * by handle. Only called while the file system has watches.
+ */
+static void notify(FileSystem *const filesystem, Dir_node *dir, int kind,
+                   const char name[], size_t length)
+{
+    Fs_handle handle;
+
+    handle.ino = dir->ino;
+    if (handle.ino == 0)
+    {
+        handle.ino = assign_inode(filesystem, dir, NULL);
+    }
+    handle.gen = handle.ino != 0 ? filesystem->inodes[handle.ino].gen : 0;
+
+    watch_notify(filesystem, dir, handle, kind, name, length);
+}
+
+/*
+ * A helper function to print the contents of the whole specified directory.
+ * To do this, the function takes two steps:
+ * 1. It will create an ordered linked list (arranged in lexicographic order)
+ *    storing the names of all files and subdirectories (if any) within the
+ *    specified directory.
+ * 2. Prints all the names being stored in the ordered linked list while
+ *    deallocating any memory being used by it. We can safely do this since
+ *    the linked list will be of no use for us in the future.
+ */
+static void print_whole_dir(FileSystem *const filesystem,
+                            Dir_node *const dir)
+{
+    Name_node *name_list = NULL, *printed_name;
+    Dir_node *cur_dir;
+    File_node *cur_file;
+
+    /* Make an ordered Linked List of File/Directory names. */
+
+    /* Traverse directory's files. */
+    cur_file = FILE_AT(filesystem, dir->file_list);
+
+    while (cur_file != NULL)
+    {
+        name_list = insert_name(name_list, cur_file->name,
+                                cur_file->symlink != NULL ? "@" : "");
+        cur_file = FILE_AT(filesystem, cur_file->next_file);
+    }
+
+    /* Traverse directory's subdirectories. */
+    cur_dir = DIR_AT(filesystem, dir->subdir_list);
+
+    while (cur_dir != NULL)
+    {
+        name_list = insert_name(name_list, cur_dir->name, "/");
+        cur_dir = DIR_AT(filesystem, cur_dir->next_dir);
+    }
+
+    /* Start printing names. If the name_list is NULL, it indicates that
+    the directory is empty, and therefore, nothing is printed. */
+    while (name_list != NULL)
+    {
+        print_text(filesystem, name_list->name);
+        print_text(filesystem, "\n");
+
+        /* Set printed_name to the name that has just been printed
+        and move name_list to the next node. */
+        printed_name = name_list;
+        name_list = name_list->next_name;
+
+        /* Free allocated memory being used by printed_name. */
+        free(printed_name->name);
+        free(printed_name);
+    }
+}
+
+/*
+ * Prints text to the file system's output, which is the standard output
+ * unless it has been changed with fs_set_output().
+ */
+void print_text(FileSystem *const filesystem, const char text[])
+{
+    if (filesystem->print != NULL)
+    {
+        filesystem->print(filesystem->print_context, text);
+    }
+    else
+    {
+        fputs(text, stdout);
+    }
+}
+
+/*
+ * A helper function to assist the print_whole_dir() function in creating
+ * an ordered linked list of names.
+ * - The head parameter represents the head of the name linked list.
+ * - The name parameter represents the name to be stored within the node.
+ * - The suffix parameter is appended to the stored name. This distinction
+ *   is important since directories are printed with a trailing
+ *   forward-slash, and symbolic links with a trailing at sign (@).
+ */
+static Name_node *insert_name(Name_node *head, char *name,
+                              const char suffix[])
+{
+    Name_node *cur, *prev = NULL, *new_node;
+    char *new_name;
+
+    /* The boolean value flag is used to indicate whether an error has
+    occured in the process of allocating memory, to prevent the function
+    from executing more statements and causing the program to crash. */
+    int flag = 1;
+
+    /* Initialize new_name node. */
+    new_node = malloc(sizeof(*new_node));
+
+    if (new_node != NULL)
+    {
+        new_name = malloc(sizeof(char) * (strlen(name) + strlen(suffix) + 1));
+        if (new_name != NULL)
+        {
+            /* Concatenate the suffix to the end of the name */
+            strcpy(new_name, name);
+            strcat(new_name, suffix);
+
+            /* Initialize values of new_name node */
+            new_node->name = new_name;
+            new_node->next_name = NULL;
+        }
+        else
+        {
+            /* Malloc Error */
+            flag = 0;
+        }
+    }
+    else
+    {
+        /* Malloc Error */
+        flag = 0;
+    }
+
+    /* Insert the new_name node into the linked list. */
+    if (flag)
+    {
+        /* If head is NULL, it means that the node to be
+        inserted is the first node in the linked list. */
+        if (head == NULL)
+        {
+            return new_node;
+        }
+
+        cur = head;
+
+        /* Find a location to insert the node */
+        while (cur != NULL && strcmp(name, cur->name) >= 0)
+        {
+            prev = cur;
+            cur = cur->next_name;
+        }
+
+        /* Initializes the pointer to the next node. */
+        new_node->next_name = cur;
+
+        /* Case: File is inserted at the head */
+        if (prev == NULL)
+        {
+            head = new_node;
+        }
+
+        /* Case: File is inserted elsewhere */
+        else
+        {
+            prev->next_name = new_node;
+        }
+    }
+
+    return head;
+}
+
+/*
+ * A helper method to search for a directory and remove it from the list
+ * of subdirectories. This function is distinct from simply searching for
+ * a directory using the search_dir() helper function and removing it using
+ * the remove_dir() helper function as it also modifies the links within
+ * the subdirectory linked list.
+ */
+static int search_and_remove_dir(FileSystem *const filesystem,
+                                 Dir_node *const cur_dir, const char name[],
+                                 size_t length)
+{
+    Dir_node *cur, *prev = NULL;
+    int result = 0;
+
+    /* Traverses the subdirectory list to look for the desired subdirectory */
+    cur = DIR_AT(filesystem, cur_dir->subdir_list);
+
+    while (cur != NULL && compare_name(cur->name, name, length) != 0)
+    {
+        prev = cur;
+        cur = DIR_AT(filesystem, cur->next_dir);
+    }
+
+    /* If cur is NULL, it would indicate that the subdirectory with the
+    specified name is not found, and result would stay 0. */
+    if (cur != NULL)
+    {
+        result = 1;
+
+        /* Case: The subdirectory to be removed is the head of the list */
+        if (prev == NULL)
+        {
+            cur_dir->subdir_list = cur->next_dir;
+        }
+
+        /* Case: The subdirectory to be removed is between the list */
+        else
+        {
+            prev->next_dir = cur->next_dir;
+        }
+
+        /* Remove all subdirectory contents and free all
+        allocated memory being used by it */
+        remove_dir(filesystem, cur);
+    }
+
+    return result;
+}
+
+/*
+ * A recursive helper function used to remove all the contents within a
+ * directory, which includes all files and subdirectories within it, and
+ * frees all allocated memory being used by any of the content. Inodes
+ * assigned to any of them are freed as well.
+ */
+static void remove_dir(FileSystem *const filesystem, Dir_node *dir)
+{
+    File_node *cur_file, *file_to_be_removed;
+    Dir_node *cur_dir, *dir_to_be_removed;
+
+    if (dir != NULL)
+    {
+        /* Remove all files within this directory */
+        cur_file = FILE_AT(filesystem, dir->file_list);
+
+        /* If cur_file is NULL, this would indicate
+        that the directory has no files */
+        while (cur_file != NULL)
+        {
+            file_to_be_removed = cur_file;
+            cur_file = FILE_AT(filesystem, cur_file->next_file);
+
+            remove_file(filesystem, file_to_be_removed);
+        }
+
+        /* Remove all subdirectories within this directory */
+        cur_dir = DIR_AT(filesystem, dir->subdir_list);
+
+        /* If cur_dir is NULL, this would indicate
+        that the directory has no subdirectories */
+        while (cur_dir != NULL)
+        {
+            dir_to_be_removed = cur_dir;
+            cur_dir = DIR_AT(filesystem, cur_dir->next_dir);
+
+            remove_dir(filesystem, dir_to_be_removed); /* Recursive call */
+        }
+
+        if (filesystem->watches != NULL && dir->ino != 0)
+        {
+            watch_forget(filesystem, dir);
+        }
+        release_inode(filesystem, dir->ino);
+        if (filesystem->name_index != NULL)
+        {
+            index_remove(filesystem, dir->name_id);
+        }
+
+        /* Free allocated memory being used by other directory struct
+        members. The name and path of the root are never allocated. */
+        if (dir->par_dir != 0)
+        {
+            fs_free(filesystem, dir->name,
+                    sizeof(char) * (strlen(dir->name) + 1));
+            fs_free(filesystem, dir->path,
+                    sizeof(char) * (strlen(dir->path) + 1));
+        }
+
+        /* Give the directory itself back to the directory table */
+        free_node(&filesystem->dirs, dir, dir->self);
+    }
+}
+
+/*
+ * A helper method to search for a file and remove it from the list of files.
+ * This function is distinct from simply searching for a file using the
+ * search_file() helper function and removing it using the remove_file()
+ * helper function as it also modifies the links within the file linked list.
+ */
+static int search_and_remove_file(FileSystem *const filesystem,
+                                  Dir_node *const cur_dir, const char name[],
+                                  size_t length)
+{
+    File_node *cur, *prev = NULL;
+    int result = 0;
+
+    /* Traverses the file list to look for the desired file */
+    cur = FILE_AT(filesystem, cur_dir->file_list);
+
+    while (cur != NULL && compare_name(cur->name, name, length) != 0)
+    {
+        prev = cur;
+        cur = FILE_AT(filesystem, cur->next_file);
+    }
+
+    /* If cur is NULL, it would indicate that the file with the
+    specified name is not found, and result would stay 0. */
+    if (cur != NULL)
+    {
+        result = 1;
+
+        /* Case: The file to be removed is the head of the list */
+        if (prev == NULL)
+        {
+            cur_dir->file_list = cur->next_file;
+        }
+
+        /* Case: The file to be removed is between the list */
+        else
+        {
+            prev->next_file = cur->next_file;
+        }
+
+        /* Remove all file contents and free all
+        allocated memory being used by it */
+        remove_file(filesystem, cur);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function used to remove all the contents within a
+ * file, namely its name and timestamp. The timestamp is shared between
+ * hard links, so it is only freed together with the last link.
+ */
+static void remove_file(FileSystem *const filesystem, File_node *file)
+{
+    File_node *cur_link, *prev_link = NULL;
+
+    if (file != NULL)
+    {
+        release_inode(filesystem, file->ino);
+        if (filesystem->name_index != NULL)
+        {
+            index_remove(filesystem, file->name_id);
+        }
+
+        if (file->data != NULL)
+        {
+            /* Takes the file out of the list of links to its data */
+            cur_link = FILE_AT(filesystem, file->data->links);
+            while (cur_link != file)
+            {
+                prev_link = cur_link;
+                cur_link = FILE_AT(filesystem, cur_link->next_link);
+            }
+
+            if (prev_link == NULL)
+            {
+                file->data->links = file->next_link;
+            }
+            else
+            {
+                prev_link->next_link = file->next_link;
+            }
+
+            file->data->link_count -= 1;
+            if (file->data->link_count == 0)
+            {
+                fs_free(filesystem, file->data, sizeof(*file->data));
+            }
+        }
+
+        if (file->symlink != NULL)
+        {
+            drop_link(filesystem, file->symlink);
+            fs_free(filesystem, file->symlink->target,
+                    sizeof(char) * (strlen(file->symlink->target) + 1));
+            fs_free(filesystem, file->symlink, sizeof(*file->symlink));
+        }
+
+        fs_free(filesystem, file->name,
+                sizeof(char) * (strlen(file->name) + 1));
+        free_node(&filesystem->files, file, file->self);
+    }
+}
+
+/*
+ * A helper function to clear the hash of the specified directory and of
+ * every directory above it, after something inside of it has changed. The
+ * directories above an invalid hash are always invalid too, so it stops at
+ * the first one that already is.
+ */
+static void mark_dirty(FileSystem *const filesystem, Dir_node *dir)
+{
+    while (dir != NULL && dir->hash_valid)
+    {
+        dir->hash_valid = 0;
+        dir = DIR_AT(filesystem, dir->par_dir);
+    }
+}
+
+/*
+ * A helper function to give the specified directory a new generation,
+ * after an entry has been created in or removed from it. This invalidates
+ * the cached resolutions of the symbolic links that looked names up in it,
+ * and only those.
+ */
+static void mark_changed(FileSystem *const filesystem, Dir_node *dir)
+{
+    filesystem->generation += 1;
+    dir->generation = filesystem->generation;
+}
+
+/*
+ * A helper function to return the hash of everything within the specified
+ * directory, namely the names of its files and subdirectories in order, the
+ * timestamps of its files, the targets of its symbolic links and the hashes
+ * of its subdirectories. Only directories that changed since their hash was
+ * last computed are looked at again.
+ * - The hash is 64 bits wide, as two lanes of 32 bits which are fed the
+ *   same bytes but start from different values.
+ */
+static const unsigned long *dir_hash(FileSystem *const filesystem,
+                                     Dir_node *const dir)
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    const unsigned long *subdir_hash;
+    unsigned long hash[2], timestamp = 0;
+    int i;
+
+    if (!dir->hash_valid)
+    {
+        hash[0] = HASH_BASIS;
+        hash[1] = HASH_BASIS_2;
+
+        /* Each entry starts with a letter telling its kind, so that
+        entries of different kinds can never hash the same way */
+        for (cur_file = FILE_AT(filesystem, dir->file_list);
+             cur_file != NULL;
+             cur_file = FILE_AT(filesystem, cur_file->next_file))
+        {
+            if (cur_file->data != NULL)
+            {
+                timestamp = (unsigned long)cur_file->data->timestamp;
+            }
+
+            for (i = 0; i < 2; i++)
+            {
+                if (cur_file->symlink != NULL)
+                {
+                    hash[i] = hash_bytes(hash[i], "L", 1);
+                    hash[i] = hash_bytes(hash[i], cur_file->name,
+                                         strlen(cur_file->name) + 1);
+                    hash[i] = hash_bytes(hash[i], cur_file->symlink->target,
+                                         strlen(cur_file->symlink->target)
+                                             + 1);
+                }
+                else
+                {
+                    hash[i] = hash_bytes(hash[i], "F", 1);
+                    hash[i] = hash_bytes(hash[i], cur_file->name,
+                                         strlen(cur_file->name) + 1);
+                    hash[i] = hash_number(hash[i], timestamp);
+                }
+            }
+        }
+
+        for (cur_dir = DIR_AT(filesystem, dir->subdir_list);
+             cur_dir != NULL;
+             cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+        {
+            subdir_hash = dir_hash(filesystem, cur_dir); /* Recursive call */
+            for (i = 0; i < 2; i++)
+            {
+                hash[i] = hash_bytes(hash[i], "D", 1);
+                hash[i] = hash_bytes(hash[i], cur_dir->name,
+                                     strlen(cur_dir->name) + 1);
+                hash[i] = hash_number(hash[i], subdir_hash[0]);
+                hash[i] = hash_number(hash[i], subdir_hash[1]);
+            }
+        }
+
+        dir->hash[0] = hash[0];
+        dir->hash[1] = hash[1];
+        dir->hash_valid = 1;
+    }
+
+    return dir->hash;
+}
+
+/*
+ * A helper function to add length bytes to a hash, returning the new hash.
+ * Hashes are 32 bits wide on every platform.
+ */
+static unsigned long hash_bytes(unsigned long hash, const char bytes[],
+                                size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        hash = ((hash ^ (unsigned char)bytes[i]) * HASH_PRIME) & HASH_MASK;
+    }
+
+    return hash;
+}
+
+/*
+ * A helper function to add the lowest 4 bytes of number to a hash, which
+ * hold every number hashed (timestamps, ids and other hashes), returning
+ * the new hash.
+ */
+static unsigned long hash_number(unsigned long hash, unsigned long number)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        hash = ((hash ^ (number & 0xFF)) * HASH_PRIME) & HASH_MASK;
+        number >>= 8;
+    }
+
+    return hash;
+}
+
+/*
+ * A recursive helper function for fs_diff(), printing the differences
+ * between the directories a_dir of a and b_dir of b, which are at the same
+ * path in their file systems, wherever a prints. Nothing is printed if
+ * their hashes match.
+ * Returns the number of entries printed.
+ */
+static long diff_dir(FileSystem *const a, FileSystem *const b,
+                     Dir_node *const a_dir, Dir_node *const b_dir)
+{
+    const unsigned long *a_hash = dir_hash(a, a_dir);
+    const unsigned long *b_hash = dir_hash(b, b_dir);
+    long result = 0;
+
+    if (a_hash[0] != b_hash[0] || a_hash[1] != b_hash[1])
+    {
+        /* Removals are printed before everything else */
+        result += diff_files(a, b, a_dir, b_dir, 1);
+        result += diff_subdirs(a, b, a_dir, b_dir, 1);
+        result += diff_files(a, b, a_dir, b_dir, 0);
+        result += diff_subdirs(a, b, a_dir, b_dir, 0);
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print the differences between the files of a_dir and
+ * b_dir. Since both lists are in order, they are walked side by side.
+ * - If removals is 1, only the files missing from b_dir are printed.
+ * - If removals is 0, only the files added or changed in b_dir are printed.
+ * Returns the number of entries printed.
+ */
+static long diff_files(FileSystem *const a, FileSystem *const b,
+                       Dir_node *const a_dir, Dir_node *const b_dir,
+                       int removals)
+{
+    File_node *a_file = FILE_AT(a, a_dir->file_list);
+    File_node *b_file = FILE_AT(b, b_dir->file_list);
+    long result = 0;
+    int order, changed;
+
+    while (a_file != NULL || b_file != NULL)
+    {
+        if (a_file == NULL)
+        {
+            order = 1;
+        }
+        else if (b_file == NULL)
+        {
+            order = -1;
+        }
+        else
+        {
+            order = strcmp(a_file->name, b_file->name);
+        }
+
+        /* Case: The file is only in a_dir */
+        if (order < 0)
+        {
+            if (removals)
+            {
+                print_entry(a, "- ", a_dir, a_file, NULL);
+                result++;
+            }
+            a_file = FILE_AT(a, a_file->next_file);
+        }
+        /* Case: The file is only in b_dir */
+        else if (order > 0)
+        {
+            if (!removals)
+            {
+                print_entry(a, "+ ", b_dir, b_file, NULL);
+                result++;
+            }
+            b_file = FILE_AT(b, b_file->next_file);
+        }
+        /* Case: The file is in both, and may have changed */
+        else
+        {
+            if (a_file->symlink == NULL || b_file->symlink == NULL)
+            {
+                changed = a_file->symlink != b_file->symlink
+                          || a_file->data->timestamp
+                                 != b_file->data->timestamp;
+            }
+            else
+            {
+                changed = strcmp(a_file->symlink->target,
+                                 b_file->symlink->target) != 0;
+            }
+
+            if (!removals && changed)
+            {
+                print_entry(a, "~ ", b_dir, b_file, NULL);
+                result++;
+            }
+            a_file = FILE_AT(a, a_file->next_file);
+            b_file = FILE_AT(b, b_file->next_file);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print the differences between the subdirectories of
+ * a_dir and b_dir, walking both lists side by side like diff_files().
+ * - If removals is 1, only the subdirectories missing from b_dir are
+ *   printed.
+ * - If removals is 0, the subdirectories added to b_dir are printed with
+ *   everything inside of them, and those in both are compared.
+ * Returns the number of entries printed.
+ */
+static long diff_subdirs(FileSystem *const a, FileSystem *const b,
+                         Dir_node *const a_dir, Dir_node *const b_dir,
+                         int removals)
+{
+    Dir_node *a_subdir = DIR_AT(a, a_dir->subdir_list);
+    Dir_node *b_subdir = DIR_AT(b, b_dir->subdir_list);
+    long result = 0;
+    int order;
+
+    while (a_subdir != NULL || b_subdir != NULL)
+    {
+        if (a_subdir == NULL)
+        {
+            order = 1;
+        }
+        else if (b_subdir == NULL)
+        {
+            order = -1;
+        }
+        else
+        {
+            order = strcmp(a_subdir->name, b_subdir->name);
+        }
+
+        /* Case: The subdirectory is only in a_dir */
+        if (order < 0)
+        {
+            if (removals)
+            {
+                print_entry(a, "- ", a_dir, NULL, a_subdir);
+                result++;
+            }
+            a_subdir = DIR_AT(a, a_subdir->next_dir);
+        }
+        /* Case: The subdirectory is only in b_dir */
+        else if (order > 0)
+        {
+            if (!removals)
+            {
+                result += print_added_dir(a, b, b_subdir);
+            }
+            b_subdir = DIR_AT(b, b_subdir->next_dir);
+        }
+        /* Case: The subdirectory is in both */
+        else
+        {
+            if (!removals)
+            {
+                result += diff_dir(a, b, a_subdir, b_subdir);
+            }
+            a_subdir = DIR_AT(a, a_subdir->next_dir);
+            b_subdir = DIR_AT(b, b_subdir->next_dir);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A recursive helper function for fs_diff(), printing the specified
+ * directory of b as added, followed by everything inside of it, wherever
+ * a prints.
+ * Returns the number of entries printed.
+ */
+static long print_added_dir(FileSystem *const a, FileSystem *const b,
+                            Dir_node *const dir)
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    long result = 1;
+
+    print_entry(a, "+ ", DIR_AT(b, dir->par_dir), NULL, dir);
+
+    for (cur_file = FILE_AT(b, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(b, cur_file->next_file))
+    {
+        print_entry(a, "+ ", dir, cur_file, NULL);
+        result++;
+    }
+
+    for (cur_dir = DIR_AT(b, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(b, cur_dir->next_dir))
+    {
+        result += print_added_dir(a, b, cur_dir); /* Recursive call */
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to print a line of fs_diff(), made of change followed
+ * by the path of either file or subdir (with the other one passed as NULL)
+ * within the directory dir.
+ */
+static void print_entry(FileSystem *const filesystem, const char change[],
+                        Dir_node *const dir, File_node *const file,
+                        Dir_node *const subdir)
+{
+    char timestamp[32];
+
+    print_text(filesystem, change);
+    print_text(filesystem, dir->path);
+    print_text(filesystem, "/");
+
+    if (subdir != NULL)
+    {
+        print_text(filesystem, subdir->name);
+        print_text(filesystem, "/\n");
+    }
+    else if (file->symlink != NULL)
+    {
+        print_text(filesystem, file->name);
+        print_text(filesystem, "@ ");
+        print_text(filesystem, file->symlink->target);
+        print_text(filesystem, "\n");
+    }
+    else
+    {
+        sprintf(timestamp, " %d\n", file->data->timestamp);
+        print_text(filesystem, file->name);
+        print_text(filesystem, timestamp);
+    }
+}
+
+/*
+ * A helper function to take a node of node_size bytes from the table,
+ * reusing the last one freed if there is one, and to store its number in
+ * index. A chunk is added to the table whenever the last one is full.
+ * - If memory could not be allocated, or if every number a node can have
+ *   is taken, then it will return NULL.
+ */
+static void *alloc_node(FileSystem *const filesystem, Node_table *const table,
+                        size_t node_size, Node_index *index)
+{
+    void **new_chunks;
+    size_t chunk = table->used >> NODE_CHUNK_BITS, new_capacity;
+    void *result = NULL;
+
+    /* Case: A freed node can be reused */
+    if (table->free_node != 0)
+    {
+        *index = table->free_node;
+        result = node_at(table, node_size, *index);
+        memcpy(&table->free_node, result, sizeof(table->free_node));
+    }
+    /* Case: A new node is added after the last one */
+    else if (table->used != (Node_index)-1)
+    {
+        /* The array of chunks doubles in size when it is full */
+        if ((table->used & NODE_CHUNK_MASK) == 0
+            && chunk == table->chunk_capacity)
+        {
+            new_capacity = chunk == 0 ? 4 : chunk * 2;
+            new_chunks = fs_alloc(filesystem,
+                                  sizeof(*new_chunks) * new_capacity);
+            if (new_chunks != NULL)
+            {
+                if (chunk != 0)
+                {
+                    memcpy(new_chunks, table->chunks,
+                           sizeof(*new_chunks) * chunk);
+                    fs_free(filesystem, table->chunks,
+                            sizeof(*new_chunks) * chunk);
+                }
+                table->chunks = new_chunks;
+                table->chunk_capacity = new_capacity;
+            }
+        }
+        if ((table->used & NODE_CHUNK_MASK) == 0
+            && chunk < table->chunk_capacity)
+        {
+            table->chunks[chunk] = fs_alloc(filesystem,
+                                            node_size * NODE_CHUNK_SIZE);
+        }
+
+        if (chunk < table->chunk_capacity && table->chunks[chunk] != NULL)
+        {
+            /* Node 0 is never handed out */
+            *index = table->used == 0 ? 1 : table->used;
+            table->used = *index + 1;
+            result = node_at(table, node_size, *index);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to give the node with the specified number back to
+ * the table, so that it is the next one handed out.
+ */
+static void free_node(Node_table *const table, void *node, Node_index index)
+{
+    memcpy(node, &table->free_node, sizeof(table->free_node));
+    table->free_node = index;
+}
+
+/*
+ * A helper function to free every chunk of the table, along with the array
+ * holding them, leaving it empty. Called by rmfs() once every node has been
+ * freed.
+ */
+static void free_table(FileSystem *const filesystem, Node_table *const table,
+                       size_t node_size)
+{
+    size_t chunk;
+
+    for (chunk = 0; chunk < ((size_t)table->used + NODE_CHUNK_MASK)
+                                >> NODE_CHUNK_BITS; chunk++)
+    {
+        fs_free(filesystem, table->chunks[chunk],
+                node_size * NODE_CHUNK_SIZE);
+    }
+    fs_free(filesystem, table->chunks,
+            sizeof(*table->chunks) * table->chunk_capacity);
+
+    table->chunks = NULL;
+    table->chunk_capacity = 0;
+    table->used = 0;
+    table->free_node = 0;
+}
+
+/*
+ * A helper function to return the node of node_size bytes with the
+ * specified number, which must not be 0, in the table. DIR_AT() and
+ * FILE_AT() do the same for tables of a known kind.
+ */
+static void *node_at(Node_table *const table, size_t node_size,
+                     Node_index index)
+{
+    return (char *)table->chunks[index >> NODE_CHUNK_BITS]
+           + (index & NODE_CHUNK_MASK) * node_size;
+}
+
+/*
+ * A recursive helper function for fs_compact(), giving everything inside
+ * the specified directory, which already has its new number, their new
+ * numbers: first its files and then its subdirectories, each in the order
+ * of their list, followed by the contents of each subdirectory in turn.
+ * The numbers are stored in the maps at the old numbers, and counted in
+ * dir_count and file_count.
+ */
+static void number_dir(FileSystem *const filesystem, Dir_node *const dir,
+                       Node_index dir_map[], Node_index file_map[],
+                       Node_index *dir_count, Node_index *file_count)
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        *file_count += 1;
+        file_map[cur_file->self] = *file_count;
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        *dir_count += 1;
+        dir_map[cur_dir->self] = *dir_count;
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        number_dir(filesystem, cur_dir, dir_map, file_map, dir_count,
+                   file_count); /* Recursive call */
+    }
+}
+
+/*
+ * A recursive helper function for fs_compact(), replacing every number held
+ * by the specified directory and everything inside of it with the new one
+ * in the maps. The lists are walked by their old numbers, so each link is
+ * followed before it is replaced. The lists of links of the files' data
+ * are left to pack_dir().
+ */
+static void relink_dir(FileSystem *const filesystem, Dir_node *const dir,
+                       const Node_index dir_map[],
+                       const Node_index file_map[])
+{
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    Node_index next;
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, next))
+    {
+        next = cur_file->next_file;
+        cur_file->next_file = file_map[next];
+        cur_file->next_link = file_map[cur_file->next_link];
+        cur_file->par_dir = dir_map[cur_file->par_dir];
+        cur_file->self = file_map[cur_file->self];
+    }
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, next))
+    {
+        next = cur_dir->next_dir;
+        relink_dir(filesystem, cur_dir, dir_map,
+                   file_map); /* Recursive call */
+        cur_dir->next_dir = dir_map[next];
+    }
+
+    dir->file_list = file_map[dir->file_list];
+    dir->subdir_list = dir_map[dir->subdir_list];
+    dir->par_dir = dir_map[dir->par_dir];
+    dir->self = dir_map[dir->self];
+}
+
+/*
+ * A helper function for fs_compact(), swapping every node of the table in
+ * use to its new number in map, where free nodes have 0. The map is used
+ * up in the process. The count nodes in use then come first, and the
+ * chunks holding none of them are freed.
+ */
+static void sort_table(FileSystem *const filesystem, Node_table *const table,
+                       size_t node_size, Node_index map[], Node_index count)
+{
+    union
+    {
+        Dir_node dir;
+        File_node file;
+    } temp;
+    Node_index i, j;
+    size_t chunk, chunk_count;
+
+    for (i = 1; i < table->used; i++)
+    {
+        /* Each swap puts one node in its place, and brings the node that
+        was there to i, which is placed next */
+        while (map[i] != 0 && map[i] != i)
+        {
+            j = map[i];
+            memcpy(&temp, node_at(table, node_size, i), node_size);
+            memcpy(node_at(table, node_size, i),
+                   node_at(table, node_size, j), node_size);
+            memcpy(node_at(table, node_size, j), &temp, node_size);
+            map[i] = map[j];
+            map[j] = j;
+        }
+    }
+
+    /* The free nodes are all after the last one in use now */
+    chunk_count = ((size_t)table->used + NODE_CHUNK_MASK) >> NODE_CHUNK_BITS;
+    table->used = count != 0 ? count + 1 : 0;
+    table->free_node = 0;
+
+    for (chunk = ((size_t)table->used + NODE_CHUNK_MASK) >> NODE_CHUNK_BITS;
+         chunk < chunk_count; chunk++)
+    {
+        fs_free(filesystem, table->chunks[chunk],
+                node_size * NODE_CHUNK_SIZE);
+        table->chunks[chunk] = NULL;
+    }
+}
+
+/*
+ * A recursive helper function to return the number of bytes pack_dir()
+ * needs for the specified directory and everything inside of it. The data
+ * of a file is counted with the first of its links.
+ */
+static size_t packed_size(FileSystem *const filesystem, Dir_node *const dir)
+{
+    File_node *cur_file;
+    Dir_node *cur_dir;
+    size_t strings = 0, result = 0;
+
+    /* The name and path of the root are never allocated */
+    if (dir->par_dir != 0)
+    {
+        strings += strlen(dir->name) + 1 + strlen(dir->path) + 1;
+    }
+
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        if (cur_file->data != NULL && cur_file->data->links == cur_file->self)
+        {
+            result += PACK_ROUND(sizeof(*cur_file->data));
+        }
+
+        strings += strlen(cur_file->name) + 1;
+        if (cur_file->symlink != NULL)
+        {
+            result += PACK_ROUND(sizeof(*cur_file->symlink));
+            strings += strlen(cur_file->symlink->target) + 1;
+        }
+    }
+    result += PACK_ROUND(strings);
+
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        result += packed_size(filesystem, cur_dir); /* Recursive call */
+    }
+
+    return result;
+}
+
+/*
+ * A recursive helper function for fs_compact(), moving the file records
+ * and names of the specified directory and everything inside of it to
+ * block at offset, and freeing the memory they used before. The bytes
+ * moved are added to live. It is called once the nodes are in their new
+ * places, which the inode table and the name index are pointed to, and
+ * gives the data of each file the new number of its first link from
+ * file_map.
+ */
+static void pack_dir(FileSystem *const filesystem, char *const block,
+                     size_t *offset, size_t *live, Dir_node *const dir,
+                     const Node_index file_map[])
+{
+    Dir_node *cur_dir;
+    File_node *cur_file, *cur_link;
+    File_data *data;
+    Symlink_data *symlink;
+
+    if (dir->ino != 0)
+    {
+        filesystem->inodes[dir->ino].dir = dir;
+    }
+    if (filesystem->name_index != NULL)
+    {
+        index_move(filesystem, dir, NULL);
+    }
+
+    /* The records of the files come first */
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        if (cur_file->ino != 0)
+        {
+            filesystem->inodes[cur_file->ino].file = cur_file;
+        }
+        if (filesystem->name_index != NULL)
+        {
+            index_move(filesystem, NULL, cur_file);
+        }
+
+        /* The data is moved with the first of its links reached, and
+        every link is pointed to its new location */
+        data = cur_file->data;
+        if (data != NULL && ((char *)data < block
+                             || (char *)data >= block + *offset))
+        {
+            data = (File_data *)(block + *offset);
+            *offset += PACK_ROUND(sizeof(*data));
+            *live += sizeof(*data);
+
+            *data = *cur_file->data;
+            data->links = file_map[data->links];
+            fs_free(filesystem, cur_file->data, sizeof(*data));
+
+            for (cur_link = FILE_AT(filesystem, data->links);
+                 cur_link != NULL;
+                 cur_link = FILE_AT(filesystem, cur_link->next_link))
+            {
+                cur_link->data = data;
+            }
+        }
+
+        /* The record of a symbolic link is moved without its cached
+        resolution */
+        if (cur_file->symlink != NULL)
+        {
+            symlink = (Symlink_data *)(block + *offset);
+            *offset += PACK_ROUND(sizeof(*symlink));
+            *live += sizeof(*symlink);
+
+            drop_link(filesystem, cur_file->symlink);
+            *symlink = *cur_file->symlink;
+
+            fs_free(filesystem, cur_file->symlink, sizeof(*symlink));
+            cur_file->symlink = symlink;
+        }
+    }
+
+    /* Followed by the names of the directory and of its files */
+    if (dir->par_dir != 0)
+    {
+        dir->name = pack_string(filesystem, block, offset, live, dir->name);
+        dir->path = pack_string(filesystem, block, offset, live, dir->path);
+    }
+    for (cur_file = FILE_AT(filesystem, dir->file_list); cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        cur_file->name = pack_string(filesystem, block, offset, live,
+                                     cur_file->name);
+        if (cur_file->symlink != NULL)
+        {
+            cur_file->symlink->target =
+                pack_string(filesystem, block, offset, live,
+                            cur_file->symlink->target);
+        }
+    }
+    *offset = PACK_ROUND(*offset);
+
+    /* Then come the subdirectories, each with its own contents */
+    for (cur_dir = DIR_AT(filesystem, dir->subdir_list); cur_dir != NULL;
+         cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        pack_dir(filesystem, block, offset, live, cur_dir,
+                 file_map); /* Recursive call */
+    }
+}
+
+/*
+ * A helper function for pack_dir(), copying string to block at offset and
+ * freeing it. Returns the copy.
+ */
+static char *pack_string(FileSystem *const filesystem, char *const block,
+                         size_t *offset, size_t *live, char *string)
+{
+    char *result = block + *offset;
+    size_t size = sizeof(char) * (strlen(string) + 1);
+
+    memcpy(result, string, size);
+    *offset += size;
+    *live += size;
+    fs_free(filesystem, string, size);
+
+    return result;
+}
+
+/*
+ * A helper function to add a directory to the transaction. Directories
+ * made by the transaction pass the directory they were made in as parent,
+ * while existing ones pass NULL.
+ * - If memory could not be allocated, then it will return NULL.
+ */
+static Txn_dir *txn_add_dir(Fs_txn *const txn, Dir_node *node,
+                            Txn_dir *parent)
+{
+    Txn_dir *result;
+    Dir_node *cur;
+
+    result = calloc(1, sizeof(*result));
+    if (result != NULL)
+    {
+        txn->dir_count += 1;
+        result->node = node;
+        result->parent = parent;
+        result->id = txn->dir_count;
+
+        if (parent != NULL)
+        {
+            /* There is nothing inside of it to load */
+            result->depth = parent->depth + 1;
+            result->made = 1;
+            result->loaded = 1;
+            result->next = txn->new_dirs;
+            txn->new_dirs = result;
+        }
+        else
+        {
+            for (cur = DIR_AT(txn->filesystem, node->par_dir); cur != NULL;
+                 cur = DIR_AT(txn->filesystem, cur->par_dir))
+            {
+                result->depth += 1;
+            }
+            result->next = txn->old_dirs;
+            txn->old_dirs = result;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * A helper function to find the directory of the transaction for node,
+ * which existed before it, adding one if there is none yet.
+ * - If memory could not be allocated, then it will return NULL.
+ */
+static Txn_dir *txn_old_dir(Fs_txn *const txn, Dir_node *node)
+{
+    Txn_dir *result = txn->old_dirs;
+
+    while (result != NULL && result->node != node)
     {
-        /* Malloc Error */
-        flag = 0;
+        result = result->next;
     }
 
-    /* Insert the new_name node into the linked list. */
-    if (flag)
+    if (result == NULL)
     {
-        /* If head is NULL, it means that the node to be
-        inserted is the first node in the linked list. */
-        if (head == NULL)
-        {
-            return new_node;
-        }
+        result = txn_add_dir(txn, node, NULL);
+    }
 
-        cur = head;
+    return result;
+}
 
-        /* Find a location to insert the node */
-        while (cur != NULL && strcmp(name, cur->name) >= 0)
+/*
+ * A helper function to find the entry of the transaction's table for the
+ * name in dir. The files and subdirectories already in dir are added to the
+ * table the first time it is used, so that names are never searched for in
+ * the directory's lists.
+ * - If create is 1, an empty entry is added for names that have none yet.
+ * - Returns NULL if there is no entry, or if memory could not be allocated.
+ */
+static Txn_entry *txn_entry(Fs_txn *const txn, Txn_dir *dir,
+                            const char name[], size_t length, int create)
+{
+    Txn_entry *result = NULL;
+    const char *new_name;
+
+    if ((dir->loaded || txn_load(txn, dir))
+        && (!create || txn_reserve(txn, 1)) && txn->entry_capacity != 0)
+    {
+        result = txn_slot(txn, dir, name, length);
+
+        if (result->dir == NULL)
         {
-            prev = cur;
-            cur = cur->next_name;
+            new_name = create ? txn_name(txn, name, length) : NULL;
+            if (new_name != NULL)
+            {
+                memset(result, 0, sizeof(*result));
+                result->dir = dir;
+                result->name = new_name;
+                result->length = length;
+                txn->entry_count += 1;
+            }
+            else
+            {
+                result = NULL;
+            }
         }
+    }
 
-        /* Initializes the pointer to the next node. */
-        new_node->next_name = cur;
+    return result;
+}
 
-        /* Case: File is inserted at the head */
-        if (prev == NULL)
+/*
+ * A helper function to add an entry for every file and subdirectory in dir
+ * to the transaction's table.
+ * - If memory could not be allocated, then nothing is added and it will
+ *   return 0.
+ */
+static int txn_load(Fs_txn *const txn, Txn_dir *dir)
+{
+    FileSystem *const filesystem = txn->filesystem;
+    Txn_entry *entry;
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    size_t count = 0;
+    int result;
+
+    for (cur_dir = DIR_AT(filesystem, dir->node->subdir_list);
+         cur_dir != NULL; cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
+    {
+        count += 1;
+    }
+    for (cur_file = FILE_AT(filesystem, dir->node->file_list);
+         cur_file != NULL;
+         cur_file = FILE_AT(filesystem, cur_file->next_file))
+    {
+        count += 1;
+    }
+
+    /* The names of the nodes stay valid until the transaction ends */
+    result = txn_reserve(txn, count);
+    if (result)
+    {
+        for (cur_dir = DIR_AT(filesystem, dir->node->subdir_list);
+             cur_dir != NULL;
+             cur_dir = DIR_AT(filesystem, cur_dir->next_dir))
         {
-            head = new_node;
+            entry = txn_slot(txn, dir, cur_dir->name, strlen(cur_dir->name));
+            memset(entry, 0, sizeof(*entry));
+            entry->dir = dir;
+            entry->name = cur_dir->name;
+            entry->length = strlen(cur_dir->name);
+            entry->old_dir = cur_dir;
         }
-
-        /* Case: File is inserted elsewhere */
-        else
+        for (cur_file = FILE_AT(filesystem, dir->node->file_list);
+             cur_file != NULL;
+             cur_file = FILE_AT(filesystem, cur_file->next_file))
         {
-            prev->next_name = new_node;
+            entry = txn_slot(txn, dir, cur_file->name,
+                             strlen(cur_file->name));
+            memset(entry, 0, sizeof(*entry));
+            entry->dir = dir;
+            entry->name = cur_file->name;
+            entry->length = strlen(cur_file->name);
+            entry->old_file = cur_file;
         }
+
+        txn->entry_count += count;
+        dir->loaded = 1;
     }
 
-    return head;
+    return result;
 }
 
 /*
- * A helper method to search for a directory and remove it from the list
- * of subdirectories. This function is distinct from simply searching for
- * a directory using the search_dir() helper function and removing it using
- * the remove_dir() helper function as it also modifies the links within
- * the subdirectory linked list.
+ * A helper function to find the slot of the transaction's table holding
+ * the name in dir, or the free slot where it belongs, using linear probing.
+ * The table must not be empty.
  */
-static int search_and_remove_dir(Dir_node *const cur_dir, const char name[])
+static Txn_entry *txn_slot(Fs_txn *const txn, Txn_dir *dir,
+                           const char name[], size_t length)
 {
-    Dir_node *cur, *prev = NULL;
-    int result = 0;
+    Txn_entry *result;
+    size_t slot;
 
-    /* Traverses the subdirectory list to look for the desired subdirectory */
-    cur = cur_dir->subdir_list;
+    slot = (size_t)hash_number(hash_bytes(HASH_BASIS, name, length),
+                               dir->id);
+    slot &= txn->entry_capacity - 1;
+    result = &txn->entries[slot];
 
-    while (cur != NULL && strcmp(cur->name, name) != 0)
+    while (result->dir != NULL
+           && (result->dir != dir || result->length != length
+               || memcmp(result->name, name, length) != 0))
     {
-        prev = cur;
-        cur = cur->next_dir;
+        slot = (slot + 1) & (txn->entry_capacity - 1);
+        result = &txn->entries[slot];
     }
 
-    /* If cur is NULL, it would indicate that the subdirectory with the
-    specified name is not found, and result would stay 0. */
-    if (cur != NULL)
+    return result;
+}
+
+/*
+ * A helper function to make room in the transaction's table for count more
+ * entries, doubling its size (and moving every entry to its slot in the
+ * new table) until it is at most half full.
+ * - If memory could not be allocated, then it will return 0.
+ */
+static int txn_reserve(Fs_txn *const txn, size_t count)
+{
+    Txn_entry *old_entries = txn->entries;
+    size_t old_capacity = txn->entry_capacity, capacity, i;
+    int result = 1;
+
+    capacity = old_capacity == 0 ? 1024 : old_capacity;
+    while ((txn->entry_count + count) * 2 > capacity)
     {
-        result = 1;
+        capacity *= 2;
+    }
 
-        /* Case: The subdirectory to be removed is the head of the list */
-        if (prev == NULL)
+    if (capacity != old_capacity)
+    {
+        txn->entries = calloc(capacity, sizeof(*txn->entries));
+        if (txn->entries != NULL)
         {
-            cur_dir->subdir_list = cur->next_dir;
-        }
+            txn->entry_capacity = capacity;
+            for (i = 0; i < old_capacity; i++)
+            {
+                if (old_entries[i].dir != NULL)
+                {
+                    *txn_slot(txn, old_entries[i].dir, old_entries[i].name,
+                              old_entries[i].length) = old_entries[i];
+                }
+            }
 
-        /* Case: The subdirectory to be removed is between the list */
+            free(old_entries);
+        }
         else
         {
-            prev->next_dir = cur->next_dir;
+            txn->entries = old_entries;
+            result = 0;
         }
+    }
 
-        /* Remove all subdirectory contents and free all
-        allocated memory being used by it */
-        remove_dir(cur);
+    return result;
+}
+
+/*
+ * A helper function to copy the name of an entry that did not exist before
+ * the transaction, without a terminating null character. Names are copied
+ * into blocks of TXN_NAME_BLOCK bytes, which are freed when it ends.
+ * - If memory could not be allocated, then it will return NULL.
+ */
+static const char *txn_name(Fs_txn *const txn, const char name[],
+                            size_t length)
+{
+    char *result = NULL, *block;
+    size_t size;
+
+    if (txn->names == NULL || txn->names_size - txn->names_used < length)
+    {
+        size = sizeof(block) + (length > TXN_NAME_BLOCK ? length
+                                                        : TXN_NAME_BLOCK);
+        block = malloc(size);
+        if (block != NULL)
+        {
+            memcpy(block, &txn->names, sizeof(block));
+            txn->names = block;
+            txn->names_used = sizeof(block);
+            txn->names_size = size;
+        }
+    }
+
+    if (txn->names != NULL && txn->names_size - txn->names_used >= length)
+    {
+        result = txn->names + txn->names_used;
+        memcpy(result, name, length);
+        txn->names_used += length;
     }
 
     return result;
 }
 
 /*
- * A recursive helper function used to remove all the contents within a
- * directory, which includes all files and subdirectories within it, and
- * frees all allocated memory being used by any of the content.
+ * A helper function to check whether the name of the entry is taken by a
+ * file or subdirectory, as the tree would be if the transaction was
+ * committed now.
  */
-static void remove_dir(Dir_node *dir)
+static int txn_taken(Txn_entry *const entry)
 {
-    File_node *cur_file, *file_to_be_removed;
-    Dir_node *cur_dir, *dir_to_be_removed;
+    return entry->new_file != NULL || entry->new_dir != NULL
+           || (!entry->removed
+               && (entry->old_file != NULL || entry->old_dir != NULL));
+}
 
-    if (dir != NULL)
+/*
+ * A helper function to check whether the entry has anything to apply when
+ * the transaction is committed.
+ */
+static int txn_changed(Txn_entry *const entry)
+{
+    return entry->removed || entry->touches != 0 || entry->new_file != NULL
+           || entry->new_dir != NULL;
+}
+
+/*
+ * A helper function to check whether the directory was made by the
+ * transaction, and then removed along with itself or a directory above it,
+ * which means that it is never added to the tree.
+ */
+static int txn_dropped(Txn_dir *dir)
+{
+    int result = 0;
+
+    while (dir != NULL && dir->made && !result)
     {
-        /* Remove all files within this directory */
-        cur_file = dir->file_list;
+        result = dir->removed;
+        dir = dir->parent;
+    }
 
-        /* If cur_file is NULL, this would indicate
-        that the directory has no files */
-        while (cur_file != NULL)
-        {
-            file_to_be_removed = cur_file;
-            cur_file = cur_file->next_file;
+    return result;
+}
+
+/*
+ * A helper function to apply the changes of the transaction within dir,
+ * which must be sorted by name. The new lists of files and subdirectories
+ * are built by merging the changes into the old lists, and replace them at
+ * once. Directories made by the transaction are published the same way
+ * once they have been added.
+ */
+static void txn_publish(Fs_txn *const txn, Txn_dir *const dir)
+{
+    FileSystem *const filesystem = txn->filesystem;
+    Txn_entry *entry;
+    Dir_node *cur_dir;
+    File_node *cur_file;
+    Node_index subdirs = 0, *last_dir = &subdirs;
+    Node_index files = 0, *last_file = &files;
+    size_t i;
 
-            remove_file(file_to_be_removed);
+    qsort(dir->changes, dir->change_count, sizeof(*dir->changes),
+          compare_changes);
+
+    cur_dir = DIR_AT(filesystem, dir->node->subdir_list);
+    cur_file = FILE_AT(filesystem, dir->node->file_list);
+
+    for (i = 0; i < dir->change_count; i++)
+    {
+        entry = dir->changes[i];
+
+        /* Keeps the unchanged nodes coming before the name */
+        while (cur_dir != NULL
+               && compare_name(cur_dir->name, entry->name, entry->length) < 0)
+        {
+            *last_dir = cur_dir->self;
+            last_dir = &cur_dir->next_dir;
+            cur_dir = DIR_AT(filesystem, cur_dir->next_dir);
+        }
+        while (cur_file != NULL
+               && compare_name(cur_file->name, entry->name, entry->length)
+                      < 0)
+        {
+            *last_file = cur_file->self;
+            last_file = &cur_file->next_file;
+            cur_file = FILE_AT(filesystem, cur_file->next_file);
         }
 
-        /* Remove all subdirectories within this directory */
-        cur_dir = dir->subdir_list;
+        /* The node that had the name is next, and is kept unless it was
+        removed */
+        if (entry->old_dir != NULL)
+        {
+            cur_dir = DIR_AT(filesystem, cur_dir->next_dir);
+            if (!entry->removed)
+            {
+                *last_dir = entry->old_dir->self;
+                last_dir = &entry->old_dir->next_dir;
+            }
+        }
+        else if (entry->old_file != NULL)
+        {
+            cur_file = FILE_AT(filesystem, cur_file->next_file);
+            if (!entry->removed)
+            {
+                *last_file = entry->old_file->self;
+                last_file = &entry->old_file->next_file;
+            }
+        }
 
-        /* If cur_dir is NULL, this would indicate
-        that the directory has no subdirectories */
-        while (cur_dir != NULL)
+        /* Followed by the node made in its place */
+        if (entry->new_dir != NULL)
         {
-            dir_to_be_removed = cur_dir;
-            cur_dir = cur_dir->next_dir;
+            *last_dir = entry->new_dir->node->self;
+            last_dir = &entry->new_dir->node->next_dir;
+        }
+        else if (entry->new_file != NULL)
+        {
+            *last_file = entry->new_file->self;
+            last_file = &entry->new_file->next_file;
+        }
+    }
 
-            remove_dir(dir_to_be_removed); /* Recursive call */
+    *last_dir = cur_dir != NULL ? cur_dir->self : 0;
+    *last_file = cur_file != NULL ? cur_file->self : 0;
+    dir->node->subdir_list = subdirs;
+    dir->node->file_list = files;
+
+    /* Reports every change, and frees the removed nodes. The name of an
+    entry may belong to its old node, so the node is freed last. */
+    for (i = 0; i < dir->change_count; i++)
+    {
+        entry = dir->changes[i];
+
+        if (entry->removed && filesystem->watches != NULL)
+        {
+            notify(filesystem, dir->node, FS_EVENT_REMOVE, entry->name,
+                   entry->length);
         }
 
-        /* Free allocated memory being used
-        by other directory struct members */
-        if (strcmp("root", dir->name) != 0)
+        if (entry->new_dir != NULL)
+        {
+            if (filesystem->name_index != NULL)
+            {
+                index_add(filesystem, entry->new_dir->node, NULL);
+            }
+            if (filesystem->watches != NULL)
+            {
+                notify(filesystem, dir->node, FS_EVENT_MKDIR, entry->name,
+                       entry->length);
+            }
+
+            txn_publish(txn, entry->new_dir); /* Recursive call */
+        }
+        else if (entry->new_file != NULL)
         {
-            free(dir->name);
+            if (filesystem->name_index != NULL)
+            {
+                index_add(filesystem, NULL, entry->new_file);
+            }
+            if (filesystem->watches != NULL)
+            {
+                notify(filesystem, dir->node, FS_EVENT_CREATE, entry->name,
+                       entry->length);
+            }
         }
 
-        if (strlen(dir->path) != 0)
+        if (entry->removed && entry->old_dir != NULL)
+        {
+            remove_dir(filesystem, entry->old_dir);
+        }
+        else if (entry->removed)
         {
-            free(dir->path);
+            remove_file(filesystem, entry->old_file);
         }
+    }
 
-        /* Free allocated memory being used by the directory itself */
-        free(dir);
+    if (dir->change_count != 0)
+    {
+        mark_dirty(filesystem, dir->node);
+        mark_changed(filesystem, dir->node);
     }
 }
 
 /*
- * A helper method to search for a file and remove it from the list of files.
- * This function is distinct from simply searching for a file using the
- * search_file() helper function and removing it using the remove_file()
- * helper function as it also modifies the links within the file linked list.
+ * A helper function to end the transaction, freeing everything it holds.
+ * The files and directories it made are freed as well if it was not
+ * committed, or if they were dropped before it was.
  */
-static int search_and_remove_file(Dir_node *const cur_dir, const char name[])
+static void txn_end(Fs_txn *txn, int committed)
 {
-    File_node *cur, *prev = NULL;
-    int result = 0;
-
-    /* Traverses the file list to look for the desired file */
-    cur = cur_dir->file_list;
+    Txn_dir *dir, *next_dir;
+    char *block;
+    size_t i;
 
-    while (cur != NULL && strcmp(cur->name, name))
+    for (i = 0; i < txn->entry_capacity; i++)
     {
-        prev = cur;
-        cur = cur->next_file;
+        if (txn->entries[i].dir != NULL && txn->entries[i].new_file != NULL
+            && (!committed || txn_dropped(txn->entries[i].dir)))
+        {
+            remove_file(txn->filesystem, txn->entries[i].new_file);
+        }
     }
 
-    /* If cur is NULL, it would indicate that the file with the
-    specified name is not found, and result would stay 0. */
-    if (cur != NULL)
+    /* These directories were never added to the tree, and so are empty */
+    for (dir = txn->new_dirs; dir != NULL; dir = dir->next)
     {
-        result = 1;
-
-        /* Case: The file to be removed is the head of the list */
-        if (prev == NULL)
+        if (!committed || txn_dropped(dir))
         {
-            cur_dir->file_list = cur->next_file;
+            remove_dir(txn->filesystem, dir->node);
         }
+    }
 
-        /* Case: The file to be removed is between the list */
-        else
-        {
-            prev->next_file = cur->next_file;
-        }
+    for (dir = txn->new_dirs; dir != NULL; dir = next_dir)
+    {
+        next_dir = dir->next;
+        free(dir);
+    }
+    for (dir = txn->old_dirs; dir != NULL; dir = next_dir)
+    {
+        next_dir = dir->next;
+        free(dir);
+    }
 
-        /* Remove all file contents and free all
-        allocated memory being used by it */
-        remove_file(cur);
+    while (txn->names != NULL)
+    {
+        block = txn->names;
+        memcpy(&txn->names, block, sizeof(block));
+        free(block);
+    }
+
+    free(txn->entries);
+    free(txn);
+}
+
+/*
+ * A helper function for qsort(), ordering changes by their names, like
+ * compare_name() orders nodes.
+ */
+static int compare_changes(const void *a, const void *b)
+{
+    const Txn_entry *entry_a = *(Txn_entry *const *)a;
+    const Txn_entry *entry_b = *(Txn_entry *const *)b;
+    int result;
+
+    result = memcmp(entry_a->name, entry_b->name,
+                    entry_a->length < entry_b->length ? entry_a->length
+                                                      : entry_b->length);
+    if (result == 0)
+    {
+        result = entry_a->length < entry_b->length ? -1
+                 : entry_a->length > entry_b->length;
     }
 
     return result;
 }
 
 /*
- * A helper function used to remove all the contents within a
- * file, namely its name and timestamp.
+ * A helper function for qsort(), ordering directories of a transaction from
+ * the deepest to the shallowest.
  */
-static void remove_file(File_node *file)
+static int compare_depths(const void *a, const void *b)
 {
-    if (file != NULL)
+    unsigned long depth_a = (*(Txn_dir *const *)a)->depth;
+    unsigned long depth_b = (*(Txn_dir *const *)b)->depth;
+
+    return depth_b < depth_a ? -1 : depth_b > depth_a;
+}
+
+/*
+ * Allocates size bytes for the file system, using its allocator if it has
+ * one, and malloc() otherwise. The bytes are added to the file system's
+ * memory usage.
+ */
+void *fs_alloc(FileSystem *const filesystem, size_t size)
+{
+    void *ptr;
+
+    if (filesystem->allocator != NULL)
+    {
+        ptr = filesystem->allocator->alloc(filesystem->allocator->context,
+                                           size);
+    }
+    else
+    {
+        ptr = malloc(size);
+    }
+
+    if (ptr != NULL)
+    {
+        filesystem->bytes_used += size;
+    }
+
+    return ptr;
+}
+
+/*
+ * Frees memory allocated by fs_alloc(). The size must be the same as when
+ * it was allocated. NULL pointers are ignored.
+ */
+void fs_free(FileSystem *const filesystem, void *ptr, size_t size)
+{
+    char *block = filesystem->packed;
+
+    /* Memory packed by fs_compact() is only given back once nothing in
+    its block is used anymore */
+    if (ptr != NULL && block != NULL && (char *)ptr >= block
+        && (char *)ptr < block + filesystem->packed_size)
+    {
+        filesystem->packed_live -= size;
+        if (filesystem->packed_live == 0)
+        {
+            filesystem->packed = NULL;
+            fs_free(filesystem, block,
+                    filesystem->packed_size); /* Recursive call */
+        }
+    }
+    else if (ptr != NULL)
     {
+        if (filesystem->allocator != NULL)
+        {
+            filesystem->allocator->release(filesystem->allocator->context,
+                                           ptr, size);
+        }
+        else
+        {
+            free(ptr);
+        }
 
-        free(file->name);
-        free(file);
+        filesystem->bytes_used -= size;
     }
 }
\ No newline at end of file
@@ -7,13 +7,64 @@
  * Author: Samuel Kosasih
  */
 
+#ifndef FILESYSTEM_H
+#define FILESYSTEM_H
+
 #include "filesystem-datastructure.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void mkfs(FileSystem *const filesystem);
+void mkfs_with(FileSystem *const filesystem, const Fs_allocator *allocator);
+void fs_set_output(FileSystem *const filesystem,
+                   void (*print)(void *context, const char text[]),
+                   void *context);
 int touch(FileSystem *const filesystem, const char name[]);
 int mkdir(FileSystem *const filesystem, const char name[]);
 int cd(FileSystem *const filesystem, const char name[]);
 int ls(FileSystem *const filesystem, const char name[]);
 void pwd(FileSystem *const filesystem);
 void rmfs(FileSystem *const filesystem);
-int rm(FileSystem *const filesystem, const char name[]);
\ No newline at end of file
+int rm(FileSystem *const filesystem, const char name[]);
+int ln(FileSystem *const filesystem, const char target[], const char name[]);
+int ln_s(FileSystem *const filesystem, const char target[], const char name[]);
+int fs_lookup(FileSystem *const filesystem, const char name[],
+              Fs_handle *handle);
+int touch_h(FileSystem *const filesystem, Fs_handle handle);
+int ls_h(FileSystem *const filesystem, Fs_handle handle);
+int cd_h(FileSystem *const filesystem, Fs_handle handle);
+int rm_h(FileSystem *const filesystem, Fs_handle handle);
+long fs_diff(FileSystem *const a, FileSystem *const b);
+int fs_compact(FileSystem *const filesystem);
+Fs_txn *fs_txn_begin(FileSystem *const filesystem);
+int fs_txn_touch(Fs_txn *const txn, const char name[]);
+int fs_txn_mkdir(Fs_txn *const txn, const char name[]);
+int fs_txn_cd(Fs_txn *const txn, const char name[]);
+int fs_txn_rm(Fs_txn *const txn, const char name[]);
+int fs_txn_commit(Fs_txn *txn);
+void fs_txn_abort(Fs_txn *txn);
+
+/* Variants taking the length of each name, which need no null character */
+int touch_n(FileSystem *const filesystem, const char name[], size_t length);
+int mkdir_n(FileSystem *const filesystem, const char name[], size_t length);
+int cd_n(FileSystem *const filesystem, const char name[], size_t length);
+int ls_n(FileSystem *const filesystem, const char name[], size_t length);
+int rm_n(FileSystem *const filesystem, const char name[], size_t length);
+int ln_n(FileSystem *const filesystem, const char target[],
+         size_t target_length, const char name[], size_t length);
+int ln_s_n(FileSystem *const filesystem, const char target[],
+           size_t target_length, const char name[], size_t length);
+int fs_lookup_n(FileSystem *const filesystem, const char name[],
+                size_t length, Fs_handle *handle);
+int fs_txn_touch_n(Fs_txn *const txn, const char name[], size_t length);
+int fs_txn_mkdir_n(Fs_txn *const txn, const char name[], size_t length);
+int fs_txn_cd_n(Fs_txn *const txn, const char name[], size_t length);
+int fs_txn_rm_n(Fs_txn *const txn, const char name[], size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * File: filesystem.hpp
+ *
+ * This file contains a C++ interface to the file system in filesystem.h.
+ *
+ * fs::FileSystem calls mkfs() when it is constructed and rmfs() when it is
+ * destroyed. Its member functions take std::string_view names, and pass
+ * their lengths straight to the _n functions of filesystem.h, so names are
+ * neither copied nor scanned for a terminating null character.
+ *
+ * The memory for directories, files and names comes from an allocator
+ * policy, given as a template parameter of fs::BasicFileSystem. A policy is
+ * a class with these two member functions:
+ *
+ *     void *allocate(std::size_t size);
+ *     void deallocate(void *ptr, std::size_t size);
+ *
+ * fs::MallocPolicy (the default) uses malloc() without any indirection, and
+ * fs::PoolPolicy takes its memory from an Fs_pool of filesystem-pool.h.
+ *
+ * Author: Samuel Kosasih
+ */
+
+#ifndef FILESYSTEM_HPP
+#define FILESYSTEM_HPP
+
+#include "filesystem.h"
+#include "filesystem-pool.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace fs
+{
+
+/*
+ * The default allocator policy, which leaves the file system to use malloc()
+ * and free() directly.
+ */
+struct MallocPolicy
+{
+    void *allocate(std::size_t size) { return std::malloc(size); }
+    void deallocate(void *ptr, std::size_t) { std::free(ptr); }
+};
+
+/*
+ * An allocator policy taking memory from an Fs_pool, which must outlive
+ * every file system using it. Several file systems can share one pool.
+ */
+class PoolPolicy
+{
+public:
+    explicit PoolPolicy(Fs_pool &pool) noexcept : pool_(&pool) {}
+
+    void *allocate(std::size_t size) { return pool_alloc(pool_, size); }
+
+    void deallocate(void *ptr, std::size_t size)
+    {
+        pool_release(pool_, ptr, size);
+    }
+
+private:
+    Fs_pool *pool_;
+};
+
+/*
+ * A file system whose memory comes from the allocator policy AllocPolicy.
+ * It cannot be copied or moved, since the file system keeps a pointer to
+ * the allocator stored inside of it.
+ */
+template <class AllocPolicy = MallocPolicy>
+class BasicFileSystem
+{
+public:
+    BasicFileSystem() : BasicFileSystem(AllocPolicy()) {}
+
+    explicit BasicFileSystem(AllocPolicy policy) : policy_(std::move(policy))
+    {
+        allocator_.alloc = &allocate;
+        allocator_.release = &deallocate;
+        allocator_.context = &policy_;
+
+        mkfs_with(&filesystem_, uses_malloc ? nullptr : &allocator_);
+    }
+
+    ~BasicFileSystem() { rmfs(&filesystem_); }
+
+    BasicFileSystem(const BasicFileSystem &) = delete;
+    BasicFileSystem &operator=(const BasicFileSystem &) = delete;
+
+    /* Works like the functions of the same name in filesystem.h, returning
+    true where they return 1 */
+    bool touch(std::string_view name)
+    {
+        return touch_n(&filesystem_, data(name), name.size()) != 0;
+    }
+
+    bool mkdir(std::string_view name)
+    {
+        return mkdir_n(&filesystem_, data(name), name.size()) != 0;
+    }
+
+    bool cd(std::string_view name)
+    {
+        return cd_n(&filesystem_, data(name), name.size()) != 0;
+    }
+
+    bool ls(std::string_view name = std::string_view())
+    {
+        return ls_n(&filesystem_, data(name), name.size()) != 0;
+    }
+
+    bool rm(std::string_view name)
+    {
+        return rm_n(&filesystem_, data(name), name.size()) != 0;
+    }
+
+    bool ln(std::string_view target, std::string_view name)
+    {
+        return ln_n(&filesystem_, data(target), target.size(),
+                    data(name), name.size()) != 0;
+    }
+
+    bool ln_s(std::string_view target, std::string_view name)
+    {
+        return ln_s_n(&filesystem_, data(target), target.size(),
+                      data(name), name.size()) != 0;
+    }
+
+    void pwd() { ::pwd(&filesystem_); }
+
+    /* Returns a handle to the named node, or nothing if it does not exist */
+    std::optional<Fs_handle> lookup(std::string_view name)
+    {
+        Fs_handle handle;
+
+        if (fs_lookup_n(&filesystem_, data(name), name.size(), &handle))
+        {
+            return handle;
+        }
+        return std::nullopt;
+    }
+
+    /* Works like the handle variants in filesystem.h */
+    bool touch(Fs_handle handle) { return touch_h(&filesystem_, handle) != 0; }
+    bool cd(Fs_handle handle) { return cd_h(&filesystem_, handle) != 0; }
+    bool ls(Fs_handle handle) { return ls_h(&filesystem_, handle) != 0; }
+    bool rm(Fs_handle handle) { return rm_h(&filesystem_, handle) != 0; }
+
+    /* The number of bytes allocated for the file system */
+    std::size_t bytes_used() const noexcept { return filesystem_.bytes_used; }
+
+    /* The underlying C file system, for the functions not wrapped here */
+    ::FileSystem *get() noexcept { return &filesystem_; }
+    AllocPolicy &policy() noexcept { return policy_; }
+
+private:
+    static constexpr bool uses_malloc =
+        std::is_same_v<AllocPolicy, MallocPolicy>;
+
+    /* Empty views may have no data at all, which the C functions would
+    take as a NULL name rather than an empty one */
+    static const char *data(std::string_view name) noexcept
+    {
+        return name.empty() ? "" : name.data();
+    }
+
+    static void *allocate(void *context, std::size_t size)
+    {
+        return static_cast<AllocPolicy *>(context)->allocate(size);
+    }
+
+    static void deallocate(void *context, void *ptr, std::size_t size)
+    {
+        static_cast<AllocPolicy *>(context)->deallocate(ptr, size);
+    }
+
+    AllocPolicy policy_;
+    Fs_allocator allocator_;
+    ::FileSystem filesystem_;
+};
+
+/* A file system using malloc() */
+using FileSystem = BasicFileSystem<>;
+
+/* A file system taking its memory from a shared Fs_pool */
+using PooledFileSystem = BasicFileSystem<PoolPolicy>;
+
+} /* namespace fs */
+
+#endif